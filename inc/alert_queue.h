@@ -15,9 +15,18 @@
 #pragma once
 #include <ee5>
 
+#include <array>
+#include <atomic>
 #include <cassert>
+#include <chrono>
 #include <condition_variable>
+#include <cstddef>
+#include <new>
+#include <type_traits>
+#include <hazard.h>
+#include <lock_profile.h>
 #include <spin_locking.h>
+#include <static_memory_pool.h>
 #include <workthread.h>
 
 BNS( ee5 )
@@ -46,7 +55,7 @@ private:
     // will have to lock the data values anyway and the added complexity of
     // having separate locks would end up creating more stalls.
     //
-    spin_flag   data_lock;
+    profiled_lock<spin_flag> data_lock{ EE5_LOCK_SITE( "smp_queue::data_lock" ) };
     T*          head;
     T*          tail;
 
@@ -119,6 +128,52 @@ public:
         } );
     }
 
+    // Remove up to max items with a single trip through the lock.
+    //
+    //  returns the number of items placed in out.
+    //
+    size_t dequeue_bulk( T** out, size_t max )
+    {
+        return framed_lock( data_lock, [&]()->size_t
+        {
+            size_t n = 0;
+
+            for( ; n < max && head; ++n )
+            {
+                out[n] = head;
+                head = head->next;
+                B::dec();
+            }
+
+            if( !head )
+            {
+                tail = nullptr;
+            }
+
+            if( n == 0 )
+            {
+                B::reset();
+            }
+
+            return n;
+        } );
+    }
+
+    // The _wait versions are only available with an aq::cv policy. They sleep while the
+    // queue is empty and return nullptr / 0 if nothing shows up before the timeout.
+    //
+    template<typename Rep, typename Period>
+    T* dequeue_wait( const std::chrono::duration<Rep,Period>& timeout )
+    {
+        return B::await( [this]() { return dequeue(); }, timeout );
+    }
+
+    template<typename Rep, typename Period>
+    size_t dequeue_bulk_wait( T** out, size_t max, const std::chrono::duration<Rep,Period>& timeout )
+    {
+        return B::await( [&,this]() { return dequeue_bulk( out, max ); }, timeout );
+    }
+
     T* peek()
     {
         return head;
@@ -126,6 +181,501 @@ public:
 };
 
 
+
+//-------------------------------------------------------------------------------------------------
+// smp_ring
+//
+//  A bounded multi-producer / multi-consumer ring of T* based on Dmitry Vyukov's sequence number
+//  queue. Unlike smp_queue there is no lock; each slot carries a sequence value that tells a
+//  producer (sequence == position) or a consumer (sequence == position + 1) that it is their
+//  turn. A producer or consumer only ever contends on the position counter for its side of the
+//  ring, and then touches a single slot.
+//
+//  Each slot is padded to a cache line so that a producer filling slot n doesn't stall the
+//  consumer emptying slot n-1. The two position counters are on separate cache lines for the
+//  same reason. This makes the ring "fat" (capacity * CACHE_ALIGN bytes), so size it for the
+//  expected burst and not the "worst case."
+//
+//  Because the ring is bounded, enqueue can fail. The try_ prefix is there to make sure the
+//  caller has a strategy for a full ring.
+//
+//  capacity must be a power of two. (The wrap is a mask instead of a divide.)
+//
+//  The B policy hooks behave the same as smp_queue. Because there isn't a lock around the hooks
+//  the policy is expected to be thread safe. (counter and cv are.)
+//
+template<typename T, size_t capacity, typename B>
+class ee5_alignas( CACHE_ALIGN ) smp_ring : public B
+{
+private:
+    static const std::memory_order release = std::memory_order_release;
+    static const std::memory_order relaxed = std::memory_order_relaxed;
+    static const std::memory_order acquire = std::memory_order_acquire;
+
+    static_assert( capacity >= 2,                       "The ring needs at least two slots." );
+    static_assert( ( capacity & ( capacity - 1 ) ) == 0,  "The ring capacity must be a power of two." );
+
+    static const size_t mask = capacity - 1;
+
+    struct ee5_alignas( CACHE_ALIGN ) slot
+    {
+        std::atomic_size_t  sequence;
+        T*                  item;
+    };
+
+    ee5_alignas( CACHE_ALIGN ) std::atomic_size_t   enqueue_pos;
+    ee5_alignas( CACHE_ALIGN ) std::atomic_size_t   dequeue_pos;
+    ee5_alignas( CACHE_ALIGN ) std::array<slot,capacity> slots;
+
+    // Claim up to count positions starting at the current position for one side of the ring.
+    // offset is 0 for producers (slot is empty) and 1 for consumers (slot is full).
+    //
+    // The slots are checked before the position is moved. If the CAS succeeds the caller owns
+    // every slot that was checked because no one else can touch a slot until the owner of that
+    // position bumps the sequence.
+    //
+    size_t claim( std::atomic_size_t& position, size_t offset, size_t count, size_t* first )
+    {
+        size_t pos = position.load( relaxed );
+
+        for(;;)
+        {
+            size_t ready = 0;
+
+            while( ready < count )
+            {
+                size_t seq = slots[ ( pos + ready ) & mask ].sequence.load( acquire );
+
+                if( seq != pos + ready + offset )
+                {
+                    break;
+                }
+                ++ready;
+            }
+
+            if( ready == 0 )
+            {
+                // The first slot wasn't ready. If the sequence is "behind" the ring is
+                // full / empty, otherwise another thread got here first and we try again
+                // from the new position.
+                //
+                size_t    seq  = slots[ pos & mask ].sequence.load( acquire );
+                ptrdiff_t diff = static_cast<ptrdiff_t>( seq ) - static_cast<ptrdiff_t>( pos + offset );
+
+                if( diff < 0 )
+                {
+                    return 0;
+                }
+
+                pos = position.load( relaxed );
+            }
+            else if( position.compare_exchange_weak( pos, pos + ready, relaxed, relaxed ) )
+            {
+                *first = pos;
+                return ready;
+            }
+        }
+    }
+
+public:
+    static const size_t max_item_count = capacity;
+
+    template<typename...TArgs>
+    smp_ring( TArgs...args ) : B( args... )
+    {
+        for( size_t i = 0; i < capacity; ++i )
+        {
+            slots[i].sequence.store( i, relaxed );
+            slots[i].item = nullptr;
+        }
+
+        enqueue_pos.store( 0, relaxed );
+        dequeue_pos.store( 0, relaxed );
+    }
+
+    smp_ring( const smp_ring& ) = delete;
+
+    // Lock free enqueue
+    //
+    //  returns false if the ring is full.
+    //
+    bool try_enqueue( T* item )
+    {
+        return try_enqueue_bulk( &item, 1 ) == 1;
+    }
+
+    // Lock free dequeue
+    //
+    //  returns nullptr if the ring is empty.
+    //
+    T* try_dequeue()
+    {
+        T* ret = nullptr;
+
+        try_dequeue_bulk( &ret, 1 );
+
+        return ret;
+    }
+
+    // Place up to count items into the ring with a single update to the producer position.
+    //
+    //  returns the number of items that were placed. The items are taken from the front of the
+    //  array so a partial enqueue leaves items[ret..count) to the caller.
+    //
+    size_t try_enqueue_bulk( T* const * items, size_t count )
+    {
+        size_t pos  = 0;
+        size_t done = claim( enqueue_pos, 0, count, &pos );
+
+        for( size_t i = 0; i < done; ++i )
+        {
+            slot& s = slots[ ( pos + i ) & mask ];
+
+            s.item = items[i];
+            s.sequence.store( pos + i + 1, release );
+
+            B::inc();
+        }
+
+        if( done )
+        {
+            B::set();
+        }
+
+        return done;
+    }
+
+    // Remove up to max items from the ring with a single update to the consumer position.
+    //
+    //  returns the number of items placed in out.
+    //
+    size_t try_dequeue_bulk( T** out, size_t max )
+    {
+        size_t pos  = 0;
+        size_t done = claim( dequeue_pos, 1, max, &pos );
+
+        for( size_t i = 0; i < done; ++i )
+        {
+            slot& s = slots[ ( pos + i ) & mask ];
+
+            out[i] = s.item;
+            s.sequence.store( pos + i + capacity, release );
+
+            B::dec();
+        }
+
+        if( !done )
+        {
+            B::reset();
+        }
+
+        return done;
+    }
+
+    // The _wait versions are only available with an aq::cv policy. They sleep while the
+    // ring is empty and return nullptr / 0 if nothing shows up before the timeout.
+    //
+    template<typename Rep, typename Period>
+    T* dequeue_wait( const std::chrono::duration<Rep,Period>& timeout )
+    {
+        return B::await( [this]() { return try_dequeue(); }, timeout );
+    }
+
+    template<typename Rep, typename Period>
+    size_t dequeue_bulk_wait( T** out, size_t max, const std::chrono::duration<Rep,Period>& timeout )
+    {
+        return B::await( [&,this]() { return try_dequeue_bulk( out, max ); }, timeout );
+    }
+};
+
+
+
+//-------------------------------------------------------------------------------------------------
+// lf_links
+//
+//  The links smp_lf_queue threads its items through. Every queue draws from one process wide
+//  static_memory_pool, and goes to the heap only when the pool is dry. (The pool outlives the
+//  queues on purpose. A retired link is freed by the global hazard_domain whenever a scan gets
+//  to it, which can be after the queue it came from is gone.)
+//
+class lf_links
+{
+public:
+    struct link
+    {
+        std::atomic<link*>  next;
+        void*               item;
+    };
+
+private:
+    static const size_t capacity = 4096;
+
+    using pool_t = static_memory_pool<sizeof( link ),capacity,alignof( link )>;
+
+    static pool_t& pool()
+    {
+        // Never destroyed, see above.
+        //
+        static std::aligned_storage<sizeof( pool_t ),alignof( pool_t )>::type storage;
+        static pool_t* links = new ( &storage ) pool_t();
+
+        return *links;
+    }
+
+public:
+    static link* acquire(void* item)
+    {
+        link* l = pool().acquire<link>();
+
+        if( l == nullptr )
+        {
+            l = new link;
+        }
+
+        l->next.store( nullptr, std::memory_order_relaxed );
+        l->item = item;
+
+        return l;
+    }
+
+    // Matches hazard_domain::deleter so a link can be retired straight back here.
+    //
+    static void release(void* l,void* = nullptr)
+    {
+        if( !pool().release( l ) )
+        {
+            delete static_cast<link*>( l );
+        }
+    }
+};
+
+
+
+//-------------------------------------------------------------------------------------------------
+// smp_lf_queue
+//
+//  An unbounded lock free queue (Michael & Scott, 1996). Producers only contend with producers
+//  on tail and consumers only contend with consumers on head. Neither side ever waits for a
+//  thread that was preempted in the middle of an operation, the next thread along finishes the
+//  lagging tail update and carries on.
+//
+//  The interface is the same as smp_queue: enqueue( T* ) and dequeue() -> T*, and the B policy
+//  hooks are called at the same points. The difference is that the items are NOT linked through
+//  T::next. The algorithm keeps a dummy node at the head of the list and the node that a
+//  dequeue "returns" becomes the new dummy, so an intrusive version would hand the caller a
+//  node the queue is still using. Instead each item rides in a link from lf_links, which is a
+//  pool pop and not a trip to the heap.
+//
+//  Memory reclamation:
+//
+//      A consumer that loses the race for head may still be reading the old head's next pointer
+//      after the winner is done with it. Freeing the link at that point is a use after free, and
+//      recycling it is the classic ABA problem. Each operation holds a hazard_domain::guard (on
+//      the global domain) for its duration, protects the links it dereferences, and retires the
+//      old dummy back to lf_links.
+//
+template<typename T, typename B>
+class ee5_alignas( CACHE_ALIGN ) smp_lf_queue : public B
+{
+private:
+    static const std::memory_order release = std::memory_order_release;
+    static const std::memory_order relaxed = std::memory_order_relaxed;
+    static const std::memory_order acquire = std::memory_order_acquire;
+
+    using link = lf_links::link;
+
+    ee5_alignas( CACHE_ALIGN ) std::atomic<link*>   head;
+    ee5_alignas( CACHE_ALIGN ) std::atomic<link*>   tail;
+
+    // The body of a dequeue with the guard already claimed. Both hazard slots are
+    // clear on return.
+    //
+    T* dequeue_one( hazard_domain::guard& hazards )
+    {
+        T* ret = nullptr;
+
+        for(;;)
+        {
+            link* h     = hazards.protect( 0, head );
+            link* t     = tail.load( acquire );
+            link* next  = hazards.protect( 1, h->next );
+
+            if( h != head.load( acquire ) )
+            {
+                continue;
+            }
+
+            if( next == nullptr )
+            {
+                break;
+            }
+
+            if( h == t )
+            {
+                // Tail is lagging behind, help it along.
+                //
+                tail.compare_exchange_weak( t, next, release, relaxed );
+                continue;
+            }
+
+            // The item has to be read before the exchange, once head moves next is the
+            // new dummy and the item belongs to whoever dequeues "through" it.
+            //
+            T* item = static_cast<T*>( next->item );
+
+            if( head.compare_exchange_weak( h, next, release, relaxed ) )
+            {
+                ret = item;
+                hazards.retire( h, lf_links::release );
+                break;
+            }
+        }
+
+        hazards.clear( 0 );
+        hazards.clear( 1 );
+
+        return ret;
+    }
+
+public:
+    template<typename...TArgs>
+    smp_lf_queue( TArgs...args ) : B( args... )
+    {
+        link* dummy = lf_links::acquire( nullptr );
+
+        head.store( dummy, relaxed );
+        tail.store( dummy, relaxed );
+    }
+
+    smp_lf_queue( const smp_lf_queue& ) = delete;
+
+    // As with the other containers, the queue has to be idle by the time it is destroyed.
+    // Items that are still queued are not touched, only the links are freed.
+    //
+    ~smp_lf_queue()
+    {
+        for( link* l = head.load(); l; )
+        {
+            link* next = l->next.load( relaxed );
+            lf_links::release( l );
+            l = next;
+        }
+    }
+
+    // Lock free enqueue
+    //
+    void enqueue( T* item )
+    {
+        {
+            hazard_domain::guard    hazards;
+            link*                   n = lf_links::acquire( item );
+
+            for(;;)
+            {
+                link* t     = hazards.protect( 0, tail );
+                link* next  = t->next.load( acquire );
+
+                if( t != tail.load( acquire ) )
+                {
+                    continue;
+                }
+
+                if( next != nullptr )
+                {
+                    // Tail is lagging behind, help it along.
+                    //
+                    tail.compare_exchange_weak( t, next, release, relaxed );
+                    continue;
+                }
+
+                link* expected = nullptr;
+                if( t->next.compare_exchange_weak( expected, n, release, relaxed ) )
+                {
+                    // Linked in. If this fails someone else already moved the tail.
+                    //
+                    tail.compare_exchange_strong( t, n, release, relaxed );
+                    break;
+                }
+            }
+        }
+
+        B::inc();
+        B::set();
+    }
+
+    // Lock free dequeue
+    //
+    //  returns nullptr if the queue is empty.
+    //
+    T* dequeue()
+    {
+        T* ret;
+
+        {
+            hazard_domain::guard hazards;
+
+            ret = dequeue_one( hazards );
+        }
+
+        if( ret )
+        {
+            B::dec();
+        }
+        else
+        {
+            B::reset();
+        }
+
+        return ret;
+    }
+
+    // Remove up to max items while holding a single guard.
+    //
+    //  returns the number of items placed in out.
+    //
+    size_t dequeue_bulk( T** out, size_t max )
+    {
+        size_t n = 0;
+
+        {
+            hazard_domain::guard hazards;
+
+            for( ; n < max; ++n )
+            {
+                out[n] = dequeue_one( hazards );
+
+                if( !out[n] )
+                {
+                    break;
+                }
+                B::dec();
+            }
+        }
+
+        if( n == 0 )
+        {
+            B::reset();
+        }
+
+        return n;
+    }
+
+    // The _wait versions are only available with an aq::cv policy. They sleep while the
+    // queue is empty and return nullptr / 0 if nothing shows up before the timeout.
+    //
+    template<typename Rep, typename Period>
+    T* dequeue_wait( const std::chrono::duration<Rep,Period>& timeout )
+    {
+        return B::await( [this]() { return dequeue(); }, timeout );
+    }
+
+    template<typename Rep, typename Period>
+    size_t dequeue_bulk_wait( T** out, size_t max, const std::chrono::duration<Rep,Period>& timeout )
+    {
+        return B::await( [&,this]() { return dequeue_bulk( out, max ); }, timeout );
+    }
+};
+
 class bare
 {
 protected:
@@ -147,53 +697,78 @@ protected:
 class counter : public bare
 {
 private:
-    volatile size_t c;
+    // The lock free containers call inc / dec without holding a lock so the
+    // count has to be atomic. The count is advisory so relaxed is enough.
+    //
+    std::atomic_size_t c;
 protected:
     counter()
     {
-        c = 0;
+        c.store( 0, std::memory_order_relaxed );
     }
     using bare::set;
     using bare::reset;
     void inc()
     {
-        ++c;
+        c.fetch_add( 1, std::memory_order_relaxed );
     }
     void dec()
     {
-        --c;
+        c.fetch_sub( 1, std::memory_order_relaxed );
     }
 public:
     size_t count()
     {
-        return c;
+        return c.load( std::memory_order_relaxed );
     }
 };
 
 
+//
+// The cv policy lets consumers sleep while the container is empty. It is built on an eventcount
+// and not the cv_event so that a reset() from one consumer can't wipe out a set() that another
+// consumer needs. reset() is kept for the containers but does nothing.
+//
+// set() is called on every enqueue, with no sleepers it costs a fence and a load.
+//
 template<typename B>
 class cv : public B
 {
 private:
-    ee5::cv_event evnt;
+    ee5::eventcount evnt;
 protected:
     cv()
     {
     }
     void set()
     {
-        evnt.set();
+        evnt.notify_one();
     }
     void reset()
     {
-        evnt.reset();
     }
     using B::inc;
     using B::dec;
+
+    template<typename F, typename Rep, typename Period>
+    auto await(F attempt, const std::chrono::duration<Rep,Period>& timeout) -> decltype( attempt() )
+    {
+        return evnt.await( attempt, timeout );
+    }
 public:
+    // Block until the next enqueue. Prefer dequeue_wait() on the container, which can't
+    // miss an item that arrived just before the call.
+    //
     void wait()
     {
-        evnt.wait();
+        evnt.commit_wait( evnt.prepare_wait() );
+    }
+
+    // Wake every thread that is sleeping in wait() / dequeue_wait(). (Shutdown, etc.)
+    //
+    void wake_all()
+    {
+        evnt.notify_all();
     }
 };
 
@@ -213,4 +788,28 @@ using smp_cv_queue_t = aq::smp_queue < T, aq::cv< aq::bare > > ;
 template<typename T>
 using smp_ccv_queue_t = aq::smp_queue < T, aq::cv< aq::counter > > ;
 
+template<typename T, size_t N>
+using smp_ring_t = aq::smp_ring < T, N, aq::bare > ;
+
+template<typename T, size_t N>
+using smp_c_ring_t = aq::smp_ring < T, N, aq::counter > ;
+
+template<typename T, size_t N>
+using smp_cv_ring_t = aq::smp_ring < T, N, aq::cv< aq::bare > > ;
+
+template<typename T, size_t N>
+using smp_ccv_ring_t = aq::smp_ring < T, N, aq::cv< aq::counter > > ;
+
+template<typename T>
+using smp_lf_queue_t = aq::smp_lf_queue < T, aq::bare > ;
+
+template<typename T>
+using smp_lf_c_queue_t = aq::smp_lf_queue < T, aq::counter > ;
+
+template<typename T>
+using smp_lf_cv_queue_t = aq::smp_lf_queue < T, aq::cv< aq::bare > > ;
+
+template<typename T>
+using smp_lf_ccv_queue_t = aq::smp_lf_queue < T, aq::cv< aq::counter > > ;
+
 ENS( ee5 )
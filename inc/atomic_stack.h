@@ -17,6 +17,8 @@
 
 #include <atomic>
 #include <cassert>
+#include <cstddef>
+#include <cstdint>
 
 BNS( ee5 )
 //-------------------------------------------------------------------------------------------------
@@ -55,10 +57,44 @@ private:
     //
     static const std::memory_order release = std::memory_order_release;
     static const std::memory_order relaxed = std::memory_order_relaxed;
+    static const std::memory_order acquire = std::memory_order_acquire;
 
-    std::atomic<T*> top; // Atomic storage for the top of the stack
+    // Top of the stack with a version tag
+    //
+    //  A pop reads top->next and then swaps top for it. If, between the two, top is popped, the
+    //  next item is popped, and the first one is pushed back (a pool handing the same buffer
+    //  back and forth does this all day long) the swap still sees the same pointer and installs
+    //  a next that isn't on the stack anymore. (ABA) Every change to top bumps the tag, so the
+    //  exchange fails instead.
+    //
+    //  On 64 bit builds the tag is the upper 16 bits of the word. (User space addresses are 47
+    //  bits on the platforms of interest.) On 32 bit builds the pointer and tag are both 32 bits.
+    //
+    using word = uint64_t;
+
+    static const unsigned   tag_shift   = sizeof( void* ) == 8 ? 48 : 32;
+    static const word       ptr_mask    = ( word( 1 ) << tag_shift ) - 1;
+
+    static T* ptr(word w)
+    {
+        return reinterpret_cast<T*>( static_cast<uintptr_t>( w & ptr_mask ) );
+    }
+
+    static word next_word(word prior,T* p)
+    {
+        assert( ( reinterpret_cast<uintptr_t>( p ) & ~ptr_mask ) == 0 );
+
+        return ( ( ( prior >> tag_shift ) + 1 ) << tag_shift ) | reinterpret_cast<uintptr_t>( p );
+    }
+
+    std::atomic<word> top; // Atomic storage for the top of the stack
 
 public:
+    atomic_stack() : top( 0 )
+    {
+    }
+    atomic_stack(const atomic_stack&) = delete;
+
     // Lock free push
     //
     void push(T* item)
@@ -70,7 +106,7 @@ public:
         // had issues with the ordering of the operations as of 2014
         // this is still likely a marginally more portable approach.
         //
-        T* prior_top = top.load( relaxed );
+        word prior_top = top.load( relaxed );
 
         do
         {
@@ -78,9 +114,9 @@ public:
             // will hopefully ~still~ be the value in top
             // at the point of the exchange below.
             //
-            item->next = prior_top;
+            item->next = ptr( prior_top );
         }
-        while( ! top.compare_exchange_weak( prior_top, item, release, relaxed) );
+        while( ! top.compare_exchange_weak( prior_top, next_word( prior_top, item ), release, relaxed) );
         //                                  |
         //                      if top STILL == prior_top then item is placed in top
         //                      and true is returned otherwise
@@ -91,12 +127,17 @@ public:
 
     // Lock free pop
     //
+    //  The memory behind the items has to stay valid while they are on the stack, ret->next is
+    //  read from an item another thread may have popped in the meantime. (The tag keeps the
+    //  stale value from being used.) static_memory_pool buffers are. If popped items are
+    //  freed, use the hazard pointer version below.
+    //
     T* pop()
     {
-        T* ret = top.load( relaxed );
+        word ret = top.load( acquire );
 
-        while( ret != nullptr && !top.compare_exchange_weak( ret, ret->next, release, relaxed ) );
-        //                                                   |
+        while( ptr( ret ) != nullptr && !top.compare_exchange_weak( ret, next_word( ret, ptr( ret )->next ), acquire, acquire ) );
+        //                                                          |
         //                                  if top STILL == ret then the routine will
         //                                  return true and we are done, otherwise
         //                                  ret is set to what the value of ret->next was
@@ -109,8 +150,341 @@ public:
         //
         //  The outer user of this should have a strategy in dealing with resource exhaustion.
         //
+        return ptr( ret );
+    }
+
+    // Lock free pop of items that are freed once popped
+    //
+    //  hazards is a hazard_domain::guard (or anything with set / clear). The top item is
+    //  published in hazard slot 0 before next is read, so a thread that popped it in the
+    //  meantime can't free it until this pop is done with it. Popped items must be handed to
+    //  the domain's retire instead of being freed directly.
+    //
+    template<typename H>
+    T* pop(H& hazards)
+    {
+        word ret = top.load( acquire );
+
+        for(;;)
+        {
+            T* item = ptr( ret );
+
+            if( item == nullptr )
+            {
+                break;
+            }
+
+            hazards.set( 0, item );
+
+            // The item was still on top after it was published, so any retire of it comes
+            // later and will see the hazard. (seq_cst: the re-read can't move above the
+            // store of the hazard.)
+            //
+            word check = top.load();
+
+            if( check != ret )
+            {
+                ret = check;
+                continue;
+            }
+
+            if( top.compare_exchange_weak( ret, next_word( ret, item->next ), acquire, acquire ) )
+            {
+                break;
+            }
+        }
+
+        hazards.clear( 0 );
+
+        return ptr( ret );
+    }
+
+    // Single attempt push
+    //
+    //  returns false if another thread changed top. (Contention, the item is NOT on the stack.)
+    //
+    bool try_push(T* item)
+    {
+        word prior_top = top.load( relaxed );
+
+        item->next = ptr( prior_top );
+
+        return top.compare_exchange_strong( prior_top, next_word( prior_top, item ), release, relaxed );
+    }
+
+    // Single attempt pop
+    //
+    //  returns false if another thread changed top. Otherwise returns true and out is the old
+    //  top, which is nullptr when the stack is empty.
+    //
+    bool try_pop(T*& out)
+    {
+        word ret = top.load( acquire );
+
+        if( ptr( ret ) == nullptr )
+        {
+            out = nullptr;
+            return true;
+        }
+
+        if( top.compare_exchange_strong( ret, next_word( ret, ptr( ret )->next ), acquire, relaxed ) )
+        {
+            out = ptr( ret );
+            return true;
+        }
+
+        return false;
+    }
+
+    // Lock free push of a prebuilt list
+    //
+    //  first..last must already be linked through next. The whole list goes on the stack with
+    //  a single successful exchange, so pushing n items costs the same contended atomic as
+    //  pushing one. first ends up on top.
+    //
+    void push_chain(T* first, T* last)
+    {
+        assert( first != nullptr && last != nullptr );
+
+        word prior_top = top.load( relaxed );
+
+        do
+        {
+            last->next = ptr( prior_top );
+        }
+        while( ! top.compare_exchange_weak( prior_top, next_word( prior_top, first ), release, relaxed) );
+    }
+
+    // Lock free pop of everything
+    //
+    //  A single exchange detaches the entire stack. The returned list is linked through next
+    //  and ends with nullptr. (Top of the stack first.)
+    //
+    T* pop_all()
+    {
+        word prior_top = top.load( relaxed );
+
+        while( ptr( prior_top ) != nullptr && !top.compare_exchange_weak( prior_top, next_word( prior_top, nullptr ), acquire, relaxed ) );
+
+        return ptr( prior_top );
+    }
+
+    // A snapshot, only "exact" when nothing else is running.
+    //
+    bool empty()
+    {
+        return ptr( top.load( acquire ) ) == nullptr;
+    }
+
+    // Lock free pop of up to n items
+    //
+    //  The first n items are detached with a single exchange. The returned list is linked
+    //  through next and ends with nullptr. If popped isn't null it receives the number of
+    //  items in the list.
+    //
+    //  The walk down the list has the same exposure as pop(). The nodes being walked are not
+    //  owned until the exchange succeeds, so the memory behind the items has to stay valid
+    //  while they are on the stack. (static_memory_pool is.)
+    //
+    T* pop_n(size_t n, size_t* popped = nullptr)
+    {
+        word    ret     = top.load( acquire );
+        T*      last    = nullptr;
+        size_t  count   = 0;
+
+        do
+        {
+            if( ptr( ret ) == nullptr || n == 0 )
+            {
+                ret     = 0;
+                count   = 0;
+                break;
+            }
+
+            last    = ptr( ret );
+            count   = 1;
+
+            while( count < n && last->next != nullptr )
+            {
+                last = last->next;
+                ++count;
+            }
+        }
+        while( !top.compare_exchange_weak( ret, next_word( ret, last->next ), acquire, acquire ) );
+
+        if( ptr( ret ) )
+        {
+            last->next = nullptr;
+        }
+
+        if( popped )
+        {
+            *popped = count;
+        }
+
+        return ptr( ret );
+    }
+};
+
+
+
+//-------------------------------------------------------------------------------------------------
+// elimination_stack
+//
+//  An atomic_stack with an elimination array in front of it. (Hendler, Shavit & Yerushalmi 2004)
+//
+//  Under heavy contention most of the CAS attempts on top fail, and every failure is another
+//  round trip for the cache line. A push and a pop that happen at the same time cancel each
+//  other out, so there is no need for either of them to touch top at all. When an attempt on
+//  the stack fails a thread goes to a random slot in a small side array instead:
+//
+//      push    parks the item in an empty slot and waits (briefly) for a pop to take it. If no
+//              pop shows up the item is taken back and the push tries the stack again.
+//
+//      pop     takes an item parked in a slot. If there isn't one it tries the stack again.
+//
+//  The slots are on their own cache lines, so the exchanges spread over many lines instead of
+//  piling up on one. Without contention every operation succeeds on the first CAS and the array
+//  is never touched, the cost over atomic_stack is a branch.
+//
+//  The bulk operations go straight to the stack.
+//
+//  slots:      Number of exchange slots. More slots means fewer collisions in the array but a
+//              lower chance that a push and pop meet. Somewhere around half the number of
+//              cores is a good start.
+//
+//  patience:   Number of spins a push waits in a slot for a partner.
+//
+template<typename T, size_t slots = 8, size_t patience = 128>
+class elimination_stack
+{
+private:
+    static const std::memory_order acquire = std::memory_order_acquire;
+    static const std::memory_order relaxed = std::memory_order_relaxed;
+
+    struct ee5_alignas( CACHE_ALIGN ) exchanger
+    {
+        std::atomic<T*> item;
+    };
+
+    ee5_alignas( CACHE_ALIGN ) atomic_stack<T>  stack;
+    ee5_alignas( CACHE_ALIGN ) exchanger        arena[slots];
+
+    // A cheap per thread xorshift for picking slots. Contending threads need to land on
+    // different slots, they don't need "good" random numbers.
+    //
+    static size_t pick()
+    {
+        static ee5_thread_local uint32_t x = 0;
+
+        if( x == 0 )
+        {
+            x = static_cast<uint32_t>( reinterpret_cast<uintptr_t>( &x ) >> 4 ) | 1;
+        }
+
+        x ^= x << 13;
+        x ^= x >> 17;
+        x ^= x << 5;
+
+        return x % slots;
+    }
+
+    bool eliminate_push(T* item)
+    {
+        exchanger&  e           = arena[ pick() ];
+        T*          expected    = nullptr;
+
+        if( !e.item.compare_exchange_strong( expected, item, std::memory_order_release, relaxed ) )
+        {
+            return false;   // Slot is busy
+        }
+
+        for( size_t spin = 0; spin < patience; ++spin )
+        {
+            if( e.item.load( relaxed ) != item )
+            {
+                return true;
+            }
+        }
+
+        // Nobody came. If the item can't be taken back, a pop got it at the last moment.
+        //
+        expected = item;
+        return !e.item.compare_exchange_strong( expected, nullptr, relaxed, relaxed );
+    }
+
+    T* eliminate_pop()
+    {
+        exchanger&  e       = arena[ pick() ];
+        T*          item    = e.item.load( acquire );
+
+        if( item && e.item.compare_exchange_strong( item, nullptr, acquire, relaxed ) )
+        {
+            return item;
+        }
+
+        return nullptr;
+    }
+
+public:
+    elimination_stack()
+    {
+        for( auto& e : arena )
+        {
+            e.item.store( nullptr, relaxed );
+        }
+    }
+    elimination_stack(const elimination_stack&) = delete;
+
+    void push(T* item)
+    {
+        assert( item != nullptr );
+
+        while( !stack.try_push( item ) && !eliminate_push( item ) )
+        {
+        }
+    }
+
+    // returns nullptr if the stack is empty. (Items parked in the array by pushes that haven't
+    // finished yet are not "on" the stack.)
+    //
+    T* pop()
+    {
+        T* ret = nullptr;
+
+        while( !stack.try_pop( ret ) )
+        {
+            ret = eliminate_pop();
+
+            if( ret )
+            {
+                break;
+            }
+        }
+
         return ret;
     }
+
+    void push_chain(T* first, T* last)
+    {
+        stack.push_chain( first, last );
+    }
+
+    T* pop_all()
+    {
+        return stack.pop_all();
+    }
+
+    T* pop_n(size_t n, size_t* popped = nullptr)
+    {
+        return stack.pop_n( n, popped );
+    }
 };
 
+// Default elimination_stack as a single parameter template. (For use as a template template
+// argument, i.e. static_memory_pool.)
+//
+template<typename T>
+using eliminating_stack = elimination_stack<T>;
+
 ENS( ee5 )
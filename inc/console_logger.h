@@ -16,8 +16,14 @@
 #include <ee5>
 
 
+#include <atomic_stack.h>
 #include <error.h>
 #include <logging.h>
+#include <log_binary.h>
+#include <log_record.h>
+#include <log_sink.h>
+#include <log_timestamp.h>
+#include <spsc_queue.h>
 #include <workthread.h>
 #include <static_memory_pool.h>
 
@@ -27,6 +33,7 @@
 #include <cstdlib>
 #include <ctime>
 #include <memory>
+#include <type_traits>
 #include <chrono>
 #include <thread>
 #include <cstdio>
@@ -44,29 +51,99 @@ struct
 //    alignas(size_t)
 LogLine
 {
+    struct line_deleter
+    {
+        void operator()(LogLine* l);
+    };
+
     using time_point    = std::chrono::high_resolution_clock::time_point;
     using mem_pool_t    = static_memory_pool<2048,1000>;
-    using log_line_ptr  = mem_pool_t::unique_type<LogLine>;
-
-    static const size_t msg_offset;
-    static mem_pool_t   mem;
+    using log_line_ptr  = std::unique_ptr<LogLine,line_deleter>;
+
+    // text        msg is the formatted line
+    // deferred    msg holds cb_msg bytes of log_args for info->format
+    // binary      msg is a binary_header, the log_args and the start of the payload
+    // binary_more the next cb_msg bytes of a binary line's payload
+    //
+    enum line_kind : uint32_t
+    {
+        text,
+        deferred,
+        binary,
+        binary_more
+    };
+
+    // A binary line in the ring holds all of its payload. One in the pool holds as much as
+    // fits and chains binary_more lines for the rest. (Released with the line.)
+    //
+    struct binary_header
+    {
+        LogLine*    chain;
+        uint64_t    cb_payload;     // The whole payload
+        uint64_t    cb_captured;    // What made it into the buffers
+        uint32_t    cb_args;
+        uint32_t    cb_here;        // Payload bytes in this line
+    };
+
+    // What create_buffer does when the pool is empty
+    //
+    //  overflow_block  wait (on a futex) up to overflow_wait for a buffer to come back, then
+    //                  drop the line
+    //  overflow_drop   drop the line right away
+    //  overflow_grow   take the buffer from the heap
+    //  overflow_write  fail, the caller formats the line on its own stack and writes it out
+    //                  itself (see ConsoleLogger)
+    //
+    //  Dropped lines are counted, and the logger writes the count into the log.
+    //
+    enum overflow_policy : uint32_t
+    {
+        overflow_block,
+        overflow_drop,
+        overflow_grow,
+        overflow_write
+    };
+
+    static const size_t                 msg_offset;
+    static mem_pool_t                   mem;
+    static std::atomic<overflow_policy> overflow;
+    static std::atomic<uint32_t>        overflow_wait_ms;
+    static std::atomic_size_t           dropped;
 
     time_point          time;
     const __info*       info;
     size_t              id;
     size_t              cb_msg;
+    line_kind           kind;
+    LogLine*            next;       // ConsoleLogger overflow stack
     char                msg[1];
 
+    static void set_overflow(overflow_policy policy,std::chrono::milliseconds wait = std::chrono::milliseconds( 100 ))
+    {
+        overflow_wait_ms.store( static_cast<uint32_t>( wait.count() ) );
+        overflow.store( policy );
+    }
+
+    // A buffer from the pool (or per the overflow policy), nullptr if there isn't one. Coming
+    // back empty handed counts as a dropped line, unless the buffer was only ever going to be
+    // part of a line. (count_drop false)
+    //
+    static LogLine* acquire(bool count_drop = true);
+
+    // Back to the pool (or the heap). The chain of a binary line goes with it.
+    //
+    static void release(LogLine* l);
+
     static RC create_buffer(size_t size,log_line_ptr& pBuffer,size_t* pcMsg = nullptr, char** ppMsg = nullptr)
     {
         CBREx( size <= mem_pool_t::max_item_size, e_invalid_argument( 1, "size must be larger than the structure") );
 
-        do
+        pBuffer.reset( acquire() );
+
+        if( !pBuffer )
         {
-            pBuffer = mem.acquire_unique<LogLine>( );
+            return e_pool_empty();
         }
-        while(!pBuffer);
-
 
         if(pcMsg)
         {
@@ -93,77 +170,146 @@ RC cb_vsnprintf(size_t c,char* p,size_t* pc,char** ppP,const char* fmt,va_list v
 
 //---------------------------------------------------------------------------------------------------------------------
 //
+//  Every thread that logs gets its own staging ring, and the lines are built in place in the
+//  ring. A log call never touches anything another logging thread writes to, so 32 threads
+//  logging at once don't contend with each other at all. The logger thread merges the rings
+//  (oldest line first) and writes the lines out.
+//
+//  A line that doesn't fit in the thread's ring goes through the shared LogLine pool and an
+//  overflow stack instead.
 //
+//  The rings are never freed. When a thread exits its ring is handed to the next thread that
+//  starts logging.
 //
+//  The formatted lines go to a log_sink (stdout unless SetSink says otherwise), which is
+//  flushed each time the logger runs out of lines. That is also when the lines turned away
+//  by rate limited sites are reported (no more than once a second).
 //
 namespace c = std::chrono;
 class ConsoleLogger
 {
 private:
     using hrc_t         = c::high_resolution_clock;
-    using sys_t         = c::system_clock;
-    using time_point    = c::high_resolution_clock::time_point;
-    using thread_t      = WorkThread<LogLinePtr>;
-    using thread_ptr    = std::unique_ptr<thread_t>;
-    using milli         = c::duration<uint64_t, std::milli>;
-    using micro         = c::duration<uint64_t, std::micro>;
-    static thread_ptr pThread;
+    using staging_ring  = spsc_record_ring<64 * 1024>;
+
+    struct staging
+    {
+        staging_ring        ring;
+        std::atomic_bool    owned;      // A thread is producing into the ring
+        staging*            next;       // Registry, never shrinks
+    };
+
+    // Hands the ring back when the thread goes away.
+    //
+    struct staging_owner
+    {
+        staging* s;
+
+        ~staging_owner()
+        {
+            if( s )
+            {
+                s->owned.store( false, std::memory_order_release );
+                s = nullptr;
+            }
+        }
+    };
+
+    // A line built on the caller's stack. (overflow_write, and the dropped line count)
+    //
+    using line_storage  = std::aligned_storage<LogLine::mem_pool_t::max_item_size,alignof( LogLine )>::type;
+
+    static std::atomic<staging*>    stagings;
+    static atomic_stack<LogLine>    overflow;
+    static eventcount               wake;
+    static std::atomic_bool         stopping;
+    static std::thread              logger;
+    static adaptive_mutex           write_lock;
+    static std::unique_ptr<log_sink> sink;
+    static std::atomic<uint64_t>    idle_passes;    // drain passes that found nothing
+    static log_timestamp            stamp;          // Under write_lock
+    static binary_renderer::style   binary_style;   // Under write_lock
+    static log_record::style        record_style;   // Under write_lock
+
+    static staging* local();
+    static void post(LogLine* line);
+    static void write(const LogLine* line);
+    static void report_dropped();
+    static void report_suppressed(bool now);
+    static void flush_sink();
+    static size_t drain();
+    static bool pending();
+    static void run();
+
+    static LogLine* claim(staging* s,const __info* i,size_t cb_record,LogLinePtr& pooled,line_storage& on_stack);
+    static void publish(staging* s,LogLine* l,LogLinePtr& pooled,line_storage& on_stack,size_t cb_record);
 
     static void console_log(const __info* i,...);
+    static void console_log_deferred(const __info* i,const void* args,size_t cb);
+    static void console_log_binary(const __info* i,const void* payload,size_t cb_payload,const void* args,size_t cb_args);
 
-    static void Doit(LogLinePtr& pLL)
-    {
-        // Convert the HRC time captured to time_t system clock representation
-        // then, convert it back. This will give use a value without the
-        // micro/milliseconds as the system clock truncates the value to seconds.
-        // The duration between the two is the fractional part which gets
-        // converted to the millisecond or microsecond value for the time stamp.
-        //
-        time_t          now     = hrc_t::to_time_t(pLL->time);
-        time_point      now_s   = sys_t::from_time_t(now);
-        hrc_t::duration d       = pLL->time - now_s;
-
-#ifdef _MSC_VER
-#pragma warning(disable: 4996)
-#endif
-        char buf[100];
-        std::strftime(buf, sizeof(buf), "%Y-%m-%dT%H:%M:%S", std::gmtime(&now));
-#ifdef _MSC_VER
-#pragma warning(default: 4996)
-#endif
-
-
-
-#ifdef _MSC_VER
-        auto  fraction  = c::duration_cast<milli>(d).count();
-        printf( "[%s.%03luZ]|%s|:%lx %s %s\n", buf, fraction, pLL->info->facility, pLL->id, pLL->info->function, pLL->msg );
-#else
-#pragma GCC diagnostic push
-#pragma GCC diagnostic ignored "-Wformat"
-        auto  fraction  = c::duration_cast<micro>(d).count();
-        printf("[%s.%06luZ]|%s|:%lx %s %s\n",buf, fraction,pLL->info->facility,pLL->id,pLL->info->function,pLL->msg);
-#pragma GCC diagnostic pop
-#endif
-        fflush( stdout );
-    }
+    static void Doit(const LogLine* pLL);
 
 protected:
 public:
-    static RC Startup(program_log* pLog)
+    static RC Startup(program_log* pLog,program_log_deferred* pDeferred,program_log_binary* pBinary)
     {
-        pThread.reset( new thread_t( 55, std::function<void(LogLinePtr&)>(ConsoleLogger::Doit) ) );
-        *pLog = ConsoleLogger::console_log;
-        return pThread->Startup();
+        if( !sink )
+        {
+            sink.reset( new stdio_sink() );
+        }
+
+        stopping.store( false );
+        logger      = std::thread( ConsoleLogger::run );
+        *pLog       = ConsoleLogger::console_log;
+        *pDeferred  = ConsoleLogger::console_log_deferred;
+        *pBinary    = ConsoleLogger::console_log_binary;
+        return s_ok();
     }
 
+    // Everything logged before the call is written out.
+    //
     static void Shutdown()
     {
-        pThread->Shutdown();
+        stopping.store( true );
+        wake.notify_all();
+
+        if( logger.joinable() )
+        {
+            logger.join();
+        }
+
+        flush_sink();
     }
 
+    // Where the lines go from here on. (stdout until then) The old sink is flushed and
+    // destroyed.
+    //
+    static RC SetSink(log_sink* s);
+
+    // How the time is written at the front of each line.
+    //
+    static void SetTimestamp(log_timestamp::style s);
+
+    // How LOG_BINARY payloads are written out.
+    //
+    static void SetBinaryStyle(binary_renderer::style s);
+
+    // How LOG_RECORD records are written out.
+    //
+    static void SetRecordStyle(log_record::style s);
+
+    // Everything logged before the call is written to the sink and the sink is flushed.
+    //
+    static void Flush();
+
+    // A line that is already formatted, msg is cb bytes. (Cut short to fit a LogLine.)
+    //
+    static void Write(const __info* i,const char* msg,size_t cb);
+
     static RC Enqueue(LogLinePtr&& p)
     {
-        pThread->Enqueue( std::forward<LogLinePtr>(p) );
+        post( p.release() );
 
         return s_ok();
     }
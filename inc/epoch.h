@@ -0,0 +1,202 @@
+//-------------------------------------------------------------------------------------------------
+// Copyright (C) 2014 Ernest R. Ewert
+//
+// Feel free to use this as you see fit.
+// I ask that you keep my name with the code.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+// MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+// IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+// OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+// ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+// OTHER DEALINGS IN THE SOFTWARE.
+//
+#pragma once
+#include <ee5>
+
+#include <error.h>
+#include <spin_locking.h>
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <thread>
+#include <vector>
+
+BNS( ee5 )
+//-------------------------------------------------------------------------------------------------
+// epoch_domain
+//
+//  Quiescent state based reclamation. (QSBR, McKenney & Slingwine)
+//
+//  A lock free structure can unlink a node, but it can't free it. Another thread may have loaded
+//  a pointer to the node just before it was unlinked and still be reading it. Instead the node
+//  is retired, and freed once every thread that might have seen it has been through a quiescent
+//  state: a point where the thread holds no references into any of the structures. For a
+//  WorkThread that point is the top of its loop, between work items, which costs the reader
+//  nothing. There are no read side barriers or counters at all.
+//
+//  The domain keeps a global epoch. A thread's quiescent() copies the global epoch into its
+//  record. retire() advances the global epoch and tags the item with the new value. Once every
+//  online thread's record has caught up to the tag the item can't be reachable from any of
+//  them and the deleter is called.
+//
+//  Threads that block (waiting on a signal, I/O) must go offline() first, or they hold up
+//  reclamation for everyone until they wake up. An offline thread may not hold references.
+//
+//      epoch_thread participant;                       // enter / leave for this thread
+//
+//      node* n = stack.pop();                          // unlink
+//      epoch_domain::global().retire_to( pool, n );    // freed into the pool later
+//
+//      ...
+//      epoch_domain::global().quiescent();             // no references held here
+//
+//  A thread that isn't a participant must not read the protected structures (see
+//  hazard_domain for that case), but it can retire into the domain. Its retires are freed by
+//  the participants' reclaim passes, it never waits on them.
+//
+//  The records come in blocks of block_records. When every record is taken another block is
+//  chained on, so any number of threads can participate. (Blocks are only freed with the
+//  domain.)
+//
+class epoch_domain
+{
+public:
+    static const size_t block_records = 128;
+
+    using deleter = void (*)(void* item,void* context);
+
+private:
+    static const std::memory_order release = std::memory_order_release;
+    static const std::memory_order relaxed = std::memory_order_relaxed;
+    static const std::memory_order acquire = std::memory_order_acquire;
+
+    static const uint64_t offline_epoch     = UINT64_MAX;   // Doesn't hold anything up
+    static const size_t   reclaim_threshold = 64;           // retires between reclaim passes
+    static const uint32_t reclaim_interval  = 64;           // quiescent states between passes
+
+    struct retired
+    {
+        void*       item;
+        deleter     release;
+        void*       context;
+        uint64_t    epoch;
+    };
+
+    using limbo_list = std::vector<retired>;
+
+    struct ee5_alignas( CACHE_ALIGN ) record
+    {
+        std::atomic<uint64_t>   epoch;      // Last epoch seen quiescent
+        std::atomic_bool        used;
+        limbo_list              limbo;      // Only touched by the owner
+        uint32_t                ticks;      // Only touched by the owner
+    };
+
+    struct ee5_alignas( CACHE_ALIGN ) block
+    {
+        std::atomic<size_t>     high_water; // Records handed out so far, from the front
+        std::atomic<block*>     next;
+        record                  records[block_records];
+
+        block();
+
+        static void* operator new(size_t cb);
+        static void operator delete(void* p);
+    };
+
+    ee5_alignas( CACHE_ALIGN ) std::atomic<uint64_t>    global_epoch;
+    ee5_alignas( CACHE_ALIGN ) std::atomic_bool         orphaned;   // orphans to reclaim
+    spin_mutex                                          orphan_lock;
+    limbo_list                                          orphans;
+    block                                               first;
+
+    record* self();
+    uint64_t oldest(const record* skip);
+    void reclaim(limbo_list& list,uint64_t safe);
+    void reclaim(record* r);
+    void reclaim_orphans(uint64_t safe);
+
+public:
+    epoch_domain();
+    ~epoch_domain();
+    epoch_domain(const epoch_domain&) = delete;
+
+    // The domain WorkThreads participate in.
+    //
+    static epoch_domain& global();
+
+    // Join / leave as a reader. Anything the thread retired and couldn't free yet is handed
+    // to the domain on leave.
+    //
+    //  enter returns e_overflow() when the thread is already in too many domains. The thread
+    //  is NOT a participant then, and must not read the protected structures.
+    //
+    RC enter();
+    void leave();
+    bool participating();
+
+    // The calling thread holds no references.
+    //
+    void quiescent();
+
+    // Going to block for a while (offline), and back (online).
+    //
+    void offline();
+    void online();
+
+    // Free item with release( item, context ) once no participant can be looking at it.
+    //
+    void retire(void* item,deleter release,void* context = nullptr);
+
+    template<typename P>
+    void retire_to(P& pool,void* item)
+    {
+        retire( item, [](void* i,void* p) { static_cast<P*>( p )->release( i ); }, &pool );
+    }
+
+    // Wait until everything retired so far (by this thread) is freed. The caller must not
+    // hold references.
+    //
+    void synchronize();
+
+    // Items retired by this thread (and orphans) not freed yet.
+    //
+    size_t pending();
+};
+
+
+
+//-------------------------------------------------------------------------------------------------
+// epoch_thread
+//
+//  Participate in a domain for the life of a scope. Check status(), the thread may not have
+//  gotten in.
+//
+class epoch_thread
+{
+    epoch_domain&   domain;
+    RC              rc;
+
+public:
+    epoch_thread(epoch_domain& d = epoch_domain::global()) : domain( d ), rc( d.enter() )
+    {
+    }
+    epoch_thread(const epoch_thread&) = delete;
+    ~epoch_thread()
+    {
+        if( rc == s_ok() )
+        {
+            domain.leave();
+        }
+    }
+
+    RC status() const
+    {
+        return rc;
+    }
+};
+
+ENS( ee5 )
@@ -33,6 +33,7 @@ typedef result_code_t   rc_t;
 #define e_pool_terminated()		static_cast<result_code_t>(0x8000000000000005)
 #define e_pool_empty()		    static_cast<result_code_t>(0x8000000000000006)
 #define e_to_large(a,m)         static_cast<result_code_t>(0x8000000000000007)
+#define e_io_failure()          static_cast<result_code_t>(0x8000000000000008)
 
 #define CBREx( x, e )   do { if ( !(x) )           { return (e);                   } } while(0)
 #define CMA( x )        do { if ( (x) == nullptr ) { return e_out_of_memory();     } } while(0)
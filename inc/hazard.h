@@ -0,0 +1,200 @@
+//-------------------------------------------------------------------------------------------------
+// Copyright (C) 2014 Ernest R. Ewert
+//
+// Feel free to use this as you see fit.
+// I ask that you keep my name with the code.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+// MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+// IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+// OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+// ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+// OTHER DEALINGS IN THE SOFTWARE.
+//
+#pragma once
+#include <ee5>
+
+#include <static_memory_pool.h>
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+BNS( ee5 )
+//-------------------------------------------------------------------------------------------------
+// hazard_domain
+//
+//  Hazard pointers. (Michael 2004)
+//
+//  epoch_domain only works for threads that regularly pass through a quiescent state. A thread
+//  blocked in a read (I/O), or a signal handler, can't promise that. With hazard pointers a
+//  reader instead publishes each pointer it is about to dereference in a hazard slot, and
+//  re-checks that the pointer is still reachable. A retired item is only freed once a scan of
+//  all of the slots doesn't find it. The cost moves to the reader (a store and a full fence
+//  per protected pointer) but nobody has to register, and a stalled thread holds up at most
+//  the few items in its slots.
+//
+//  The slots live in a fixed array of records inside the domain. A guard claims a record for
+//  its scope (each thread starts looking at "its" record, so the claim is an uncontended
+//  exchange in the normal case) and the record's retired list stays with the record between
+//  uses. smp_lf_queue and atomic_stack::pop( guard& ) both work this way.
+//
+//      hazard_domain::guard hazards;                   // claims a record
+//
+//      node* n = stack.pop( hazards );                 // next is read under the hazard
+//      hazards.retire_to( pool, n );                   // freed into the pool later
+//
+//  Retired entries come out of a static_memory_pool, so retiring normally never goes to the
+//  heap. A record scans its list once it holds scan_threshold entries (at least half of them
+//  can be freed at that point, so the scan is paid for by the retires). If the pool runs dry
+//  the retiring thread scans every idle record, and if that doesn't free an entry either it
+//  takes one from the heap. (Records held by long lived guards can tie up the whole pool, and
+//  nobody else can scan those, so waiting for an entry could wait forever.)
+//
+//  More than records_max guards alive at once spin waiting for a record to be handed back.
+//
+class hazard_domain
+{
+public:
+    static const size_t records_max = 64;
+    static const size_t slots       = 2;        // per record
+
+    static const size_t scan_threshold  = 2 * records_max * slots;     // retired before a scan
+    static const size_t retire_capacity = 4096;                         // pooled retired entries
+
+    using deleter = void (*)(void* item,void* context);
+
+private:
+    static const std::memory_order release = std::memory_order_release;
+    static const std::memory_order relaxed = std::memory_order_relaxed;
+    static const std::memory_order acquire = std::memory_order_acquire;
+
+    struct retired
+    {
+        void*       item;
+        deleter     release;
+        void*       context;
+        retired*    next;
+        bool        heap;       // Not from the pool
+    };
+
+    using retired_pool = static_memory_pool<sizeof( retired ),retire_capacity,alignof( retired )>;
+
+    struct ee5_alignas( CACHE_ALIGN ) record
+    {
+        std::atomic_bool    owned;
+        std::atomic<void*>  hazard[slots];
+        retired*            list;       // Only touched by the owner
+        size_t              count;      // Only touched by the owner
+    };
+
+    record          records[records_max];
+    retired_pool    pool;
+
+    record* claim();
+    record* try_claim(record& r);
+    void release_record(record* r);
+    void retire(record* r,void* item,deleter release,void* context);
+    void scan(record* r);
+    void scan_idle();
+    void free_entry(retired* e);
+
+public:
+    hazard_domain();
+    ~hazard_domain();
+    hazard_domain(const hazard_domain&) = delete;
+
+    // The domain for the lock free containers.
+    //
+    static hazard_domain& global();
+
+    //---------------------------------------------------------------------------------------------
+    // guard
+    //
+    //  A claimed record for the life of a scope. Every slot is cleared when the guard goes away.
+    //
+    class guard
+    {
+        hazard_domain&  domain;
+        record*         r;
+
+    public:
+        guard(hazard_domain& d = hazard_domain::global()) : domain( d ), r( d.claim() )
+        {
+        }
+        guard(const guard&) = delete;
+        ~guard()
+        {
+            domain.release_record( r );
+        }
+
+        // Publish p in a slot. (seq_cst: the store has to be visible before the caller
+        // re-checks that p is still reachable.)
+        //
+        void set(size_t slot,void* p)
+        {
+            r->hazard[slot].store( p );
+        }
+
+        void clear(size_t slot)
+        {
+            r->hazard[slot].store( nullptr, release );
+        }
+
+        // Load src and publish it in the slot. Once this returns the item can't be freed
+        // until the slot is cleared or reused.
+        //
+        template<typename T>
+        T* protect(size_t slot,const std::atomic<T*>& src)
+        {
+            T* p = src.load( acquire );
+
+            for(;;)
+            {
+                set( slot, p );
+
+                T* check = src.load();
+
+                if( check == p )
+                {
+                    return p;
+                }
+                p = check;
+            }
+        }
+
+        // Free item with release( item, context ) once no slot refers to it.
+        //
+        void retire(void* item,deleter release,void* context = nullptr)
+        {
+            domain.retire( r, item, release, context );
+        }
+
+        template<typename P>
+        void retire_to(P& pool,void* item)
+        {
+            retire( item, [](void* i,void* p) { static_cast<P*>( p )->release( i ); }, &pool );
+        }
+    };
+
+    // Retire without holding a guard. (A record is claimed just for the retire.)
+    //
+    void retire(void* item,deleter release,void* context = nullptr);
+
+    template<typename P>
+    void retire_to(P& pool,void* item)
+    {
+        retire( item, [](void* i,void* p) { static_cast<P*>( p )->release( i ); }, &pool );
+    }
+
+    // Scan every record no guard is holding, freeing what isn't protected.
+    //
+    void collect();
+
+    // Retired items not freed yet. (Only counts records no guard is holding.)
+    //
+    size_t pending();
+};
+
+ENS( ee5 )
@@ -0,0 +1,199 @@
+//-------------------------------------------------------------------------------------------------
+// Copyright (C) 2014 Ernest R. Ewert
+//
+// Feel free to use this as you see fit.
+// I ask that you keep my name with the code.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+// MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+// IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+// OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+// ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+// OTHER DEALINGS IN THE SOFTWARE.
+//
+#pragma once
+#include <ee5>
+
+#include <spin_locking.h>
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+
+BNS( ee5 )
+//-------------------------------------------------------------------------------------------------
+// lock profiling
+//
+//  The lock_test harness in tst_spin_locks times lock() from the outside. That is fine for
+//  picking a lock, but it says nothing about which locks are hot in a running program. A
+//  profiled_lock<L> is an L that keeps track of:
+//
+//      - acquisitions, and how many of them had to wait
+//      - spin iterations spent waiting (counted by the backoff policies)
+//      - log2 histograms of the wait time and the hold time (nanoseconds)
+//
+//  The numbers are kept per lock_site, a name and a source location. Every lock declared at
+//  the same place (every WorkThread::data_lock for example) adds to the same site, so the
+//  numbers outlive the locks. At ee5::Shutdown the sites are ranked by total wait time and
+//  written to the log.
+//
+//      profiled_lock<spin_mutex> data_lock{ EE5_LOCK_SITE( "WorkThread::data_lock" ) };
+//
+//  All of this is only built when EE5_LOCK_PROFILING is defined (for the library AND the code
+//  using it). Otherwise profiled_lock<L> is just an L, EE5_LOCK_SITE is nullptr and there is
+//  nothing left to cost anything.
+//
+//  L must be Lockable. (try_lock is used to tell a contended acquisition from an uncontended
+//  one.) Shared locking on a reader / writer L passes straight through and isn't profiled.
+//
+struct lock_site;
+
+void lock_profile_report();
+
+#ifndef EE5_LOCK_PROFILING
+
+#define EE5_LOCK_SITE( name ) nullptr
+
+template<typename L>
+class profiled_lock : public L
+{
+public:
+    profiled_lock(lock_site* = nullptr)
+    {
+    }
+};
+
+inline void lock_profile_report()
+{
+}
+
+#else
+
+#define EE5_LOCK_SITE( name ) \
+    ( []() -> ee5::lock_site* { static ee5::lock_site __site__( name, __FILE__, __LINE__ ); return &__site__; }() )
+
+
+//-------------------------------------------------------------------------------------------------
+// lock_site
+//
+//  The counters for the locks declared at one place. The counters are relaxed atomics, they
+//  only need to add up by the time the report is written.
+//
+struct lock_site
+{
+    static const size_t buckets = 40;   // 2^40 ns is about 18 minutes
+
+    using counter = std::atomic<uint64_t>;
+
+    const char*     name;
+    const char*     file;
+    size_t          line;
+    lock_site*      next;               // registry
+
+    counter         acquired;
+    counter         contended;
+    counter         spins;
+    counter         wait_ns;
+    counter         hold_ns;
+    counter         wait_histogram[buckets];
+    counter         hold_histogram[buckets];
+
+    lock_site(const char* n,const char* f,size_t l);
+    lock_site(const lock_site&) = delete;
+
+    static size_t bucket(uint64_t ns)
+    {
+        size_t b = 0;
+
+        while( ns > 1 && b < buckets - 1 )
+        {
+            ns >>= 1;
+            ++b;
+        }
+
+        return b;
+    }
+
+    void waited(uint64_t ns,uint64_t spun)
+    {
+        contended.fetch_add( 1, std::memory_order_relaxed );
+        spins.fetch_add( spun, std::memory_order_relaxed );
+        wait_ns.fetch_add( ns, std::memory_order_relaxed );
+        wait_histogram[ bucket( ns ) ].fetch_add( 1, std::memory_order_relaxed );
+    }
+
+    void held(uint64_t ns)
+    {
+        acquired.fetch_add( 1, std::memory_order_relaxed );
+        hold_ns.fetch_add( ns, std::memory_order_relaxed );
+        hold_histogram[ bucket( ns ) ].fetch_add( 1, std::memory_order_relaxed );
+    }
+
+    // For locks that were not given a site.
+    //
+    static lock_site* unnamed();
+};
+
+
+template<typename L>
+class profiled_lock : public L
+{
+private:
+    using clock = std::chrono::steady_clock;
+
+    lock_site*          site;
+    clock::time_point   since;  // Only touched by the owner
+
+    static uint64_t ns(clock::duration d)
+    {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>( d ).count();
+    }
+
+public:
+    profiled_lock(lock_site* s = nullptr) : site( s ? s : lock_site::unnamed() )
+    {
+    }
+
+    void lock()
+    {
+        if( L::try_lock() )
+        {
+            since = clock::now();
+            return;
+        }
+
+        uint64_t            spun    = lock_profile_spins;
+        clock::time_point   start   = clock::now();
+
+        L::lock();
+
+        since = clock::now();
+
+        site->waited( ns( since - start ), lock_profile_spins - spun );
+    }
+
+    bool try_lock()
+    {
+        if( L::try_lock() )
+        {
+            since = clock::now();
+            return true;
+        }
+        return false;
+    }
+
+    void unlock()
+    {
+        uint64_t held = ns( clock::now() - since );
+
+        L::unlock();
+
+        site->held( held );
+    }
+};
+
+#endif
+
+ENS( ee5 )
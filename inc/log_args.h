@@ -0,0 +1,202 @@
+//-------------------------------------------------------------------------------------------------
+// Copyright (C) 2014 Ernest R. Ewert
+//
+// Feel free to use this as you see fit.
+// I ask that you keep my name with the code.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+// MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+// IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+// OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+// ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+// OTHER DEALINGS IN THE SOFTWARE.
+//
+#pragma once
+#include <ee5>
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <type_traits>
+
+BNS( ee5 )
+//-------------------------------------------------------------------------------------------------
+// log_args
+//
+//  Deferred formatting. (The idea is from NanoLog, Yang et al. 2018)
+//
+//  A printf style log call spends almost all of its time in vsnprintf, on the thread that is
+//  doing the logging. The format string is already known at compile time (it lives in the
+//  static __info for the call site), so the only thing the caller really has to capture is the
+//  argument values. The arguments are copied as raw bytes and the format string is applied
+//  later, on the logger thread or by an offline decoder.
+//
+//  Every argument is a one byte tag followed by the value:
+//
+//      arg_signed      8 bytes     every signed integral type (and enums) widened to int64_t
+//      arg_unsigned    8 bytes     every unsigned integral type widened to uint64_t
+//      arg_double      8 bytes     float and double (long double is narrowed)
+//      arg_pointer     8 bytes     any other pointer, nullptr, and null strings
+//      arg_string      10 + n bytes    the pointer, the length and the characters of a char*
+//                                      (no terminator)
+//
+//  Strings have to be copied, the pointer may not be valid by the time the line is formatted.
+//  The pointer value is kept as well, for a %p that is handed a char*.
+//  The encoded arguments are limited to max_size bytes. A string that doesn't fit is cut
+//  short, and an argument with no room left is dropped. (The decoder prints "(?)" for it.)
+//
+//  Only types printf could have taken can be captured. Anything else fails to compile.
+//
+struct log_args
+{
+    enum tag : uint8_t
+    {
+        arg_signed = 1,
+        arg_unsigned,
+        arg_double,
+        arg_pointer,
+        arg_string
+    };
+
+    static const size_t max_size = 1024;
+
+    class writer
+    {
+        uint8_t*    p;
+        uint8_t*    end;
+
+        void put(tag t,const void* v,size_t cb)
+        {
+            if( static_cast<size_t>( end - p ) >= cb + 1 )
+            {
+                *p++ = t;
+                std::memcpy( p, v, cb );
+                p += cb;
+            }
+            else
+            {
+                end = p;    // Nothing after a dropped argument, the order has to hold.
+            }
+        }
+
+    public:
+        writer(uint8_t* out,size_t cb) : p( out ), end( out + cb )
+        {
+        }
+
+        uint8_t* position() const
+        {
+            return p;
+        }
+
+        template<typename T>
+        typename std::enable_if<std::is_integral<T>::value && std::is_signed<T>::value>::type add(T v)
+        {
+            int64_t w = v;
+            put( arg_signed, &w, sizeof( w ) );
+        }
+
+        template<typename T>
+        typename std::enable_if<std::is_integral<T>::value && std::is_unsigned<T>::value>::type add(T v)
+        {
+            uint64_t w = v;
+            put( arg_unsigned, &w, sizeof( w ) );
+        }
+
+        template<typename T>
+        typename std::enable_if<std::is_enum<T>::value>::type add(T v)
+        {
+            add( static_cast<typename std::underlying_type<T>::type>( v ) );
+        }
+
+        template<typename T>
+        typename std::enable_if<std::is_floating_point<T>::value>::type add(T v)
+        {
+            double w = static_cast<double>( v );
+            put( arg_double, &w, sizeof( w ) );
+        }
+
+        void add(const void* v)
+        {
+            uint64_t w = reinterpret_cast<uintptr_t>( v );
+            put( arg_pointer, &w, sizeof( w ) );
+        }
+
+        void add(std::nullptr_t)
+        {
+            add( static_cast<const void*>( nullptr ) );
+        }
+
+        void add(const char* s)
+        {
+            if( s == nullptr )
+            {
+                add( static_cast<const void*>( nullptr ) );
+                return;
+            }
+
+            uint64_t    w       = reinterpret_cast<uintptr_t>( s );
+            size_t      room    = end - p;
+            size_t      header  = 1 + sizeof( w ) + sizeof( uint16_t );
+
+            if( room < header )
+            {
+                end = p;
+                return;
+            }
+
+            size_t cb = std::min<size_t>( std::strlen( s ), room - header );
+            uint16_t n = static_cast<uint16_t>( std::min<size_t>( cb, UINT16_MAX ) );
+
+            *p++ = arg_string;
+            std::memcpy( p, &w, sizeof( w ) );
+            p += sizeof( w );
+            std::memcpy( p, &n, sizeof( n ) );
+            p += sizeof( n );
+            std::memcpy( p, s, n );
+            p += n;
+        }
+
+        void add(char* s)
+        {
+            add( static_cast<const char*>( s ) );
+        }
+    };
+
+    // Encode args into out, returns the number of bytes used.
+    //
+    template<typename... A>
+    static size_t encode(uint8_t* out,size_t cb,A... args)
+    {
+        writer w( out, cb );
+
+        int expand[] = { 0, ( w.add( args ), 0 )... };
+        (void)expand;
+
+        return w.position() - out;
+    }
+
+    // Walks encoded arguments in order. next() is false at the end, or at an argument that
+    // was cut short.
+    //
+    struct reader
+    {
+        const uint8_t*  p;
+        const uint8_t*  end;
+
+        reader(const void* args,size_t cb) : p( static_cast<const uint8_t*>( args ) ), end( static_cast<const uint8_t*>( args ) + cb )
+        {
+        }
+
+        bool next(tag& t,uint64_t& value,const char*& s,size_t& cb);
+    };
+
+    // Apply fmt to encoded arguments. Works like snprintf: the output is always terminated and
+    // the return is the number of characters written. (Not counting the terminator.)
+    //
+    static size_t format(char* out,size_t cb,const char* fmt,const void* args,size_t cb_args);
+};
+
+ENS( ee5 )
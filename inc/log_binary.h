@@ -0,0 +1,64 @@
+//-------------------------------------------------------------------------------------------------
+// Copyright (C) 2014 Ernest R. Ewert
+//
+// Feel free to use this as you see fit.
+// I ask that you keep my name with the code.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+// MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+// IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+// OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+// ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+// OTHER DEALINGS IN THE SOFTWARE.
+//
+#pragma once
+#include <ee5>
+
+#include <cstddef>
+#include <cstdint>
+
+BNS( ee5 )
+//-------------------------------------------------------------------------------------------------
+// binary_renderer
+//
+//  Turns a LOG_BINARY payload into text on the logger thread. The payload can come in any
+//  number of pieces (it is spread over a chain of buffers), a row may straddle two pieces.
+//
+//  hex         00000000: 47 45 54 20 2f 20 48 54 54 50 2f 31 2e 31 0d 0a  |GET / HTTP/1.1..|
+//  base64      76 characters a row
+//
+//  Each row goes to emit( row, cb, context ) with the trailing newline.
+//
+class binary_renderer
+{
+public:
+    enum style : uint32_t
+    {
+        hex,
+        base64
+    };
+
+    using emit_fn = void (*)(const char* row,size_t cb,void* context);
+
+    static const size_t hex_row     = 16;   // bytes a row
+    static const size_t base64_row  = 57;   // bytes a row (76 characters)
+
+private:
+    style       format;
+    emit_fn     emit;
+    void*       context;
+    uint64_t    offset;                     // of pending[0] in the payload
+    uint8_t     pending[base64_row];
+    size_t      cb_pending;
+
+    void row(const uint8_t* p,size_t cb);
+
+public:
+    binary_renderer(style s,emit_fn e,void* c);
+
+    void add(const void* p,size_t cb);
+    void finish();
+};
+
+ENS( ee5 )
@@ -0,0 +1,68 @@
+//-------------------------------------------------------------------------------------------------
+// Copyright (C) 2014 Ernest R. Ewert
+//
+// Feel free to use this as you see fit.
+// I ask that you keep my name with the code.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+// MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+// IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+// OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+// ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+// OTHER DEALINGS IN THE SOFTWARE.
+//
+#pragma once
+#include <ee5>
+
+#include <logging.h>
+
+#include <cstddef>
+#include <cstdint>
+
+BNS( ee5 )
+//-------------------------------------------------------------------------------------------------
+// log_record
+//
+//  Renders a LOG_RECORD on the logger side, the site's field names next to the captured
+//  values.
+//
+//  json        one line
+//
+//      {"time":"2014-06-01T12:00:00.000123Z","facility":"KaZa","thread":3,"function":"void f()",
+//       "file":"f.cpp","line":12,"msg":"request done","method":"GET","status":200,"elapsed_ms":1.25}
+//
+//      Integers and doubles are numbers (null for a double that isn't finite), strings are
+//      escaped, pointers are "0x..." strings (null for nullptr). A value that didn't fit in the
+//      captured arguments is null. If out is too small the fields that don't fit are left off,
+//      the line is still whole.
+//
+//  binary      a frame that describes itself (integers in host order)
+//
+//      uint32_t    bytes in the frame after this
+//      uint8_t     version
+//      int64_t     time, ns since the epoch
+//      uint64_t    thread
+//      uint32_t    line
+//      4 strings   facility, function, file and msg, each a uint16_t length and the characters
+//      uint8_t     fields
+//      per field   a uint8_t length and the name, then the value as log_args encodes it
+//
+//  Both return the bytes written to out. (Not terminated.)
+//
+struct log_record
+{
+    enum style : uint32_t
+    {
+        json,
+        binary
+    };
+
+    static const uint8_t    version     = 1;
+    static const size_t     max_size    = 8192;     // Enough for any record. (escaping included)
+
+    static size_t render_json(char* out,size_t cb,const __info* i,const char* when,size_t thread,const void* args,size_t cb_args);
+    static size_t render_binary(char* out,size_t cb,const __info* i,int64_t ns,size_t thread,const void* args,size_t cb_args);
+};
+
+ENS( ee5 )
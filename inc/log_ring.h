@@ -0,0 +1,132 @@
+//-------------------------------------------------------------------------------------------------
+// Copyright (C) 2014 Ernest R. Ewert
+//
+// Feel free to use this as you see fit.
+// I ask that you keep my name with the code.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+// MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+// IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+// OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+// ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+// OTHER DEALINGS IN THE SOFTWARE.
+//
+#pragma once
+#include <ee5>
+
+#include <error.h>
+#include <logging.h>
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <string>
+
+BNS( ee5 )
+//-------------------------------------------------------------------------------------------------
+// MappedLogRing
+//
+//  A flight recorder. Whatever is still in ConsoleLogger's rings when the process crashes is
+//  gone, and those are the lines that matter most. Here the log calls write straight into a
+//  shared mapping of a file. Once a record is written it is in the page cache and the file
+//  has it, whatever happens to the process. (A kernel crash or power loss is another story.)
+//
+//  The file is a header page followed by a ring of fixed size slots:
+//
+//      begin       the record's sequence number (+1), written first
+//      end         the same, written last
+//      time        nanoseconds since the epoch
+//      parts       slots the record takes (consecutive)
+//      part        this slot's place in the record
+//      cb_text     the formatted line (the whole record)
+//      cb_payload  LOG_BINARY bytes after the text (the whole record)
+//      data        slot_size - 40 bytes of the record
+//
+//  A producer reserves its slots with one fetch_add on the header and fills them in. There is
+//  no logger thread. A slot whose begin and end don't match was being written when the
+//  process died, or was lapped by a newer record part way through, and the reader skips the
+//  whole record.
+//
+//  The line is formatted on the caller's thread (a format string means nothing to the reader
+//  once the process is gone). Deferred log calls are formatted here too.
+//
+//  Opening an existing ring keeps the records in it, the numbering carries on from where it
+//  was. Dump (and the logdump tool) print the last records of a ring file, oldest first.
+//
+//      MappedLogRing::options o;
+//      o.path = "/var/tmp/app.ring";
+//      MappedLogRing::Install( o );        // LOG_* go to the ring (and the console with tee)
+//
+class MappedLogRing
+{
+public:
+    struct options
+    {
+        std::string     path;
+        size_t          slots       = 16384;    // rounded up to a power of 2
+        size_t          slot_size   = 256;      // rounded up to a power of 2, 64 at least
+        bool            tee         = false;    // also hand the lines to the logger installed before
+    };
+
+    struct file_header
+    {
+        char                    magic[8];
+        uint32_t                version;
+        uint32_t                slot_size;
+        uint64_t                slots;
+        std::atomic<uint64_t>   next;           // slots handed out so far
+        int64_t                 created;        // ns since the epoch
+    };
+
+    struct slot
+    {
+        std::atomic<uint64_t>   begin;
+        std::atomic<uint64_t>   end;
+        int64_t                 time;
+        uint32_t                parts;
+        uint32_t                part;
+        uint32_t                cb_text;
+        uint32_t                cb_payload;
+        char                    data[8];        // really slot_size - offsetof( slot, data )
+    };
+
+    static const size_t header_size = 4096;
+    static const uint32_t version   = 1;
+
+private:
+    static std::atomic<file_header*>    header;
+    static bool                         tee;
+    static program_log                  previous;
+    static program_log_deferred         previous_deferred;
+    static program_log_binary           previous_binary;
+
+    static slot* at(file_header* h,uint64_t n)
+    {
+        return reinterpret_cast<slot*>( reinterpret_cast<char*>( h ) + header_size + ( n & ( h->slots - 1 ) ) * h->slot_size );
+    }
+
+    static void record(const char* text,size_t cb_text,const void* payload,size_t cb_payload);
+    static size_t line(char* out,size_t cb,const __info* i,const char* msg);
+
+    static void ring_log(const __info* i,...);
+    static void ring_log_deferred(const __info* i,const void* args,size_t cb);
+    static void ring_log_binary(const __info* i,const void* payload,size_t cb_payload,const void* args,size_t cb_args);
+
+public:
+    // Map the ring and point the LOG_* calls at it. (after ee5::Startup)
+    //
+    static RC Install(const options& o);
+
+    // The LOG_* calls go back to what they were. The mapping stays, a thread may still be in
+    // the middle of a record.
+    //
+    static void Uninstall();
+
+    // The last count records of a ring file, oldest first.
+    //
+    static RC Dump(const char* path,size_t count,FILE* out);
+};
+
+ENS( ee5 )
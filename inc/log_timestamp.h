@@ -0,0 +1,178 @@
+//-------------------------------------------------------------------------------------------------
+// Copyright (C) 2014 Ernest R. Ewert
+//
+// Feel free to use this as you see fit.
+// I ask that you keep my name with the code.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+// MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+// IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+// OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+// ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+// OTHER DEALINGS IN THE SOFTWARE.
+//
+#pragma once
+#include <ee5>
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <ctime>
+
+BNS( ee5 )
+//-------------------------------------------------------------------------------------------------
+// log_timestamp
+//
+//  The time stamp at the front of every log line. gmtime and strftime are the expensive part,
+//  and every line logged in the same second has the same "%Y-%m-%dT%H:%M:%S". That string is
+//  made once per second and kept. The fraction is written with a fixed width integer to ascii.
+//
+//  style
+//
+//      iso_micro   2014-06-01T12:00:00.123456Z
+//      iso_milli   2014-06-01T12:00:00.123Z
+//      raw_ns      1401624000123456789         nanoseconds since the epoch, for output that
+//                                              is read by a program and not a person
+//
+//  Not thread safe, each writer keeps its own.
+//
+class log_timestamp
+{
+public:
+    enum style : uint32_t
+    {
+        iso_micro,
+        iso_milli,
+        raw_ns
+    };
+
+    static const size_t max_size = 40;  // Including the terminator
+
+private:
+    style       format;
+    int64_t     second;                 // The second prefix is for
+    char        prefix[32];
+    size_t      cb_prefix;
+
+    // Exactly width digits, leading zeros.
+    //
+    static char* fixed(char* out,uint64_t v,size_t width)
+    {
+        for( size_t d = width; d > 0; --d )
+        {
+            out[d - 1] = static_cast<char>( '0' + v % 10 );
+            v /= 10;
+        }
+        return out + width;
+    }
+
+    static char* digits(char* out,uint64_t v)
+    {
+        char    backwards[20];
+        size_t  n = 0;
+
+        do
+        {
+            backwards[n++] = static_cast<char>( '0' + v % 10 );
+            v /= 10;
+        }
+        while( v );
+
+        while( n )
+        {
+            *out++ = backwards[--n];
+        }
+        return out;
+    }
+
+    void cache(int64_t s)
+    {
+        time_t  t = static_cast<time_t>( s );
+        tm      parts;
+
+#ifdef _MSC_VER
+        gmtime_s( &parts, &t );
+#else
+        gmtime_r( &t, &parts );
+#endif
+        cb_prefix   = std::strftime( prefix, sizeof( prefix ), "%Y-%m-%dT%H:%M:%S", &parts );
+        second      = s;
+    }
+
+public:
+    log_timestamp(style s = iso_micro) : format( s ), second( INT64_MIN ), cb_prefix( 0 )
+    {
+        prefix[0] = 0;
+    }
+
+    void set_style(style s)
+    {
+        format = s;
+    }
+
+    style get_style() const
+    {
+        return format;
+    }
+
+    // out has room for max_size. Returns the length, out is terminated.
+    //
+    //  The clock's epoch has to be the system clock's. (It is for high_resolution_clock
+    //  everywhere this builds.)
+    //
+    template<typename TP>
+    size_t render(char* out,TP time)
+    {
+        int64_t ns      = std::chrono::duration_cast<std::chrono::nanoseconds>( time.time_since_epoch() ).count();
+        int64_t s       = ns / 1000000000;
+        int64_t frac    = ns % 1000000000;
+        char*   p       = out;
+
+        if( frac < 0 )
+        {
+            frac += 1000000000;
+            s    -= 1;
+        }
+
+        if( format == raw_ns )
+        {
+            if( ns < 0 )
+            {
+                *p++ = '-';
+                ns   = -ns;
+            }
+
+            p = digits( p, static_cast<uint64_t>( ns ) );
+            *p = 0;
+            return p - out;
+        }
+
+        if( s != second )
+        {
+            cache( s );
+        }
+
+        std::memcpy( p, prefix, cb_prefix );
+        p += cb_prefix;
+
+        *p++ = '.';
+
+        if( format == iso_milli )
+        {
+            p = fixed( p, frac / 1000000, 3 );
+        }
+        else
+        {
+            p = fixed( p, frac / 1000, 6 );
+        }
+
+        *p++ = 'Z';
+        *p   = 0;
+
+        return p - out;
+    }
+};
+
+ENS( ee5 )
@@ -23,11 +23,15 @@
 //******
 
 
+#include "log_args.h"
 #include "stopwatch.h"
 
+#include <atomic>
+#include <chrono>
 #include <cstdint>
 #include <cstddef>
 #include <cstdlib>
+#include <sstream>
 
 
 BNS( ee5 )
@@ -35,20 +39,313 @@ BNS( ee5 )
 #define LOG_FACILITY "KaZa"
 
 
+//-------------------------------------------------------------------------------------------------
+// Levels and zones
+//
+//  Every call site has a level and a zone. A zone is a bit (or bits) picked by the code doing
+//  the logging, the facility decides what they mean.
+//
+//  Compile time: a site whose level is above EE5_LOG_LEVEL, or whose zone has no bits in
+//  EE5_LOG_ZONES, is gone. The arguments aren't even evaluated.
+//
+//      -DEE5_LOG_LEVEL=3           errors, warnings and LOG_MSG only
+//      -DEE5_LOG_ZONES=0x0000000F  zones 0 - 3 only
+//
+//  Run time: each facility has a level and a zone mask (log_set_level, log_set_zones), and a
+//  single site can be switched on or off no matter what its facility says (log_set_site). The
+//  answer is kept in the site itself, so a site that is turned off costs one relaxed load and
+//  a branch. Changing the settings updates every site that has been reached so far.
+//
+//  By default everything up to level_info is on, LOG_DEBUG and LOG_ENTRY / LOG_FRAME are off.
+//
+enum log_level : std::uint32_t
+{
+    level_always    = 0,    // LOG_ALWAYS, never filtered
+    level_error     = 1,
+    level_warning   = 2,
+    level_info      = 3,    // LOG_MSG
+    level_debug     = 4,    // LOG_DEBUG
+    level_trace     = 5     // LOG_ENTRY, LOG_FRAME
+};
+
+const std::uint32_t log_zone_all = 0xFFFFFFFF;
+
+#ifndef EE5_LOG_LEVEL
+#define EE5_LOG_LEVEL 5
+#endif
+
+#ifndef EE5_LOG_ZONES
+#define EE5_LOG_ZONES 0xFFFFFFFF
+#endif
+
+
+
+//-------------------------------------------------------------------------------------------------
+// log_limit
+//
+//  Rate limiting for one call site, so a line in a hot loop can't flood the logger.
+//
+//      limit_every     one line in every n gets through (sampling)
+//      limit_rate      n lines a second, in bursts of up to burst lines (a token bucket)
+//
+//  A line gets through with a single relaxed atomic operation, a fetch_add for limit_every
+//  and a compare and swap for limit_rate. (The token bucket keeps the time the bucket is full
+//  again rather than a count of tokens, so taking a token and refilling the bucket are the
+//  same operation.)
+//
+//  The lines turned away are counted, and the logger reports the counts about once a second
+//  (see log_take_suppressed).
+//
+struct log_limit
+{
+    enum limit_mode : std::uint32_t
+    {
+        limit_every,
+        limit_rate
+    };
+
+    const limit_mode            mode;
+    const std::uint32_t         n;
+    const std::uint64_t         interval_ns;    // limit_rate, between tokens
+    const std::uint64_t         tolerance_ns;   // limit_rate, burst tokens
+    std::atomic<std::uint64_t>  count;          // limit_every calls, limit_rate lines turned away
+    std::atomic<std::uint64_t>  full;           // limit_rate, when the bucket is full again (ns)
+    std::uint64_t               reported;       // suppressed lines reported so far
+
+    constexpr log_limit(limit_mode m,std::uint32_t per,std::uint32_t burst = 0) :
+        mode( m ),
+        n( per ? per : 1 ),
+        interval_ns( 1000000000 / ( per ? per : 1 ) ),
+        tolerance_ns( std::uint64_t( burst ? burst : ( per ? per : 1 ) ) * ( 1000000000 / ( per ? per : 1 ) ) ),
+        count( 0 ),
+        full( 0 ),
+        reported( 0 )
+    {
+    }
+
+    bool admit()
+    {
+        if( mode == limit_every )
+        {
+            return count.fetch_add( 1, std::memory_order_relaxed ) % n == 0;
+        }
+
+        std::uint64_t now   = std::chrono::duration_cast<std::chrono::nanoseconds>( std::chrono::steady_clock::now().time_since_epoch() ).count();
+        std::uint64_t when  = full.load( std::memory_order_relaxed );
+
+        for(;;)
+        {
+            std::uint64_t next = ( when > now ? when : now ) + interval_ns;
+
+            if( next - now > tolerance_ns )
+            {
+                count.fetch_add( 1, std::memory_order_relaxed );
+                return false;
+            }
+
+            if( full.compare_exchange_weak( when, next, std::memory_order_relaxed ) )
+            {
+                return true;
+            }
+        }
+    }
+
+    // Lines turned away so far.
+    //
+    std::uint64_t suppressed() const
+    {
+        std::uint64_t c = count.load( std::memory_order_relaxed );
+
+        return mode == limit_every ? c - ( c + n - 1 ) / n : c;
+    }
+};
+
+
+
+//-------------------------------------------------------------------------------------------------
+// __info
+//
+//  One per call site. state is the cached run time answer:
+//
+//      site_unknown    not reached yet, log_resolve looks it up
+//      site_off
+//      site_on
+//      site_limited    on, but limit decides line by line
+//
 struct __info
 {
-    std::uint64_t   code;
-    const char*     function;
-    const char*     facility;
-    const char*     file;
-    const char*     format;
-    std::size_t     line;
+    enum : std::uint32_t
+    {
+        site_unknown,
+        site_off,
+        site_on,
+        site_limited
+    };
+
+    std::uint64_t                       code;
+    const char*                         function;
+    const char*                         facility;
+    const char*                         file;
+    const char*                         format;
+    const char*                         fields;     // LOG_RECORD field names, comma separated
+    std::size_t                         line;
+    std::uint32_t                       zone;
+    std::uint32_t                       level;
+    mutable std::atomic<std::uint32_t>  state;
+    mutable std::atomic<log_limit*>     limit;      // nullptr, or set at compile time or by log_set_limit
+    mutable const __info*               next;       // Sites reached so far
 };
 
+// The slow path of log_enabled, the first time a site is reached.
+//
+bool log_resolve(const __info* i);
+
+// The limit can be taken away between loading the state and loading the limit.
+//
+inline bool log_admit(const __info* i)
+{
+    log_limit* l = i->limit.load( std::memory_order_acquire );
+
+    return l == nullptr || l->admit();
+}
+
+inline bool log_enabled(const __info* i)
+{
+    std::uint32_t state = i->state.load( std::memory_order_relaxed );
+
+    if( state == __info::site_off )
+    {
+        return false;
+    }
+
+    if( state == __info::site_on )
+    {
+        return true;
+    }
+
+    if( state == __info::site_limited )
+    {
+        return log_admit( i );
+    }
+
+    return log_resolve( i );
+}
+
+// LOG_ALWAYS sites aren't filtered, but they are limited. A site with a limit is always
+// site_limited, so site_off here only means there's no limit.
+//
+inline bool log_always(const __info* i)
+{
+    std::uint32_t state = i->state.load( std::memory_order_relaxed );
+
+    if( state == __info::site_limited )
+    {
+        return log_admit( i );
+    }
+
+    if( state == __info::site_unknown )
+    {
+        return log_resolve( i ) || i->state.load( std::memory_order_relaxed ) == __info::site_off;
+    }
+
+    return true;
+}
+
+// facility == nullptr changes the defaults, used by facilities without settings of their own.
+//
+void log_set_level(const char* facility,log_level level);
+void log_set_zones(const char* facility,std::uint32_t zones);
+
+// On or off for one site whatever its facility says. log_reset_sites drops all of these.
+//
+void log_set_site(const __info* site,bool on);
+void log_reset_sites();
+
+// Every site reached so far (to find the ones to switch).
+//
+void log_visit_sites(void (*visit)(const __info* site,bool on,void* context),void* context);
+
+// A limit for one site from here on, in place of the one it had. n == 0 takes the limit off.
+// (Lines the old limit turned away and nobody has reported yet are forgotten.)
+//
+void log_set_limit(const __info* site,log_limit::limit_mode mode,std::uint32_t n,std::uint32_t burst = 0);
+
+// The lines each limited site turned away since the last call, for the sites that turned any
+// away. The visitor is called under the lock.
+//
+void log_take_suppressed(void (*visit)(const __info* site,std::uint64_t suppressed,void* context),void* context);
+
 
 typedef void (*program_log)(__info const *,...);
+typedef void (*program_log_deferred)(__info const *,const void* args,std::size_t cb);
+typedef void (*program_log_binary)(__info const *,const void* payload,std::size_t cb_payload,const void* args,std::size_t cb_args);
+
+extern program_log          __ee5_log;
+extern program_log_deferred __ee5_log_deferred;
+extern program_log_binary   __ee5_log_binary;
+
+
+
+//-------------------------------------------------------------------------------------------------
+// log_deferred
+//
+//  The arguments are captured as raw bytes (see log_args) and the format string is applied on
+//  the logger thread. The caller pays for a copy of the arguments instead of a vsnprintf.
+//
+template<typename... A>
+void log_deferred(const __info* i,A... args)
+{
+    std::uint8_t    buffer[log_args::max_size];
+    std::size_t     cb = log_args::encode( buffer, sizeof( buffer ), args... );
+
+    __ee5_log_deferred( i, buffer, cb );
+}
+
+
+
+//-------------------------------------------------------------------------------------------------
+// log_binary
+//
+//  A line followed by cb bytes of payload. Both the arguments and the payload are copied, the
+//  payload is rendered (hex or base64, see ConsoleLogger::SetBinaryStyle) on the logger
+//  thread. A payload too big for one buffer is spread over a chain of them, it is never cut
+//  short unless the buffers run out.
+//
+template<typename... A>
+void log_binary(const __info* i,const void* payload,std::size_t cb,A... args)
+{
+    std::uint8_t    buffer[log_args::max_size];
+    std::size_t     cb_args = log_args::encode( buffer, sizeof( buffer ), args... );
+
+    __ee5_log_binary( i, payload, cb, buffer, cb_args );
+}
 
-extern program_log __ee5_log;
+
+
+//-------------------------------------------------------------------------------------------------
+// Structured records
+//
+//  LOG_RECORD writes a message and a set of named, typed fields instead of a printf line:
+//
+//      LOG_RECORD( 0x1, "request done", "method,status,elapsed_ms", method, status, ms );
+//
+//  The names live in the site's __info (fields), the values are captured the way deferred
+//  arguments are (see log_args), tag and all. Nothing is formatted on the caller's thread. The
+//  logger renders the record as a line of JSON, or a compact binary frame (see log_record and
+//  ConsoleLogger::SetRecordStyle), so whatever indexes the log reads the fields as they were
+//  rather than pulling them back out of the text.
+//
+//  The number of names has to match the number of values, it is checked at compile time.
+//
+constexpr std::size_t log_field_count(const char* names,std::size_t n = 1)
+{
+    return *names == 0 ? n : log_field_count( names + 1, n + ( *names == ',' ? 1 : 0 ) );
+}
+
+// Only for sizeof, never defined.
+//
+template<typename... A>
+char ( &log_arity(const A&...) )[sizeof...( A )];
 
 
 
@@ -58,45 +355,143 @@ extern program_log __ee5_log;
 #define FUNCTION_NAME __PRETTY_FUNCTION__
 #endif
 
+#define _LOG_SITE(funcname,zone,level,fmt) \
+        static const ee5::__info __info__ = { 0, funcname, LOG_FACILITY, __FILE__, fmt, nullptr, __LINE__, zone, level, {}, {}, nullptr }
+
+// The compile time part folds away for constant zones and levels. Nothing after the && is
+// evaluated for a site that is off.
+//
+#define _LOG_ON(zone,level) \
+        ( (level) <= EE5_LOG_LEVEL && ( (zone) & EE5_LOG_ZONES ) != 0 && ee5::log_enabled( &__info__ ) )
+
+// A site with a limit from the start. (log_set_limit can still change it)
+//
+#define _LOG_LIMITED_SITE(funcname,mode,n,fmt) \
+        static ee5::log_limit __limit__( mode, n ); \
+        static const ee5::__info __info__ = { 0, funcname, LOG_FACILITY, __FILE__, fmt, nullptr, __LINE__, ee5::log_zone_all, ee5::level_always, {}, { &__limit__ }, nullptr }
+
+#define _TRACE_DEFERRED_N(funcname,fmt,...) \
+    do\
+    {\
+        _LOG_SITE( funcname, ee5::log_zone_all, ee5::level_always, " - // " fmt ); \
+        if( ee5::log_always( &__info__ ) )\
+        {\
+            ee5::log_deferred(&__info__,__VA_ARGS__);\
+        }\
+    } while(0)
+
+// Defining EE5_LOG_DEFERRED moves every trace to the deferred path.
+//
+#ifdef EE5_LOG_DEFERRED
+#define _LOG_CALL(...) ee5::log_deferred(__VA_ARGS__)
+#else
+#define _LOG_CALL(...) ee5::__ee5_log(__VA_ARGS__)
+#endif
+
 #define _TRACE_N(funcname,fmt,...) \
     do\
     {\
-        static const ee5::__info __info__ = { 0, funcname, LOG_FACILITY, __FILE__," - // " fmt, __LINE__ }; \
-        ee5::__ee5_log(&__info__,__VA_ARGS__);\
+        _LOG_SITE( funcname, ee5::log_zone_all, ee5::level_always, " - // " fmt ); \
+        if( ee5::log_always( &__info__ ) )\
+        {\
+            _LOG_CALL(&__info__,__VA_ARGS__);\
+        }\
+    } while(0)
+
+#define _TRACE_LIMITED(mode,n,fmt,...) \
+    do\
+    {\
+        _LOG_LIMITED_SITE( FUNCTION_NAME, mode, n, " - // " fmt ); \
+        if( ee5::log_always( &__info__ ) )\
+        {\
+            _LOG_CALL(&__info__,__VA_ARGS__);\
+        }\
+    } while(0)
+
+#define _TRACE_AT(zone,level,prefix,fmt,...) \
+    do\
+    {\
+        _LOG_SITE( FUNCTION_NAME, zone, level, prefix fmt ); \
+        if( _LOG_ON( zone, level ) )\
+        {\
+            _LOG_CALL(&__info__,__VA_ARGS__);\
+        }\
     } while(0)
 
 #define _TRACE(fmt,...) \
     _TRACE_N( FUNCTION_NAME, fmt, __VA_ARGS__ )
 
-#define LOG_MSG(zone,        fmt,...) _TRACE(fmt,__VA_ARGS__)
+#define LOG_MSG(zone,        fmt,...) _TRACE_AT(zone,ee5::level_info," - // ",fmt,__VA_ARGS__)
 
-#define FRAME_EXIT() \
-        static const ee5::__info ___ = { 0, FUNCTION_NAME, LOG_FACILITY, __FILE__, " } // %.6f s", __LINE__ }; \
+// The closing line is only written if the opening one was.
+//
+#define LOG_FRAME(zone,fmt,...) \
+        static const ee5::__info ___ = { 0, FUNCTION_NAME, LOG_FACILITY, __FILE__, " } // %.6f s", nullptr, __LINE__, zone, ee5::level_trace, {}, {}, nullptr }; \
         struct _                                \
         {                                       \
-            s_stopwatch_f s;                    \
+            bool            on;                 \
+            ee5::s_stopwatch_d s;               \
+            _(bool b) : on( b )                 \
+            {                                   \
+            }                                   \
             ~_()                                \
             {                                   \
-                ee5::__ee5_log(&___,s.delta()); \
+                if( on )                        \
+                {                               \
+                    ee5::__ee5_log(&___,s.delta()); \
+                }                               \
             }                                   \
-        } __                                    \
-
-
-#define LOG_FRAME(zone,fmt,...) \
-        FRAME_EXIT(); \
+        } __( ( (zone) & EE5_LOG_ZONES ) != 0 && ee5::level_trace <= EE5_LOG_LEVEL && ee5::log_enabled( &___ ) ); \
         do\
-        {                   \
-            static const ee5::__info __info__ = { 0, FUNCTION_NAME, LOG_FACILITY, __FILE__," { // " fmt, __LINE__ }; \
-            ee5::__ee5_log(&__info__,__VA_ARGS__);\
+        {\
+            if( __.on )\
+            {\
+                static const ee5::__info __info__ = { 0, FUNCTION_NAME, LOG_FACILITY, __FILE__," { // " fmt, nullptr, __LINE__, zone, ee5::level_trace, {}, {}, nullptr }; \
+                ee5::__ee5_log(&__info__,__VA_ARGS__);\
+            }\
         } while(0)
 
+// s is anything that can be written to a std::ostream, it goes on the end of the line.
+//
+#define LOG_STREAM( zone,s,fmt,...) \
+    do\
+    {\
+        _LOG_SITE( FUNCTION_NAME, zone, ee5::level_debug, " - // " fmt " %s" ); \
+        if( _LOG_ON( zone, ee5::level_debug ) )\
+        {\
+            std::ostringstream __stream__;\
+            __stream__ << s;\
+            ee5::__ee5_log(&__info__,__VA_ARGS__,__stream__.str().c_str());\
+        }\
+    } while(0)
 
 #define LOG_UNAME(  funcname,       fmt,...) _TRACE_N(funcname,fmt,__VA_ARGS__)
-#define LOG_ENTRY(  zone,           fmt,...)
-#define LOG_BINARY( zone,cb,ptr,    fmt,...)
-#define LOG_STREAM( zone,s,         fmt,...)
-#define LOG_ERROR(                  fmt,...) _TRACE(fmt,__VA_ARGS__)
+#define LOG_ENTRY(  zone,           fmt,...) _TRACE_AT(zone,ee5::level_trace," { // ",fmt,__VA_ARGS__)
+#define LOG_BINARY( zone,cb,ptr,    fmt,...) \
+    do\
+    {\
+        _LOG_SITE( FUNCTION_NAME, zone, ee5::level_info, " - // " fmt ); \
+        if( _LOG_ON( zone, ee5::level_info ) )\
+        {\
+            ee5::log_binary(&__info__,ptr,cb,__VA_ARGS__);\
+        }\
+    } while(0)
+#define LOG_ERROR(                  fmt,...) _TRACE_AT(ee5::log_zone_all,ee5::level_error," - // ",fmt,__VA_ARGS__)
+#define LOG_WARNING(                fmt,...) _TRACE_AT(ee5::log_zone_all,ee5::level_warning," - // ",fmt,__VA_ARGS__)
 #define LOG_ALWAYS(                 fmt,...) _TRACE(fmt,__VA_ARGS__)
-#define LOG_DEBUG(  zone,           fmt,...)
+#define LOG_SAMPLED(n,              fmt,...) _TRACE_LIMITED(ee5::log_limit::limit_every,n,fmt,__VA_ARGS__)
+#define LOG_LIMITED(per_second,     fmt,...) _TRACE_LIMITED(ee5::log_limit::limit_rate,per_second,fmt,__VA_ARGS__)
+#define LOG_DEBUG(  zone,           fmt,...) _TRACE_AT(zone,ee5::level_debug," - // ",fmt,__VA_ARGS__)
+#define LOG_DEFERRED(               fmt,...) _TRACE_DEFERRED_N(FUNCTION_NAME,fmt,__VA_ARGS__)
+#define LOG_RECORD( zone,msg,names,     ...) \
+    do\
+    {\
+        static_assert( ee5::log_field_count( names ) == sizeof( ee5::log_arity( __VA_ARGS__ ) ), "LOG_RECORD needs a value for every name" ); \
+        static const ee5::__info __info__ = { 0, FUNCTION_NAME, LOG_FACILITY, __FILE__, msg, names, __LINE__, zone, ee5::level_info, {}, {}, nullptr }; \
+        if( _LOG_ON( zone, ee5::level_info ) )\
+        {\
+            ee5::log_deferred(&__info__,__VA_ARGS__);\
+        }\
+    } while(0)
 
 ENS( ee5 )
@@ -15,10 +15,31 @@
 #pragma once
 #include <ee5>
 
+#include <thread_support.h>
+
+#include <algorithm>
 #include <cassert>
 #include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <ctime>
 #include <atomic>
+#include <chrono>
+#include <mutex>
 #include <thread> // TODO: currently needed for spin_posix
+#include <type_traits>
+
+#if defined( _MSC_VER )
+#include <intrin.h>
+#elif defined( __x86_64__ ) || defined( __i386__ )
+#include <immintrin.h>
+#endif
+
+#if defined( __linux__ )
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
 
 BNS( ee5 )
 //-------------------------------------------------------------------------------------------------
@@ -108,6 +129,132 @@ BNS( ee5 )
 //
 
 
+//-------------------------------------------------------------------------------------------------
+// cpu_relax
+//
+//  Tells the CPU that this is a spin wait loop. On x86 the pause instruction keeps the core from
+//  flooding the memory pipeline with speculative loads of the lock (and the pipeline flush when
+//  the lock is released), and hands execution resources to the hyper thread sibling. The sibling
+//  may well be the thread that holds the lock.
+//
+inline void cpu_relax()
+{
+#if defined( _MSC_VER ) || defined( __x86_64__ ) || defined( __i386__ )
+    _mm_pause();
+#elif defined( __aarch64__ ) || defined( __arm__ )
+    __asm__ __volatile__( "yield" );
+#else
+    std::atomic_signal_fence( std::memory_order_seq_cst );
+#endif
+}
+
+
+
+//-------------------------------------------------------------------------------------------------
+// EE5_LOCK_SPIN
+//
+//  Counts a spin on the calling thread when lock profiling is built in. (see lock_profile.h)
+//  Nothing at all otherwise.
+//
+#ifdef EE5_LOCK_PROFILING
+extern ee5_thread_local uint64_t lock_profile_spins;
+#define EE5_LOCK_SPIN() ( ++ee5::lock_profile_spins )
+#else
+#define EE5_LOCK_SPIN()
+#endif
+
+
+
+//-------------------------------------------------------------------------------------------------
+// backoff policies
+//
+//  All of the spin locks take a backoff policy. The lock creates one when it starts to wait and
+//  calls it once for every failed look at the lock. The policy decides how long to stay away.
+//
+//      backoff_none                The old behavior. Hammer the cache line. Only useful to
+//                                  compare against.
+//
+//      backoff_pause               A single cpu_relax per look.
+//
+//      backoff_exponential<>       Starts at min_spins pauses per look and doubles after each
+//                                  look up to max_spins. The more a waiter fails the less
+//                                  often it looks, so fewer waiters are pulling the line
+//                                  back and forth when the lock is released.
+//
+//      backoff_yield<>             Pauses for spins looks and then gives the rest of the
+//                                  quantum away on every look. For boxes that have more
+//                                  runnable threads than cores (and VM's). A spinning thread
+//                                  that was preempted while waiting can't stall the owner.
+//
+//  All of the locks (other than spin_flag) also only try the atomic read-modify-write when a
+//  plain load says the lock is free. (test and test-and-set) The plain load is served from the
+//  local cache until the owner writes the line, while every failed RMW takes the line exclusive.
+//
+struct backoff_none
+{
+    void operator()()
+    {
+        EE5_LOCK_SPIN();
+    }
+};
+
+struct backoff_pause
+{
+    void operator()()
+    {
+        EE5_LOCK_SPIN();
+        cpu_relax();
+    }
+};
+
+template<uint32_t min_spins = 1, uint32_t max_spins = 64>
+struct backoff_exponential
+{
+    static_assert( min_spins > 0 && min_spins <= max_spins, "min_spins must be in [1,max_spins]" );
+
+    uint32_t spins = min_spins;
+
+    void operator()()
+    {
+        EE5_LOCK_SPIN();
+
+        for( uint32_t i = 0; i < spins; ++i )
+        {
+            cpu_relax();
+        }
+
+        if( spins < max_spins )
+        {
+            spins = spins * 2 < max_spins ? spins * 2 : max_spins;
+        }
+    }
+};
+
+template<uint32_t spins = 64>
+struct backoff_yield
+{
+    uint32_t count = 0;
+
+    void operator()()
+    {
+        EE5_LOCK_SPIN();
+
+        if( count < spins )
+        {
+            ++count;
+            cpu_relax();
+        }
+        else
+        {
+            std::this_thread::yield();
+        }
+    }
+};
+
+using backoff_default = backoff_exponential<>;
+
+
+
 //-------------------------------------------------------------------------------------------------
 // spin_flag
 //
@@ -121,9 +268,13 @@ BNS( ee5 )
 //  storage of this lock doesn't contain ANOTHER spin that can cause REALLY weird deadlocks or
 //  other stalls on a cache line. 
 //
-//  C++ concept: BasicLockable
+//  The C++11 atomic_flag has no way to look at the flag without setting it, so this lock can't
+//  do the test before the test_and_set. The backoff policy spaces out the attempts instead.
+//
+//  C++ concept: Lockable
 //
-class spin_flag
+template<typename backoff = backoff_default>
+class basic_spin_flag
 {
 #ifdef _MSC_VER
     // As of cl 17.00.60610.1 ATOMIC_FLAG_INIT generates a compile error
@@ -133,18 +284,21 @@ class spin_flag
 #endif
 
 public:
-    spin_flag()
+    basic_spin_flag()
     {
 #ifdef _MSC_VER
         l.clear();
 #endif
     }
-    spin_flag( const spin_flag& ) = delete;
+    basic_spin_flag( const basic_spin_flag& ) = delete;
 
     void lock()
     {
+        backoff wait;
+
         while( l.test_and_set( std::memory_order_acquire ) )
         {
+            wait();
         }
     }
 
@@ -152,8 +306,15 @@ public:
     {
         l.clear( std::memory_order_release );
     }
+
+    bool try_lock()
+    {
+        return !l.test_and_set( std::memory_order_acquire );
+    }
 };
 
+using spin_flag = basic_spin_flag<>;
+
 
 
 //-------------------------------------------------------------------------------------------------
@@ -164,6 +325,8 @@ public:
 //  be slightly faster (over time) than the std::mutex, but only slightly. This implementation is
 //  mostly for completeness as other platforms could have different performance needs.
 //
+//  The backoff policies don't apply here, the platform does its own spinning.
+//
 //  C++ concept: Lockable
 //
 #ifdef _MSC_VER
@@ -237,7 +400,8 @@ public:
 //
 //  C++ concept: Lockable
 //
-class spin_mutex
+template<typename backoff = backoff_default>
+class basic_spin_mutex
 {
     static const std::memory_order release = std::memory_order_release;
     static const std::memory_order relaxed = std::memory_order_relaxed;
@@ -246,17 +410,26 @@ class spin_mutex
     std::atomic_bool l;
 
 public:
-    spin_mutex(const spin_mutex&) = delete;
-    spin_mutex() 
+    basic_spin_mutex(const basic_spin_mutex&) = delete;
+    basic_spin_mutex() 
     {
         l = false;
     }
 
     void lock()
     {
-        bool expected = false;
+        bool    expected = false;
+        backoff wait;
+
         while( ! l.compare_exchange_strong( expected, true, acquire, relaxed ) )
         {
+            // Wait in the local cache until the owner lets go.
+            //
+            while( l.load( relaxed ) )
+            {
+                wait();
+            }
+
             expected = false;
         }
     }
@@ -275,195 +448,1174 @@ public:
 
 };
 
+using spin_mutex = basic_spin_mutex<>;
+
 
 
 //-------------------------------------------------------------------------------------------------
-//  spin_reader_writer_lock<>
-//
-// Notes:
-//
-//  This idea is kinda based on how the SRWLock from MSFT works, but adapted to use the C++
-//  support for threading. (aka a shared_mutex)
-//
-//  The idea of "max exclusive" writers is kind-of "stupid" BUT if you have a system that
-//  might have a large number of writers wanting exclusive access, you need to trap all
-//  but the first one. Most of my designs typically have only a single writer, but in order
-//  to keep this generally more useful the base class uses a traits system to allow for
-//  the behavior to be modified. The default implementation allows for 65k (I told you,
-//  absurd) writers to hit the spin at the same time. My current hardware can only encounter
-//  a ~theoretical~ 8 way race and predictions are reasonable that we won't see 64bit
-//  CPU's with 65k cores in my life time. (It WOULD however, be cool to see this!)
+// ticket_lock
 //
-//  Basically, the maximum number of "spinners" is a function of the number of CPU's/cores
-//  that have concurrent access to the memory bus. Each one of the memory access methods
-//  atomically access the underlying memory during a single instruction. The OS can't
-//  switch a thread context outside of a single instruction, therefore even if you have
-//  thousands of writer threads, the total number can ONLY get that high IF (this is absurdly
-//  unlikely, but not impossible) the OS thread quantum was set to the cycle / instruction level.
-//  (A single chip with 64GB of "cache / main memory" and 8 cores might pull this off. I am
-//  not going to hold my breath!)
+//  A fair exclusive lock. Every thread that wants in takes a ticket and waits until its number
+//  is being served, so the lock is handed out in the order it was asked for. None of the other
+//  spin locks make any promise about order, under heavy contention an unlucky thread can lose
+//  the race for a very long time (the max stall in tst_spin_locks). With a ticket lock the
+//  worst case wait is bounded by the number of threads ahead in line.
 //
-//  One of the uses this class is good for is tracking "pending work" and blocking "new"
-//  work. for those uses an "absurd" number of concurrent readers needs to be supported.
-//  In this case the default on a 64bit system is a little over 1 billion "concurrent" readers.
-//
-//  Depending on usage, I have seen dozens of readers hold a lock for "a while." In (good)
-//  concurrent design, you really shouldn't hold a lock very long. (For the case of the read
-//  "locks" being a "trap" for pending work in a pool it's probably OK as the only time an
-//  exclusive lock is taken is during a termination phase.)
+//  The cost of fairness is that a thread that is preempted while in line holds up everyone
+//  behind it. All of the waiters also spin on the same cache line, so each hand off invalidates
+//  the line in every waiting core. Past a handful of cores the mcs_lock does better.
 //
-
+//  is_contended() is true when anyone is waiting in line behind the owner.
 //
-// 32/64 bit traits for the shared reader / writer style lock.
+//  C++ concept: Lockable
 //
-struct is_32_bit
+template<typename backoff = backoff_default>
+class basic_ticket_lock
 {
-    static const bool value = sizeof(void*) == sizeof(uint32_t);
+    static const std::memory_order release = std::memory_order_release;
+    static const std::memory_order relaxed = std::memory_order_relaxed;
+    static const std::memory_order acquire = std::memory_order_acquire;
 
-    using  value_type   = uint_fast32_t;
-    using  lock_type    = std::atomic_uint_fast32_t;
+    std::atomic<uint32_t>   next;
+    std::atomic<uint32_t>   serving;
 
-    static const value_type addend_exclusive    = 0x00100000;
-    static const value_type mask_exclusive      = 0x7FF00000;
-    static const value_type max_exclusive       = 0x3FF00000;
-    static const value_type mask_shared         = 0x0007FFFF;
-    static const value_type max_shared          = 0x0003FFFF;
-};
+public:
+    basic_ticket_lock(const basic_ticket_lock&) = delete;
+    basic_ticket_lock() : next(0), serving(0)
+    {
+    }
 
-struct is_64_bit
-{
-    static const bool value = sizeof(void*) == sizeof(uint64_t);
+    void lock()
+    {
+        uint32_t    ticket  = next.fetch_add( 1, relaxed );
+        backoff     wait;
 
-    using  value_type   = uint_fast64_t;
-    using  lock_type    = std::atomic_uint_fast64_t;
+        while( serving.load( acquire ) != ticket )
+        {
+            wait();
+        }
+    }
 
-    static const value_type addend_exclusive    = 0x0000100000000000;
-    static const value_type mask_exclusive      = 0x1FFFF00000000000;
-    static const value_type max_exclusive       = 0x0FFFF00000000000;
-    static const value_type mask_shared         = 0x000001FFFFFFFFFF;
-    static const value_type max_shared          = 0x000000FFFFFFFFFF;
+    void unlock()
+    {
+        // Only the owner writes serving.
+        //
+        serving.store( serving.load( relaxed ) + 1, release );
+    }
+
+    bool try_lock()
+    {
+        uint32_t ticket = serving.load( relaxed );
+
+        // Only take a ticket if it would be served right away.
+        //
+        return next.compare_exchange_strong( ticket, ticket + 1, acquire, relaxed );
+    }
+
+    bool is_contended() const
+    {
+        return next.load( relaxed ) - serving.load( relaxed ) > 1;
+    }
 };
 
+using ticket_lock = basic_ticket_lock<>;
+
 
 
 //-------------------------------------------------------------------------------------------------
-// spin_reader_writer_lock
+// mcs_lock
 //
-//  A reader / writer lock is used when a data structure is safe to access by many readers.
-//  When a change needs to be made, a writer needs to take the lock exclusively so that any
-//  changes are picked up by subsequent reads.
+//  A fair queue lock. (Mellor-Crummey & Scott 1991) The waiters form a linked list of nodes and
+//  each waiter spins on a flag in its own node, on its own cache line. The owner hands the lock
+//  off by clearing the flag of the next node in line. A hand off touches one line in one other
+//  core instead of every waiting core, which is what keeps the cost flat when a lock is
+//  shared by dozens of cores.
 //
-//  Exclusive access will stall NEW readers and block until existing readers are finished.
+//  The classic interface has the caller provide the node. To keep this a plain Lockable (and
+//  usable with framed_lock, lock_guard, etc.) the node comes from a small per thread pool and
+//  the owner keeps it in the lock until unlock. A thread can hold up to mcs_node_pool::per_thread
+//  mcs_locks at the same time.
 //
-template<typename traits = typename std::conditional<is_64_bit::value,is_64_bit,is_32_bit>::type >
-class spin_reader_writer_lock
+//  The spinning is on a private line, so a pause is plenty. Use backoff_yield<> if there can be
+//  more threads than cores.
+//
+//  C++ concept: Lockable
+//
+class ee5_alignas( CACHE_ALIGN ) mcs_node
 {
-private:
-    static const std::memory_order release = std::memory_order_release;
-    static const std::memory_order relaxed = std::memory_order_relaxed;
-    static const std::memory_order acquire = std::memory_order_acquire;
+public:
+    std::atomic<mcs_node*>  next;
+    std::atomic_bool        locked;
 
-    using storage_t = typename traits::value_type;
-    using lock_t    = typename traits::lock_type;
+private:
+    friend class mcs_node_pool;
 
-    static const storage_t addend_exclusive = traits::addend_exclusive;
-    static const storage_t mask_exclusive   = traits::mask_exclusive;
-    static const storage_t max_exclusive    = traits::max_exclusive;
-    static const storage_t mask_shared      = traits::mask_shared;
-    static const storage_t max_shared       = traits::max_shared;
+    uint32_t                slot;
+};
 
-    // Just a little safety for folks that might want to change the
-    // behavior of the routines.
-    //
-    static_assert( mask_exclusive > mask_shared,                            "These routines require the exclusive bits in the higher order bytes.");
-    static_assert( (mask_exclusive & addend_exclusive) == addend_exclusive, "Check your exclusive mask and addend!" );
-    static_assert( (mask_exclusive > max_exclusive),                        "At least a single overflow bit is needed." );
-    static_assert( (mask_shared & 0x1) == 0x1,                              "The shared mask must include the lowest order bit." );
-    static_assert( (mask_shared > max_shared),                              "At least a single overflow bit is needed." );
-    static_assert( (mask_shared & mask_exclusive) == 0,                     "No overlap of shared and exclusive bits allowed!" );
+class mcs_node_pool
+{
+public:
+    static const uint32_t per_thread = 8;
 
-    lock_t  l;
+private:
+    uint32_t    in_use;
+    mcs_node    nodes[per_thread];
 
-public:
-    spin_reader_writer_lock(const spin_reader_writer_lock&) = delete;
-    spin_reader_writer_lock() : l(0)
+    static mcs_node_pool& local()
     {
+        static ee5_thread_local mcs_node_pool p;
+        return p;
     }
 
-    void lock()
+public:
+    static mcs_node* acquire()
     {
-        // Spin until we acquire the write lock. Which we know is "ours" because
-        // no one else owned it before.
-        //
-        while( ( l.fetch_add(addend_exclusive,acquire) & mask_exclusive ) >= addend_exclusive )
+        mcs_node_pool& p = local();
+
+        for( uint32_t i = 0; i < per_thread; ++i )
         {
-            l.fetch_sub(addend_exclusive,relaxed);
+            if( ( p.in_use & ( 1u << i ) ) == 0 )
+            {
+                p.in_use       |= 1u << i;
+                p.nodes[i].slot = i;
+
+                return &p.nodes[i];
+            }
         }
 
-        // Spin while any readers are still owning a lock
-        //
-        while( ( l.load() & mask_shared ) > 0 );
+        assert( !"Too many mcs_locks held by one thread." );
+        return nullptr;
     }
 
-    void unlock()
+    // Must be called on the thread that acquired the node.
+    //
+    static void release(mcs_node* node)
     {
-        l.fetch_sub(addend_exclusive,release);
+        local().in_use &= ~( 1u << node->slot );
     }
+};
 
-    bool try_lock()
+template<typename backoff = backoff_pause>
+class basic_mcs_lock
+{
+    static const std::memory_order release = std::memory_order_release;
+    static const std::memory_order relaxed = std::memory_order_relaxed;
+    static const std::memory_order acquire = std::memory_order_acquire;
+    static const std::memory_order acq_rel = std::memory_order_acq_rel;
+
+    std::atomic<mcs_node*>  tail;
+    mcs_node*               owner;  // Only touched by the thread holding the lock
+
+public:
+    basic_mcs_lock(const basic_mcs_lock&) = delete;
+    basic_mcs_lock() : tail(nullptr), owner(nullptr)
     {
-        // The only way this can succeed is if ALL writers and all readers
-        // are not doing anything, which means that the value in the lock
-        // had to be zero.
-        //
-        bool owned = l.fetch_add(addend_exclusive,acquire) == 0;
+    }
+
+    void lock()
+    {
+        mcs_node* me = mcs_node_pool::acquire();
+
+        me->next.store( nullptr, relaxed );
+        me->locked.store( true, relaxed );
 
-        if( !owned )
+        mcs_node* prior = tail.exchange( me, acq_rel );
+
+        if( prior )
         {
-            l.fetch_sub(addend_exclusive,relaxed);
+            backoff wait;
+
+            prior->next.store( me, release );
+
+            while( me->locked.load( acquire ) )
+            {
+                wait();
+            }
         }
 
-        return owned;
+        owner = me;
     }
 
-    void lock_shared()
+    void unlock()
     {
-        // Happy case is that no writers want in and on a 64bit system by default fewer than
-        // 1 billion readers are using the lock.
-        //
-        while( ++l > max_shared )
+        mcs_node* me    = owner;
+        mcs_node* next  = me->next.load( acquire );
+
+        if( next == nullptr )
         {
-            // Unhappy we can't keep the lock
+            // Nobody in line that we know of. If we are still the tail the lock is free.
             //
-            --l;
+            mcs_node* expected = me;
 
-            // Stay away until there is a reasonable chance we can take the lock. This
-            // prevents a lockout while an exclusive owner is waiting for readers to exit.
+            if( tail.compare_exchange_strong( expected, nullptr, release, relaxed ) )
+            {
+                mcs_node_pool::release( me );
+                return;
+            }
+
+            // Someone swapped in behind us but hasn't linked up yet.
             //
-            while(l > max_shared);
+            while( ( next = me->next.load( acquire ) ) == nullptr )
+            {
+                cpu_relax();
+            }
         }
-    }
 
-    void unlock_shared()
-    {
-        --l;
+        next->locked.store( false, release );
+        mcs_node_pool::release( me );
     }
 
-    bool try_lock_shared()
+    bool try_lock()
     {
-        bool owned = ++l <= max_shared;
+        if( tail.load( relaxed ) != nullptr )
+        {
+            return false;
+        }
 
-        if(!owned)
+        mcs_node* me        = mcs_node_pool::acquire();
+        mcs_node* expected  = nullptr;
+
+        me->next.store( nullptr, relaxed );
+        me->locked.store( true, relaxed );
+
+        if( !tail.compare_exchange_strong( expected, me, acquire, relaxed ) )
         {
-            --l;
+            mcs_node_pool::release( me );
+            return false;
         }
 
-        return owned;
+        owner = me;
+        return true;
+    }
+};
+
+using mcs_lock = basic_mcs_lock<>;
+
+
+
+//-------------------------------------------------------------------------------------------------
+// cohort_lock
+//
+//  A NUMA aware lock built out of two ordinary locks. (Dice, Marathe & Shavit, "Lock Cohorting")
+//  Every node has its own local lock, and there is one global lock. A thread takes the lock
+//  for its node first, then the global lock. When it lets go and another thread from the same
+//  node is waiting on the local lock, the global lock is passed along with the local lock
+//  instead of being released. The lock (and the data it protects) stays in the caches of one
+//  socket for a run of owners instead of bouncing over the interconnect on every hand off.
+//
+//  After max_handoffs local hand offs in a row the global lock is released anyway, so the
+//  other nodes get a turn.
+//
+//      G   The global lock. It is released by whichever thread is the last of the cohort, not
+//          always the thread that took it. ticket_lock and spin_mutex are fine with that,
+//          mcs_lock and adaptive_mutex (profiling) are not.
+//
+//      L   The node local lock. Needs is_contended(). (ticket_lock)
+//
+//  The node comes from current_numa_node. Each node's lock is on its own lines, so this lock
+//  is max_nodes cache lines. Nodes past max_nodes share.
+//
+//  C++ concept: Lockable
+//
+template<typename G = spin_mutex,typename L = ticket_lock,uint32_t max_handoffs = 64,size_t max_nodes = 8>
+class cohort_lock
+{
+    struct ee5_alignas( CACHE_ALIGN ) cohort
+    {
+        L           local;
+        bool        global_owned    = false;    // Only touched by the owner of local
+        uint32_t    handoffs        = 0;        // Only touched by the owner of local
+    };
+
+    G       global;
+    cohort  cohorts[max_nodes];
+    size_t  owner;                              // Only touched by the owner
+
+public:
+    cohort_lock(const cohort_lock&) = delete;
+    cohort_lock() : owner(0)
+    {
+    }
+
+    void lock()
+    {
+        size_t  node    = current_numa_node() % max_nodes;
+        cohort& c       = cohorts[node];
+
+        c.local.lock();
+
+        if( !c.global_owned )
+        {
+            global.lock();
+            c.global_owned  = true;
+            c.handoffs      = 0;
+        }
+
+        owner = node;
+    }
+
+    void unlock()
+    {
+        cohort& c = cohorts[owner];
+
+        if( c.local.is_contended() && ++c.handoffs < max_handoffs )
+        {
+            // Keep the global lock in this node, the next local owner inherits it.
+            //
+            c.local.unlock();
+            return;
+        }
+
+        c.global_owned  = false;
+        c.handoffs      = 0;
+
+        global.unlock();
+        c.local.unlock();
+    }
+
+    bool try_lock()
+    {
+        size_t  node    = current_numa_node() % max_nodes;
+        cohort& c       = cohorts[node];
+
+        if( !c.local.try_lock() )
+        {
+            return false;
+        }
+
+        if( !c.global_owned )
+        {
+            if( !global.try_lock() )
+            {
+                c.local.unlock();
+                return false;
+            }
+
+            c.global_owned  = true;
+            c.handoffs      = 0;
+        }
+
+        owner = node;
+        return true;
+    }
+};
+
+
+
+//-------------------------------------------------------------------------------------------------
+// futex_wait / futex_wake
+//
+//  Park the calling thread while *word == expected, and wake up to count threads parked on
+//  word. On Linux these are the futex system calls, the kernel only gets involved when there
+//  is someone to park or wake. Elsewhere the wait degrades to a yield, which is correct for
+//  every caller here (they all loop and look again) but not cheap.
+//
+inline void futex_wait(std::atomic<uint32_t>& word, uint32_t expected)
+{
+    static_assert( sizeof( std::atomic<uint32_t> ) == sizeof( uint32_t ), "futex needs a plain 32 bit word" );
+
+#if defined( __linux__ )
+    syscall( SYS_futex, reinterpret_cast<uint32_t*>( &word ), FUTEX_WAIT_PRIVATE, expected, nullptr, nullptr, 0 );
+#else
+    if( word.load( std::memory_order_relaxed ) == expected )
+    {
+        std::this_thread::yield();
+    }
+#endif
+}
+
+// Same as futex_wait, but gives up after timeout. (Callers re-check their condition anyway.)
+//
+inline void futex_wait_for(std::atomic<uint32_t>& word, uint32_t expected, std::chrono::nanoseconds timeout)
+{
+#if defined( __linux__ )
+    struct timespec ts;
+
+    ts.tv_sec   = static_cast<time_t>( timeout.count() / 1000000000 );
+    ts.tv_nsec  = static_cast<long>( timeout.count() % 1000000000 );
+
+    syscall( SYS_futex, reinterpret_cast<uint32_t*>( &word ), FUTEX_WAIT_PRIVATE, expected, &ts, nullptr, 0 );
+#else
+    if( word.load( std::memory_order_relaxed ) == expected )
+    {
+        std::this_thread::yield();
+    }
+    (void)timeout;
+#endif
+}
+
+inline void futex_wake(std::atomic<uint32_t>& word, int count)
+{
+#if defined( __linux__ )
+    syscall( SYS_futex, reinterpret_cast<uint32_t*>( &word ), FUTEX_WAKE_PRIVATE, count, nullptr, nullptr, 0 );
+#else
+    (void)word;
+    (void)count;
+#endif
+}
+
+
+
+//-------------------------------------------------------------------------------------------------
+// adaptive_mutex
+//
+//  Spin for a while, then park. A std::mutex parks right away (a trip into the kernel and a
+//  context switch even when the owner is about to let go) and the spin locks never park (if
+//  the owner is preempted, every waiter burns its whole quantum). The adaptive_mutex spins as
+//  long as the lock has recently needed to be spun for, and then sleeps on a futex.
+//
+//  How long to spin is tuned per lock. Every contended lock() records how many spins it took
+//  (or the limit when it gave up) into a running average, and the next lock() spins up to
+//  twice the average. A lock with short hold times settles on a short spin that almost always
+//  wins, a lock with long hold times (or a preempted owner) settles on giving up quickly.
+//  This is the same scheme as glibc's PTHREAD_MUTEX_ADAPTIVE_NP.
+//
+//  The lock word uses the three states from Drepper's "Futexes Are Tricky":
+//
+//      0   unlocked
+//      1   locked, nobody parked
+//      2   locked, someone may be parked
+//
+//  so an uncontended lock/unlock pair never calls the kernel.
+//
+//  C++ concept: Lockable
+//
+template<uint32_t max_spins = 1000>
+class basic_adaptive_mutex
+{
+    static const std::memory_order release = std::memory_order_release;
+    static const std::memory_order relaxed = std::memory_order_relaxed;
+    static const std::memory_order acquire = std::memory_order_acquire;
+
+    static const uint32_t unlocked  = 0;
+    static const uint32_t locked    = 1;
+    static const uint32_t parked    = 2;
+
+    std::atomic<uint32_t>   state;
+    std::atomic<int32_t>    spins;      // Running average, only a hint. (relaxed)
+
+    bool try_acquire()
+    {
+        uint32_t expected = unlocked;
+        return state.compare_exchange_strong( expected, locked, acquire, relaxed );
+    }
+
+    void learn(int32_t spun)
+    {
+        int32_t average = spins.load( relaxed );
+        spins.store( average + ( spun - average ) / 8, relaxed );
+    }
+
+public:
+    basic_adaptive_mutex(const basic_adaptive_mutex&) = delete;
+    basic_adaptive_mutex() : state(unlocked), spins(0)
+    {
+    }
+
+    void lock()
+    {
+        if( try_acquire() )
+        {
+            return;
+        }
+
+        int32_t limit   = std::min<int32_t>( max_spins, spins.load( relaxed ) * 2 + 16 );
+        int32_t spun    = 0;
+
+        for( ; spun < limit; ++spun )
+        {
+            EE5_LOCK_SPIN();
+            cpu_relax();
+
+            if( state.load( relaxed ) == unlocked && try_acquire() )
+            {
+                learn( spun );
+                return;
+            }
+        }
+
+        learn( spun );
+
+        // Mark the lock as having a sleeper before going to sleep. If the exchange sees unlocked
+        // we own the lock (in the parked state, which costs at most one spurious wake).
+        //
+        while( state.exchange( parked, acquire ) != unlocked )
+        {
+            futex_wait( state, parked );
+        }
+    }
+
+    void unlock()
+    {
+        if( state.exchange( unlocked, release ) == parked )
+        {
+            futex_wake( state, 1 );
+        }
+    }
+
+    bool try_lock()
+    {
+        return state.load( relaxed ) == unlocked && try_acquire();
+    }
+};
+
+using adaptive_mutex = basic_adaptive_mutex<>;
+
+
+
+//-------------------------------------------------------------------------------------------------
+//  spin_reader_writer_lock<>
+//
+// Notes:
+//
+//  This idea is kinda based on how the SRWLock from MSFT works, but adapted to use the C++
+//  support for threading. (aka a shared_mutex)
+//
+//  The idea of "max exclusive" writers is kind-of "stupid" BUT if you have a system that
+//  might have a large number of writers wanting exclusive access, you need to trap all
+//  but the first one. Most of my designs typically have only a single writer, but in order
+//  to keep this generally more useful the base class uses a traits system to allow for
+//  the behavior to be modified. The default implementation allows for 65k (I told you,
+//  absurd) writers to hit the spin at the same time. My current hardware can only encounter
+//  a ~theoretical~ 8 way race and predictions are reasonable that we won't see 64bit
+//  CPU's with 65k cores in my life time. (It WOULD however, be cool to see this!)
+//
+//  Basically, the maximum number of "spinners" is a function of the number of CPU's/cores
+//  that have concurrent access to the memory bus. Each one of the memory access methods
+//  atomically access the underlying memory during a single instruction. The OS can't
+//  switch a thread context outside of a single instruction, therefore even if you have
+//  thousands of writer threads, the total number can ONLY get that high IF (this is absurdly
+//  unlikely, but not impossible) the OS thread quantum was set to the cycle / instruction level.
+//  (A single chip with 64GB of "cache / main memory" and 8 cores might pull this off. I am
+//  not going to hold my breath!)
+//
+//  One of the uses this class is good for is tracking "pending work" and blocking "new"
+//  work. for those uses an "absurd" number of concurrent readers needs to be supported.
+//  In this case the default on a 64bit system is a little over 1 billion "concurrent" readers.
+//
+//  Depending on usage, I have seen dozens of readers hold a lock for "a while." In (good)
+//  concurrent design, you really shouldn't hold a lock very long. (For the case of the read
+//  "locks" being a "trap" for pending work in a pool it's probably OK as the only time an
+//  exclusive lock is taken is during a termination phase.)
+//
+
+//
+// 32/64 bit traits for the shared reader / writer style lock.
+//
+struct is_32_bit
+{
+    static const bool value = sizeof(void*) == sizeof(uint32_t);
+
+    using  value_type   = uint_fast32_t;
+    using  lock_type    = std::atomic_uint_fast32_t;
+
+    static const value_type addend_exclusive    = 0x00100000;
+    static const value_type mask_exclusive      = 0x7FF00000;
+    static const value_type max_exclusive       = 0x3FF00000;
+    static const value_type mask_shared         = 0x0007FFFF;
+    static const value_type max_shared          = 0x0003FFFF;
+};
+
+struct is_64_bit
+{
+    static const bool value = sizeof(void*) == sizeof(uint64_t);
+
+    using  value_type   = uint_fast64_t;
+    using  lock_type    = std::atomic_uint_fast64_t;
+
+    static const value_type addend_exclusive    = 0x0000100000000000;
+    static const value_type mask_exclusive      = 0x1FFFF00000000000;
+    static const value_type max_exclusive       = 0x0FFFF00000000000;
+    static const value_type mask_shared         = 0x000001FFFFFFFFFF;
+    static const value_type max_shared          = 0x000000FFFFFFFFFF;
+};
+
+
+
+//-------------------------------------------------------------------------------------------------
+// reader / writer modes
+//
+//  rw_prefer_writers   (default) A waiting writer blocks new readers. Readers look at the lock
+//                      before they try to take it, so a steady stream of readers doesn't keep
+//                      the shared count from ever draining. Readers can starve if writers
+//                      keep coming.
+//
+//  rw_prefer_readers   A writer only gets in when there are no readers at all. Lowest reader
+//                      latency, writers starve under constant reader traffic.
+//
+//  rw_phase_fair       Readers and writers take turns. (Brandenburg & Anderson, PF-T) A
+//                      reader waits for at most one writer and a writer waits for at most one
+//                      reader phase plus the writers ahead of it. Uses its own lock word, the
+//                      traits don't apply.
+//
+struct rw_prefer_writers    { static const bool prefer_writers = true;  };
+struct rw_prefer_readers    { static const bool prefer_writers = false; };
+struct rw_phase_fair        { };
+
+
+
+//-------------------------------------------------------------------------------------------------
+// spin_reader_writer_lock
+//
+//  A reader / writer lock is used when a data structure is safe to access by many readers.
+//  When a change needs to be made, a writer needs to take the lock exclusively so that any
+//  changes are picked up by subsequent reads.
+//
+//  With the default mode, exclusive access will stall NEW readers and block until existing
+//  readers are finished.
+//
+//  try_lock_for and try_lock_shared_for keep trying (with the backoff policy) until they get
+//  the lock or the time runs out. (C++ concept: TimedLockable)
+//
+template
+<
+    typename traits     = typename std::conditional<is_64_bit::value,is_64_bit,is_32_bit>::type,
+    typename backoff    = backoff_default,
+    typename mode       = rw_prefer_writers
+>
+class spin_reader_writer_lock
+{
+private:
+    static const std::memory_order release = std::memory_order_release;
+    static const std::memory_order relaxed = std::memory_order_relaxed;
+    static const std::memory_order acquire = std::memory_order_acquire;
+
+    using storage_t = typename traits::value_type;
+    using lock_t    = typename traits::lock_type;
+
+    static const storage_t addend_exclusive = traits::addend_exclusive;
+    static const storage_t mask_exclusive   = traits::mask_exclusive;
+    static const storage_t max_exclusive    = traits::max_exclusive;
+    static const storage_t mask_shared      = traits::mask_shared;
+    static const storage_t max_shared       = traits::max_shared;
+
+    // Just a little safety for folks that might want to change the
+    // behavior of the routines.
+    //
+    static_assert( mask_exclusive > mask_shared,                            "These routines require the exclusive bits in the higher order bytes.");
+    static_assert( (mask_exclusive & addend_exclusive) == addend_exclusive, "Check your exclusive mask and addend!" );
+    static_assert( (mask_exclusive > max_exclusive),                        "At least a single overflow bit is needed." );
+    static_assert( (mask_shared & 0x1) == 0x1,                              "The shared mask must include the lowest order bit." );
+    static_assert( (mask_shared > max_shared),                              "At least a single overflow bit is needed." );
+    static_assert( (mask_shared & mask_exclusive) == 0,                     "No overlap of shared and exclusive bits allowed!" );
+
+    lock_t  l;
+
+public:
+    spin_reader_writer_lock(const spin_reader_writer_lock&) = delete;
+    spin_reader_writer_lock() : l(0)
+    {
+    }
+
+    void lock()
+    {
+        backoff wait;
+
+        if( !mode::prefer_writers )
+        {
+            // Only take the lock when nobody at all has it.
+            //
+            while( !try_lock() )
+            {
+                while( l.load(relaxed) != 0 )
+                {
+                    wait();
+                }
+            }
+            return;
+        }
+
+        // Spin until we acquire the write lock. Which we know is "ours" because
+        // no one else owned it before.
+        //
+        while( ( l.fetch_add(addend_exclusive,acquire) & mask_exclusive ) >= addend_exclusive )
+        {
+            l.fetch_sub(addend_exclusive,relaxed);
+
+            // Don't bother with the RMW again until the other writer is gone.
+            //
+            while( ( l.load(relaxed) & mask_exclusive ) != 0 )
+            {
+                wait();
+            }
+        }
+
+        // Spin while any readers are still owning a lock
+        //
+        while( ( l.load(acquire) & mask_shared ) > 0 )
+        {
+            wait();
+        }
+    }
+
+    void unlock()
+    {
+        l.fetch_sub(addend_exclusive,release);
+    }
+
+    bool try_lock()
+    {
+        // The only way this can succeed is if ALL writers and all readers
+        // are not doing anything, which means that the value in the lock
+        // had to be zero.
+        //
+        storage_t expected = 0;
+
+        return l.compare_exchange_strong(expected,addend_exclusive,acquire,relaxed);
+    }
+
+    template<typename Rep,typename Period>
+    bool try_lock_for(const std::chrono::duration<Rep,Period>& timeout)
+    {
+        return try_until( timeout, [this] { return try_lock(); } );
+    }
+
+    void lock_shared()
+    {
+        backoff wait;
+
+        // Happy case is that no writers want in and on a 64bit system by default fewer than
+        // 1 billion readers are using the lock.
+        //
+        while( !try_lock_shared() )
+        {
+            // Stay away until there is a reasonable chance we can take the lock. This
+            // prevents a lockout while an exclusive owner is waiting for readers to exit.
+            //
+            while( l.load(relaxed) > max_shared )
+            {
+                wait();
+            }
+        }
+    }
+
+    void unlock_shared()
+    {
+        l.fetch_sub(1,release);
+    }
+
+    bool try_lock_shared()
+    {
+        // A writer waiting for the readers to drain needs to see the count go down. Don't
+        // bump it just to take it right back off.
+        //
+        if( mode::prefer_writers && l.load(relaxed) > max_shared )
+        {
+            return false;
+        }
+
+        bool owned = l.fetch_add(1,acquire) + 1 <= max_shared;
+
+        if(!owned)
+        {
+            l.fetch_sub(1,relaxed);
+        }
+
+        return owned;
+    }
+
+    template<typename Rep,typename Period>
+    bool try_lock_shared_for(const std::chrono::duration<Rep,Period>& timeout)
+    {
+        return try_until( timeout, [this] { return try_lock_shared(); } );
+    }
+
+private:
+    template<typename Rep,typename Period,typename F>
+    static bool try_until(const std::chrono::duration<Rep,Period>& timeout,F attempt)
+    {
+        auto    until = std::chrono::steady_clock::now() + timeout;
+        backoff wait;
+
+        while( !attempt() )
+        {
+            if( std::chrono::steady_clock::now() >= until )
+            {
+                return false;
+            }
+            wait();
+        }
+
+        return true;
+    }
+};
+
+
+
+//-------------------------------------------------------------------------------------------------
+// spin_reader_writer_lock (phase fair)
+//
+//  Readers count themselves in on rin and out on rout. The low bits of rin say if a writer is
+//  present and which phase it belongs to. Writers take tickets (win / wout) to serialize among
+//  themselves. A writer sets its bits in rin, which stops new readers, and waits for the readers
+//  that were already in to count out. A blocked reader only waits for the bits to change, which
+//  happens when that one writer leaves, so readers that arrived during the write phase all go
+//  next, before the following writer.
+//
+//  The try_ versions never wait on the other side. try_lock only sets the writer bits when no
+//  reader is in (and otherwise passes its ticket on), and a try_lock_shared that runs into a
+//  writer takes itself back out of rin.
+//
+template<typename traits,typename backoff>
+class spin_reader_writer_lock<traits,backoff,rw_phase_fair>
+{
+private:
+    static const std::memory_order release = std::memory_order_release;
+    static const std::memory_order relaxed = std::memory_order_relaxed;
+    static const std::memory_order acquire = std::memory_order_acquire;
+
+    static const uint32_t reader    = 0x100;    // Readers count in the upper bits
+    static const uint32_t writer    = 0x3;      // Writer bits
+    static const uint32_t present   = 0x2;      // A writer is present
+    static const uint32_t phase     = 0x1;      // Phase of the present writer
+
+    ee5_alignas( CACHE_ALIGN ) std::atomic<uint32_t> rin;
+    ee5_alignas( CACHE_ALIGN ) std::atomic<uint32_t> rout;
+    ee5_alignas( CACHE_ALIGN ) std::atomic<uint32_t> win;
+    ee5_alignas( CACHE_ALIGN ) std::atomic<uint32_t> wout;
+
+    // Once a writer has its ticket it is committed. Block the readers and wait out the
+    // readers that are already in.
+    //
+    void write_phase(uint32_t ticket)
+    {
+        backoff     wait;
+        uint32_t    readers = rin.fetch_add( present | ( ticket & phase ), acquire ) & ~writer;
+
+        while( rout.load( acquire ) != readers )
+        {
+            wait();
+        }
+    }
+
+public:
+    spin_reader_writer_lock(const spin_reader_writer_lock&) = delete;
+    spin_reader_writer_lock() : rin(0), rout(0), win(0), wout(0)
+    {
+    }
+
+    void lock()
+    {
+        backoff     wait;
+        uint32_t    ticket = win.fetch_add( 1, relaxed );
+
+        while( wout.load( acquire ) != ticket )
+        {
+            wait();
+        }
+
+        write_phase( ticket );
+    }
+
+    void unlock()
+    {
+        rin.fetch_and( ~writer, release );
+        wout.fetch_add( 1, release );
+    }
+
+    bool try_lock()
+    {
+        uint32_t ticket = wout.load( acquire );
+
+        // Only take a ticket when nobody is in line for one, so it's the next one up.
+        //
+        if( !win.compare_exchange_strong( ticket, ticket + 1, acquire, relaxed ) )
+        {
+            return false;
+        }
+
+        // Set the writer bits only if no reader is in. (Once rout matches, rin not changing
+        // up to the exchange means no reader came in.) Otherwise hand the ticket straight on,
+        // without ever having blocked the readers.
+        //
+        uint32_t readers = rin.load( relaxed );
+
+        if( readers != rout.load( acquire ) ||
+            !rin.compare_exchange_strong( readers, readers | present | ( ticket & phase ), acquire, relaxed ) )
+        {
+            wout.fetch_add( 1, release );
+            return false;
+        }
+
+        return true;
+    }
+
+    template<typename Rep,typename Period>
+    bool try_lock_for(const std::chrono::duration<Rep,Period>& timeout)
+    {
+        return try_until( timeout, [this] { return try_lock(); } );
+    }
+
+    void lock_shared()
+    {
+        uint32_t w = rin.fetch_add( reader, acquire ) & writer;
+
+        if( w != 0 )
+        {
+            backoff wait;
+
+            // Wait for this writer (only) to leave.
+            //
+            while( ( rin.load( acquire ) & writer ) == w )
+            {
+                wait();
+            }
+        }
+    }
+
+    void unlock_shared()
+    {
+        rout.fetch_add( reader, release );
+    }
+
+    bool try_lock_shared()
+    {
+        if( ( rin.load( relaxed ) & writer ) != 0 )
+        {
+            return false;
+        }
+
+        uint32_t v = rin.fetch_add( reader, acquire ) + reader;
+        uint32_t w = v & writer;
+
+        // A writer showed up. Its snapshot of rin may not include this reader, so counting out
+        // through rout could let it in while other readers still are. Take the reader back out
+        // of rin instead, as long as it is still the same writer. If the bits moved on, that
+        // writer has left and this reader is in the same as lock_shared would be.
+        //
+        while( w != 0 )
+        {
+            if( rin.compare_exchange_weak( v, v - reader, relaxed, relaxed ) )
+            {
+                return false;
+            }
+
+            if( ( v & writer ) != w )
+            {
+                return true;
+            }
+        }
+
+        return true;
+    }
+
+    template<typename Rep,typename Period>
+    bool try_lock_shared_for(const std::chrono::duration<Rep,Period>& timeout)
+    {
+        return try_until( timeout, [this] { return try_lock_shared(); } );
+    }
+
+private:
+    template<typename Rep,typename Period,typename F>
+    static bool try_until(const std::chrono::duration<Rep,Period>& timeout,F attempt)
+    {
+        auto    until = std::chrono::steady_clock::now() + timeout;
+        backoff wait;
+
+        while( !attempt() )
+        {
+            if( std::chrono::steady_clock::now() >= until )
+            {
+                return false;
+            }
+            wait();
+        }
+
+        return true;
     }
-
 };
 
 using spin_shared_mutex_t = spin_reader_writer_lock<>;
 
 
+
+//-------------------------------------------------------------------------------------------------
+// seqlock
+//
+//  For data that many threads read all the time and that rarely changes. (config snapshots,
+//  statistics) A reader / writer lock makes every reader write the lock word, so the line the
+//  lock is on bounces between all of the reading cores even though nothing is changing. A
+//  seqlock reader doesn't write anything shared. It reads the sequence, reads the data, and
+//  reads the sequence again. If a writer was active (odd sequence) or finished (sequence
+//  moved) in the meantime, the read is thrown away and done again.
+//
+//  Writers are serialized with L and bump the sequence before and after the change. Writers
+//  never wait for readers, so a reader can starve if the writes are frequent. That isn't what
+//  this is for.
+//
+//  The reader can see a torn value while a write is in progress, so whatever it does with the
+//  data before read_retry says the read was good must be safe with garbage. (Copy it out, don't
+//  follow pointers in it.) seqlock_value<> takes care of this for plain values.
+//
+//      uint32_t s;
+//      do
+//      {
+//          s = lock.read_begin();
+//          ... copy the data ...
+//      }
+//      while( lock.read_retry( s ) );
+//
+//  C++ concept: BasicLockable (the write side)
+//
+template<typename L = spin_mutex>
+class seqlock
+{
+    static const std::memory_order release = std::memory_order_release;
+    static const std::memory_order relaxed = std::memory_order_relaxed;
+    static const std::memory_order acquire = std::memory_order_acquire;
+
+    std::atomic<uint32_t>   sequence;
+    L                       writers;
+
+public:
+    seqlock(const seqlock&) = delete;
+    seqlock() : sequence(0)
+    {
+    }
+
+    uint32_t read_begin() const
+    {
+        uint32_t s;
+
+        while( ( s = sequence.load( acquire ) ) & 1 )
+        {
+            cpu_relax();
+        }
+
+        return s;
+    }
+
+    bool read_retry(uint32_t begin) const
+    {
+        // Keep the data loads above the second look at the sequence.
+        //
+        std::atomic_thread_fence( acquire );
+
+        return sequence.load( relaxed ) != begin;
+    }
+
+    void lock()
+    {
+        writers.lock();
+
+        sequence.store( sequence.load( relaxed ) + 1, relaxed );
+
+        // Keep the data stores below the odd sequence.
+        //
+        std::atomic_thread_fence( release );
+    }
+
+    void unlock()
+    {
+        sequence.store( sequence.load( relaxed ) + 1, release );
+
+        writers.unlock();
+    }
+};
+
+
+
+//-------------------------------------------------------------------------------------------------
+// seqlock_value
+//
+//  A trivially copyable T behind a seqlock. The value is kept as an array of atomic words
+//  (relaxed, which are plain moves on x86) so a read that overlaps a write is a torn copy and
+//  not undefined behavior.
+//
+//      seqlock_value<config> current;
+//
+//      current.store( c );         // writer
+//      config c = current.load();  // readers
+//
+template<typename T,typename L = spin_mutex>
+class seqlock_value
+{
+    static_assert( std::is_trivially_copyable<T>::value, "seqlock_value needs a trivially copyable type" );
+
+    static const std::memory_order relaxed = std::memory_order_relaxed;
+
+    using word_t = uintptr_t;
+
+    static const size_t words = ( sizeof( T ) + sizeof( word_t ) - 1 ) / sizeof( word_t );
+
+    seqlock<L>          lock;
+    std::atomic<word_t> data[words];
+
+public:
+    seqlock_value(const seqlock_value&) = delete;
+    seqlock_value()
+    {
+        store( T() );
+    }
+    seqlock_value(const T& value)
+    {
+        store( value );
+    }
+
+    T load() const
+    {
+        word_t      copy[words];
+        uint32_t    s;
+
+        do
+        {
+            s = lock.read_begin();
+
+            for( size_t i = 0; i < words; ++i )
+            {
+                copy[i] = data[i].load( relaxed );
+            }
+        }
+        while( lock.read_retry( s ) );
+
+        T value;
+        memcpy( &value, copy, sizeof( T ) );
+        return value;
+    }
+
+    void store(const T& value)
+    {
+        word_t copy[words] = { };
+        memcpy( copy, &value, sizeof( T ) );
+
+        lock.lock();
+
+        for( size_t i = 0; i < words; ++i )
+        {
+            data[i].store( copy[i], relaxed );
+        }
+
+        lock.unlock();
+    }
+
+    // Read, change and write back under the write lock. (No lost updates between writers.)
+    //
+    template<typename F>
+    void update(F change)
+    {
+        std::lock_guard<seqlock<L>> hold( lock );
+
+        word_t copy[words];
+
+        for( size_t i = 0; i < words; ++i )
+        {
+            copy[i] = data[i].load( relaxed );
+        }
+
+        T value;
+        memcpy( &value, copy, sizeof( T ) );
+
+        change( value );
+
+        memcpy( copy, &value, sizeof( T ) );
+
+        for( size_t i = 0; i < words; ++i )
+        {
+            data[i].store( copy[i], relaxed );
+        }
+    }
+};
+
+
 ENS( ee5 )
@@ -0,0 +1,559 @@
+//-------------------------------------------------------------------------------------------------
+// Copyright (C) 2014 Ernest R. Ewert
+//
+// Feel free to use this as you see fit.
+// I ask that you keep my name with the code.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+// MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+// IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+// OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+// ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+// OTHER DEALINGS IN THE SOFTWARE.
+//
+#pragma once
+#include <ee5>
+
+#include <workthread.h>
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <thread>
+#include <utility>
+
+BNS( ee5 )
+//-------------------------------------------------------------------------------------------------
+// spsc_ring
+//
+//  A bounded single-producer / single-consumer ring. When exactly one thread puts items in and
+//  exactly one thread takes them out there is no need for any of the read-modify-write
+//  operations that the multi-producer containers pay for. Every operation is wait free, a push
+//  or pop is a handful of loads and a single release store.
+//
+//  The producer owns tail and the consumer owns head. The expensive part of a "naive" SPSC
+//  ring is that every push reads head and every pop reads tail, and those reads pull the cache
+//  line over from the other core. Each side keeps a private copy of the other side's index and
+//  only refreshes it when the private copy says the ring is full (producer) or empty (consumer).
+//  In a steady stream the refresh happens roughly once per lap instead of once per item.
+//
+//  Unlike the aq:: containers the items are stored by value and moved in and out. T needs to be
+//  default constructible and move assignable. (unique_ptr's work great.)
+//
+//  capacity must be a power of two.
+//
+//  **Important**
+//  Nothing checks that there is only a single producer and a single consumer. Two threads
+//  pushing at the same time WILL corrupt the ring.
+//
+template<typename T, size_t capacity>
+class ee5_alignas( CACHE_ALIGN ) spsc_ring
+{
+private:
+    static const std::memory_order release = std::memory_order_release;
+    static const std::memory_order relaxed = std::memory_order_relaxed;
+    static const std::memory_order acquire = std::memory_order_acquire;
+
+    static_assert( capacity >= 2,                       "The ring needs at least two slots." );
+    static_assert( ( capacity & ( capacity - 1 ) ) == 0,  "The ring capacity must be a power of two." );
+
+    static const size_t mask = capacity - 1;
+
+    // Producer cache line
+    //
+    ee5_alignas( CACHE_ALIGN )
+    std::atomic_size_t  tail;           // Next slot the producer will fill
+    size_t              head_cache;     // Producer's (possibly stale) copy of head
+
+    // Consumer cache line
+    //
+    ee5_alignas( CACHE_ALIGN )
+    std::atomic_size_t  head;           // Next slot the consumer will empty
+    size_t              tail_cache;     // Consumer's (possibly stale) copy of tail
+
+    ee5_alignas( CACHE_ALIGN )
+    std::array<T,capacity> items;
+
+    // Number of slots the producer can fill, refreshing the copy of head only if
+    // the cached value can't satisfy the request.
+    //
+    size_t writable( size_t t, size_t wanted )
+    {
+        size_t room = capacity - ( t - head_cache );
+
+        if( room < wanted )
+        {
+            head_cache  = head.load( acquire );
+            room        = capacity - ( t - head_cache );
+        }
+
+        return room < wanted ? room : wanted;
+    }
+
+    // Number of slots the consumer can empty, refreshing the copy of tail only if
+    // the cached value can't satisfy the request.
+    //
+    size_t readable( size_t h, size_t wanted )
+    {
+        size_t avail = tail_cache - h;
+
+        if( avail < wanted )
+        {
+            tail_cache  = tail.load( acquire );
+            avail       = tail_cache - h;
+        }
+
+        return avail < wanted ? avail : wanted;
+    }
+
+public:
+    static const size_t max_item_count = capacity;
+
+    spsc_ring() : tail( 0 ), head_cache( 0 ), head( 0 ), tail_cache( 0 )
+    {
+    }
+    spsc_ring( const spsc_ring& ) = delete;
+
+    // Producer side
+    //
+    //  returns false if the ring is full. item is untouched in that case.
+    //
+    bool push( T&& item )
+    {
+        size_t t = tail.load( relaxed );
+
+        if( writable( t, 1 ) == 0 )
+        {
+            return false;
+        }
+
+        items[ t & mask ] = std::move( item );
+        tail.store( t + 1, release );
+
+        return true;
+    }
+
+    // Producer side
+    //
+    //  Moves up to count items out of the array and publishes them with a single store. Returns
+    //  the number of items moved, the items after that are untouched.
+    //
+    size_t push_bulk( T* in, size_t count )
+    {
+        size_t t = tail.load( relaxed );
+        size_t n = writable( t, count );
+
+        for( size_t i = 0; i < n; ++i )
+        {
+            items[ ( t + i ) & mask ] = std::move( in[i] );
+        }
+
+        if( n )
+        {
+            tail.store( t + n, release );
+        }
+
+        return n;
+    }
+
+    // Consumer side
+    //
+    //  returns false if the ring is empty.
+    //
+    bool pop( T& out )
+    {
+        size_t h = head.load( relaxed );
+
+        if( readable( h, 1 ) == 0 )
+        {
+            return false;
+        }
+
+        out = std::move( items[ h & mask ] );
+        head.store( h + 1, release );
+
+        return true;
+    }
+
+    // Consumer side
+    //
+    //  Moves up to max items into out and releases the slots with a single store. Returns the
+    //  number of items moved.
+    //
+    size_t pop_bulk( T* out, size_t max )
+    {
+        size_t h = head.load( relaxed );
+        size_t n = readable( h, max );
+
+        for( size_t i = 0; i < n; ++i )
+        {
+            out[i] = std::move( items[ ( h + i ) & mask ] );
+        }
+
+        if( n )
+        {
+            head.store( h + n, release );
+        }
+
+        return n;
+    }
+
+    // These are a snapshot and are only "exact" when called from the consumer (empty) or
+    // when nothing else is running.
+    //
+    bool empty()
+    {
+        return head.load( acquire ) == tail.load( acquire );
+    }
+
+    size_t size()
+    {
+        return tail.load( acquire ) - head.load( acquire );
+    }
+};
+
+
+
+//-------------------------------------------------------------------------------------------------
+// spsc_blocking_ring
+//
+//  Adds the ability for the consumer to sleep when the ring is empty. The producer only pays for
+//  the wake up (the cv_event mutex) when the consumer has actually said it is going to sleep.
+//  In the steady state the cost over the bare ring is a fence and a load.
+//
+//  The consumer announces that it is waiting, and then checks the ring one more time. The
+//  producer publishes the item and then checks for a waiter. With a full fence on both sides at
+//  least one of them sees the other, so the wake can't be lost. The cv_event is "sticky" so a
+//  set that races ahead of the wait just makes the wait return right away.
+//
+template<typename T, size_t capacity>
+class spsc_blocking_ring
+{
+private:
+    using ring_t = spsc_ring<T,capacity>;
+
+    ring_t              ring;
+    ee5_alignas( CACHE_ALIGN )
+    std::atomic_bool    waiting;
+    std::atomic_bool    woken;
+    cv_event            sig;
+
+    void notify()
+    {
+        std::atomic_thread_fence( std::memory_order_seq_cst );
+
+        if( waiting.load( std::memory_order_relaxed ) )
+        {
+            waiting.store( false, std::memory_order_relaxed );
+            sig.set();
+        }
+    }
+
+    // Consumer side. Returns when the ring has something or wake() was called.
+    //
+    void sleep()
+    {
+        waiting.store( true, std::memory_order_relaxed );
+        std::atomic_thread_fence( std::memory_order_seq_cst );
+
+        if( ring.empty() && !woken.load( std::memory_order_relaxed ) )
+        {
+            sig.wait();
+        }
+
+        waiting.store( false, std::memory_order_relaxed );
+    }
+
+public:
+    spsc_blocking_ring() : waiting( false ), woken( false )
+    {
+    }
+    spsc_blocking_ring( const spsc_blocking_ring& ) = delete;
+
+    bool push( T&& item )
+    {
+        bool pushed = ring.push( std::move( item ) );
+
+        if( pushed )
+        {
+            notify();
+        }
+
+        return pushed;
+    }
+
+    size_t push_bulk( T* in, size_t count )
+    {
+        size_t n = ring.push_bulk( in, count );
+
+        if( n )
+        {
+            notify();
+        }
+
+        return n;
+    }
+
+    // Producer side. Yields while the ring is full.
+    //
+    void push_wait( T&& item )
+    {
+        while( !ring.push( std::move( item ) ) )
+        {
+            std::this_thread::yield();
+        }
+
+        notify();
+    }
+
+    bool pop( T& out )
+    {
+        return ring.pop( out );
+    }
+
+    size_t pop_bulk( T* out, size_t max )
+    {
+        return ring.pop_bulk( out, max );
+    }
+
+    // Consumer side. Blocks until an item is available.
+    //
+    //  returns false (without an item) if wake() was called while the ring was empty.
+    //
+    bool pop_wait( T& out )
+    {
+        while( !ring.pop( out ) )
+        {
+            if( woken.exchange( false ) )
+            {
+                return ring.pop( out );
+            }
+
+            sleep();
+        }
+
+        return true;
+    }
+
+    // Consumer side. Blocks until at least one item is available and then takes up to max.
+    //
+    size_t pop_bulk_wait( T* out, size_t max )
+    {
+        size_t n = 0;
+
+        while( ( n = ring.pop_bulk( out, max ) ) == 0 )
+        {
+            if( woken.exchange( false ) )
+            {
+                return ring.pop_bulk( out, max );
+            }
+
+            sleep();
+        }
+
+        return n;
+    }
+
+    // Knock the consumer out of a wait. (Shutdown, etc.) Can be called from any thread.
+    //
+    void wake()
+    {
+        woken.store( true );
+        std::atomic_thread_fence( std::memory_order_seq_cst );
+        sig.set();
+    }
+
+    bool empty()
+    {
+        return ring.empty();
+    }
+
+    size_t size()
+    {
+        return ring.size();
+    }
+};
+
+//-------------------------------------------------------------------------------------------------
+// spsc_record_ring
+//
+//  A single-producer / single-consumer ring of variable length records. spsc_ring moves whole
+//  T's, which is a waste when most records are much smaller than the largest. Here the producer
+//  reserves the bytes it might need, fills them in place and commits what it actually used. The
+//  consumer gets a pointer to the record in the ring and releases it when it is done. Nothing
+//  is copied in or out.
+//
+//  Each record is an 8 byte header (the size) followed by the bytes, rounded up to 8 bytes. A
+//  record never wraps. If it doesn't fit in front of the end of the buffer the rest of the lap
+//  is filled with a pad record and the record starts over at the front.
+//
+//  The same index caching as spsc_ring, so the two sides only touch each other's cache line
+//  about once per lap.
+//
+//  capacity must be a power of two. Records can be up to capacity / 2 bytes.
+//
+template<size_t capacity>
+class ee5_alignas( CACHE_ALIGN ) spsc_record_ring
+{
+private:
+    static const std::memory_order release = std::memory_order_release;
+    static const std::memory_order relaxed = std::memory_order_relaxed;
+    static const std::memory_order acquire = std::memory_order_acquire;
+
+    static_assert( capacity >= 64,                        "The ring needs room for a few records." );
+    static_assert( ( capacity & ( capacity - 1 ) ) == 0,  "The ring capacity must be a power of two." );
+
+    static const size_t     mask    = capacity - 1;
+    static const uint32_t   pad     = UINT32_MAX;
+
+    struct header
+    {
+        uint32_t    cb;         // bytes after the header, or pad
+        uint32_t    skip;       // pad: bytes after the header to the end of the lap
+    };
+
+    static size_t round_up(size_t cb)
+    {
+        return ( cb + sizeof( header ) + 7 ) & ~size_t( 7 );
+    }
+
+    header* at(size_t position)
+    {
+        return reinterpret_cast<header*>( &buffer[ position & mask ] );
+    }
+
+    // Producer cache line
+    //
+    ee5_alignas( CACHE_ALIGN )
+    std::atomic_size_t  tail;           // End of the committed records
+    size_t              head_cache;     // Producer's (possibly stale) copy of head
+    size_t              reserved;       // Where the reserved record starts
+
+    // Consumer cache line
+    //
+    ee5_alignas( CACHE_ALIGN )
+    std::atomic_size_t  head;           // Start of the oldest record
+    size_t              tail_cache;     // Consumer's (possibly stale) copy of tail
+
+    ee5_alignas( CACHE_ALIGN )
+    uint8_t             buffer[capacity];
+
+public:
+    static const size_t max_record = capacity / 2 - sizeof( header );
+
+    spsc_record_ring() : tail( 0 ), head_cache( 0 ), reserved( 0 ), head( 0 ), tail_cache( 0 )
+    {
+    }
+    spsc_record_ring( const spsc_record_ring& ) = delete;
+
+    // Producer side
+    //
+    //  Room for cb bytes, or nullptr if the ring is too full. The bytes are only handed to the
+    //  consumer by commit. A second reserve replaces the first.
+    //
+    void* reserve( size_t cb )
+    {
+        if( cb > max_record )
+        {
+            return nullptr;
+        }
+
+        size_t t        = tail.load( relaxed );
+        size_t need     = round_up( cb );
+        size_t to_end   = capacity - ( t & mask );
+        size_t total    = need > to_end ? to_end + need : need;
+
+        if( capacity - ( t - head_cache ) < total )
+        {
+            head_cache = head.load( acquire );
+
+            if( capacity - ( t - head_cache ) < total )
+            {
+                return nullptr;
+            }
+        }
+
+        if( need > to_end )
+        {
+            header* h = at( t );
+
+            h->cb   = pad;
+            h->skip = static_cast<uint32_t>( to_end - sizeof( header ) );
+
+            t += to_end;
+        }
+
+        reserved = t;
+
+        return at( t ) + 1;
+    }
+
+    // Producer side
+    //
+    //  Publish the reserved record with the first cb bytes. (cb can't be more than was
+    //  reserved.)
+    //
+    void commit( size_t cb )
+    {
+        at( reserved )->cb = static_cast<uint32_t>( cb );
+
+        tail.store( reserved + round_up( cb ), release );
+    }
+
+    // Consumer side
+    //
+    //  The oldest record, or nullptr if the ring is empty. The record stays in the ring until
+    //  release is called.
+    //
+    void* peek( size_t* cb = nullptr )
+    {
+        size_t h = head.load( relaxed );
+
+        for(;;)
+        {
+            if( h == tail_cache )
+            {
+                tail_cache = tail.load( acquire );
+
+                if( h == tail_cache )
+                {
+                    return nullptr;
+                }
+            }
+
+            header* r = at( h );
+
+            if( r->cb != pad )
+            {
+                if( cb )
+                {
+                    *cb = r->cb;
+                }
+                return r + 1;
+            }
+
+            h += sizeof( header ) + r->skip;
+            head.store( h, release );
+        }
+    }
+
+    // Consumer side
+    //
+    //  Drop the record returned by peek.
+    //
+    void release_record()
+    {
+        size_t h = head.load( relaxed );
+
+        head.store( h + round_up( at( h )->cb ), release );
+    }
+
+    bool empty()
+    {
+        return head.load( acquire ) == tail.load( acquire );
+    }
+};
+
+ENS( ee5 )
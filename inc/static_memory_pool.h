@@ -74,8 +74,14 @@ const int cache_alignment_intel_x86_64 = 64;
 //      An additional benefit is that the proximity of following data is more likely to
 //      already be mapped.
 //
+//  stack:
+//      The lock free stack used for the cache of free buffers. atomic_stack is the default. If
+//      many threads acquire and release at the same time (marshaled call buffers from every
+//      core) eliminating_stack keeps the releases and acquires from piling up on a single
+//      cache line.
 //
-template< size_t item_size, size_t item_count, size_t align = cache_alignment_intel_x86_64 >
+//
+template< size_t item_size, size_t item_count, size_t align = cache_alignment_intel_x86_64, template<typename> class stack = atomic_stack >
 class ee5_alignas(64) static_memory_pool
 {
 private:
@@ -107,7 +113,7 @@ private:
     static_assert( offsetof( pool_buffer, data ) == 0, "This storage is intended to have zero overhead.");
 
     typedef std::array<pool_buffer,item_count>  storage_t;
-    typedef atomic_stack<pool_buffer>           stack_t;
+    typedef stack<pool_buffer>                  stack_t;
 
     // The "simple" array of like sized buffers becomes a part of the memory layout of this
     // object.
@@ -168,13 +174,16 @@ public:
     //
     static_memory_pool()
     {
-        // Load all of the items into the cache. The current effect of
-        // this loop is that the end of the array is initially used first.
+        // Link all of the items together and load them into the cache with a
+        // single push. The list runs from the end of the array to the front
+        // so the end of the array is initially used first.
         //
-        for(auto& i : store)
+        for(size_t i = 1; i < item_count; ++i)
         {
-            cache.push(&i);
+            store[i].next = &store[i-1];
         }
+
+        cache.push_chain( &store.back(), &store.front() );
     }
 
 
@@ -227,6 +236,65 @@ public:
     }
 
 
+    // acquire up to count buffers
+    //
+    //  The buffers come off the cache with a single exchange. Returns the number of buffers
+    //  placed in out, which is less than count if the pool is running dry.
+    //
+    size_t acquire(void** out, size_t count)
+    {
+        size_t          n   = 0;
+        pool_buffer*    p   = cache.pop_n( count, &n );
+
+        for( size_t i = 0; i < n; ++i )
+        {
+            pool_buffer* next = p->next;
+
+            p->next = nullptr;
+            out[i]  = p;
+            p       = next;
+        }
+
+        return n;
+    }
+
+
+    // release a batch of buffers back to the class
+    //
+    //  The buffers are cleaned and linked together on this thread and go back into the cache
+    //  with a single exchange. Pointers that don't belong to the pool are skipped. Returns the
+    //  number of buffers released.
+    //
+    size_t release(void** buffers, size_t count)
+    {
+        pool_buffer*    first   = nullptr;
+        pool_buffer*    last    = nullptr;
+        size_t          n       = 0;
+
+        for( size_t i = 0; i < count; ++i )
+        {
+            if( is_valid_pointer( buffers[i] ) )
+            {
+                pool_buffer* p = reinterpret_cast<pool_buffer*>( buffers[i] );
+
+                std::memset( p, 0, item_size );
+
+                p->next = first;
+                first   = p;
+                last    = last ? last : p;
+                ++n;
+            }
+        }
+
+        if( first )
+        {
+            cache.push_chain( first, last );
+        }
+
+        return n;
+    }
+
+
     // acquire a buffer as a specific type.
     //
     //  returns nullptr if no buffer is available.
@@ -309,7 +377,16 @@ public:
     template<typename T, typename...TArgs>
     unique_type<T> acquire_unique(TArgs...args)
     {
-        return unique_type<T>( new(acquire()) T(std::forward<TArgs>(args)...), pool_deleter(this) );
+        void* buffer = acquire();
+
+        // Placement new on a nullptr is undefined, an empty pool hands back an empty unique_ptr.
+        //
+        if( !buffer )
+        {
+            return unique_type<T>( nullptr, pool_deleter(this) );
+        }
+
+        return unique_type<T>( new(buffer) T(std::forward<TArgs>(args)...), pool_deleter(this) );
     }
 };
 
@@ -84,7 +84,7 @@ struct async_call
 
 extern async_call async;
 
-void    tp_start( size_t c );
+RC      tp_start( size_t c );
 void    tp_stop();
 size_t  tp_pending();
 size_t  tp_count();
@@ -15,7 +15,22 @@
 #pragma once
 #include <ee5>
 
+#include <cstddef>
+
 BNS( ee5 )
 
+//-------------------------------------------------------------------------------------------------
+// NUMA topology
+//
+//  Read once from /sys/devices/system/node/node*/cpulist. Where that isn't available (not
+//  Linux, or a container that hides it) everything is node 0 of 1.
+//
+//  current_numa_node is the node of the CPU the calling thread is running on right now. The
+//  thread can be moved right after the call, so it is a hint for placement (which lock, which
+//  queue) and never something to depend on.
+//
+size_t numa_node_count();
+size_t numa_node_of_cpu(size_t cpu);
+size_t current_numa_node();
 
 ENS( ee5 )
@@ -16,11 +16,14 @@
 #include <ee5>
 
 #include <delegate.h>
+#include <epoch.h>
 #include <error.h>
+#include <lock_profile.h>
 #include <spin_locking.h>
 #include <stopwatch.h>
 
 #include <condition_variable>
+#include <future>
 #include <memory>
 #include <mutex>
 #include <atomic>
@@ -28,6 +31,8 @@
 #include <thread>
 #include <cassert>
 #include <array>
+#include <chrono>
+#include <cstdint>
 
 BNS( ee5 )
 
@@ -90,6 +95,160 @@ public:
 
 
 
+//---------------------------------------------------------------------------------------------------------------------
+// eventcount
+//
+//  A cv_event is a "sticky" flag. That works for a single consumer, but a set() that races with
+//  a reset() (or a second consumer) loses the wake up. An eventcount turns "check the condition
+//  then sleep" into a two phase operation so a wake can't slip in between:
+//
+//      auto key = ec.prepare_wait();   // I might sleep
+//      if( condition_met() )           // check again
+//      {
+//          ec.cancel_wait();
+//      }
+//      else
+//      {
+//          ec.commit_wait( key );      // sleeps only if nothing was notified after prepare
+//      }
+//
+//  The notify side is a fence and a load when nobody is waiting, so it is cheap enough to call
+//  on every enqueue. The mutex / condition_variable are only touched when there is a waiter.
+//
+//  The state is an epoch (upper bits) and a count of threads between prepare and the end of
+//  the wait (lower bits).
+//
+class eventcount
+{
+private:
+    using frame_lock = std::unique_lock<std::mutex>;
+    using clock      = std::chrono::steady_clock;
+
+    static const uint64_t waiter_mask = 0x00000000FFFFFFFF;
+    static const uint64_t epoch_one   = 0x0000000100000000;
+
+    std::atomic<uint64_t>   state;
+    std::mutex              mtx;
+    std::condition_variable cv;
+
+    void wake(bool all)
+    {
+        std::atomic_thread_fence( std::memory_order_seq_cst );
+
+        if( ( state.load( std::memory_order_relaxed ) & waiter_mask ) != 0 )
+        {
+            // The epoch is moved under the mutex so a waiter can't check the epoch
+            // and then miss the notify on the way into the wait.
+            //
+            framed_lock( mtx, [&] { state.fetch_add( epoch_one ); } );
+
+            if( all )
+            {
+                cv.notify_all();
+            }
+            else
+            {
+                cv.notify_one();
+            }
+        }
+    }
+
+public:
+    using key_type = uint64_t;
+
+    eventcount() : state( 0 )
+    {
+    }
+    eventcount( const eventcount& ) = delete;
+
+    key_type prepare_wait()
+    {
+        key_type key = state.fetch_add( 1 ) >> 32;
+        std::atomic_thread_fence( std::memory_order_seq_cst );
+        return key;
+    }
+
+    void cancel_wait()
+    {
+        state.fetch_sub( 1 );
+    }
+
+    // Sleep until the epoch moves past key.
+    //
+    void commit_wait(key_type key)
+    {
+        {
+            frame_lock _lock( mtx );
+            cv.wait( _lock, [&]{ return ( state.load() >> 32 ) != key; } );
+        }
+        state.fetch_sub( 1 );
+    }
+
+    // Sleep until the epoch moves past key or the deadline passes.
+    //
+    //  returns false if the deadline passed without a notify.
+    //
+    bool commit_wait(key_type key, clock::time_point deadline)
+    {
+        bool notified = false;
+        {
+            frame_lock _lock( mtx );
+            notified = cv.wait_until( _lock, deadline, [&]{ return ( state.load() >> 32 ) != key; } );
+        }
+        state.fetch_sub( 1 );
+        return notified;
+    }
+
+    void notify_one()
+    {
+        wake( false );
+    }
+
+    void notify_all()
+    {
+        wake( true );
+    }
+
+    // Keep trying attempt() until it returns something "truthy" or the timeout expires.
+    // The thread only sleeps after attempt() has failed with a wait prepared, so a notify
+    // that happens anywhere after the first failure will not be lost.
+    //
+    //  returns the last result of attempt().
+    //
+    template<typename F, typename Rep, typename Period>
+    auto await(F attempt, const std::chrono::duration<Rep,Period>& timeout) -> decltype( attempt() )
+    {
+        clock::time_point deadline = clock::now() + std::chrono::duration_cast<clock::duration>( timeout );
+
+        for(;;)
+        {
+            auto ret = attempt();
+
+            if( ret )
+            {
+                return ret;
+            }
+
+            key_type key = prepare_wait();
+
+            ret = attempt();
+
+            if( ret )
+            {
+                cancel_wait();
+                return ret;
+            }
+
+            if( !commit_wait( key, deadline ) )
+            {
+                return attempt();
+            }
+        }
+    }
+};
+
+
+
 //---------------------------------------------------------------------------------------------------------------------
 //
 //
@@ -100,7 +259,7 @@ template<typename QItem,size_t load = 100>
 class WorkThread
 {
 private:
-    using mutex         = spin_mutex;
+    using mutex         = profiled_lock<adaptive_mutex>;
     using thread_method = object_method_delegate<WorkThread,void>;
     using frame_lock    = std::lock_guard<mutex>;
     using work_queue    = std::queue<QItem>;
@@ -112,10 +271,11 @@ private:
     std::atomic_size_t  pending;
     std::thread         thread;
     work_method         method;
+    std::promise<RC>    started;
 
     // The following values must be accessed while owning data_lock
     //
-    mutex               data_lock;
+    mutex               data_lock{ EE5_LOCK_SITE( "WorkThread::data_lock" ) };
     work_queue          queue;
     bool                quit    = false;
     bool                abandon = false;
@@ -124,6 +284,21 @@ private:
     {
         set_id(user_id);
 
+        // Work items run between the quiescent states of this loop, so the work thread is a
+        // reader in the global epoch domain for free. A thread that can't get in would run the
+        // work unprotected, Startup fails instead.
+        //
+        epoch_domain&   epochs  = epoch_domain::global();
+        epoch_thread    participant( epochs );
+
+        started.set_value( participant.status() );
+
+        if( participant.status() != s_ok() )
+        {
+            framed_lock( data_lock, [this] { quit = true; } );
+            return;
+        }
+
         work_array  pending_work;
         bool        running = true;
 
@@ -163,6 +338,10 @@ private:
         //
         while( running )
         {
+            // Nothing from the last batch of work is still being looked at.
+            //
+            epochs.quiescent();
+
             // The side effect of this framed_lock is that running, queue,
             // and pending can all be modified. The frame lock keeps other
             // threads from fiddling with the values.
@@ -188,9 +367,12 @@ private:
             }
             else if( running )
             {
-                // Stall the thread until a signal wakes us up
+                // Stall the thread until a signal wakes us up. (Don't hold up
+                // reclamation while asleep.)
                 //
+                epochs.offline();
                 sig.wait();
+                epochs.online();
             }
         }
 
@@ -223,8 +405,18 @@ public:
 
     RC Startup()
     {
+        auto joined = started.get_future();
+
         thread = std::thread( thread_method( this, &WorkThread::Thread ) );
-        return s_ok();
+
+        RC rc = joined.get();
+
+        if( rc != s_ok() )
+        {
+            thread.join();
+        }
+
+        return rc;
     }
 
     void Shutdown()
@@ -248,7 +440,7 @@ public:
         // Wake up the thread.
         sig.set();
 
-        if( join )
+        if( join && thread.joinable() )
         {
             thread.join();
         }
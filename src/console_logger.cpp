@@ -14,13 +14,34 @@
 //
 #include "console_logger.h"
 #include "workthread.h"
+#include <algorithm>
 #include <cstdarg>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <new>
 
 BNS( ee5 )
 
+size_t work_thread_id();
+
 const size_t LogLine::msg_offset = offsetof(LogLine,msg);
 
-ConsoleLogger::thread_ptr ConsoleLogger::pThread;
+std::atomic<ConsoleLogger::staging*>    ConsoleLogger::stagings( nullptr );
+atomic_stack<LogLine>                   ConsoleLogger::overflow;
+eventcount                              ConsoleLogger::wake;
+std::atomic_bool                        ConsoleLogger::stopping( false );
+std::thread                             ConsoleLogger::logger;
+adaptive_mutex                          ConsoleLogger::write_lock;
+std::unique_ptr<log_sink>               ConsoleLogger::sink;
+std::atomic<uint64_t>                   ConsoleLogger::idle_passes( 0 );
+binary_renderer::style                  ConsoleLogger::binary_style( binary_renderer::hex );
+log_record::style                       ConsoleLogger::record_style( log_record::json );
+#ifdef _MSC_VER
+log_timestamp                           ConsoleLogger::stamp( log_timestamp::iso_milli );
+#else
+log_timestamp                           ConsoleLogger::stamp( log_timestamp::iso_micro );
+#endif
 
 //---------------------------------------------------------------------------------------------------------------------
 //
@@ -36,7 +57,9 @@ RC cb_vsnprintf(size_t c,char* p,size_t* pc,char** ppP,const char* fmt,va_list v
 #ifdef _MSC_VER
 #pragma warning(default: 4996)
 #endif
-    if( i < 0 || static_cast<size_t>(i) > c )
+    // i doesn't count the terminator, so i == c was cut short too.
+    //
+    if( i < 0 || static_cast<size_t>(i) >= c )
     {
         return e_overflow();
     }
@@ -49,37 +72,872 @@ RC cb_vsnprintf(size_t c,char* p,size_t* pc,char** ppP,const char* fmt,va_list v
 
 LogLine::mem_pool_t LogLine::mem;
 
+std::atomic<LogLine::overflow_policy>   LogLine::overflow( LogLine::overflow_block );
+std::atomic<uint32_t>                   LogLine::overflow_wait_ms( 100 );
+std::atomic_size_t                      LogLine::dropped( 0 );
+
+namespace
+{
+    // overflow_block waiters sleep on released, which moves whenever a buffer comes back while
+    // somebody is waiting.
+    //
+    std::atomic<uint32_t> released( 0 );
+    std::atomic<uint32_t> waiters( 0 );
+
+    void* wait_for_buffer(LogLine::mem_pool_t& mem,std::chrono::milliseconds wait)
+    {
+        using clock = std::chrono::steady_clock;
+
+        clock::time_point   deadline    = clock::now() + wait;
+        void*               p           = nullptr;
+
+        waiters.fetch_add( 1 );
+
+        for(;;)
+        {
+            uint32_t generation = released.load();
+
+            if( ( p = mem.acquire() ) != nullptr )
+            {
+                break;
+            }
+
+            clock::time_point now = clock::now();
+
+            if( now >= deadline )
+            {
+                break;
+            }
+
+            futex_wait_for( released, generation, deadline - now );
+        }
+
+        waiters.fetch_sub( 1 );
+
+        return p;
+    }
+}
+
+
+
 //---------------------------------------------------------------------------------------------------------------------
 //
 //
 //
 //
-size_t work_thread_id();
+LogLine* LogLine::acquire(bool count_drop)
+{
+    void* p = mem.acquire();
+
+    if( p )
+    {
+        LogLine* l = static_cast<LogLine*>( p );
+
+        l->kind = text;
+        return l;
+    }
+
+    switch( overflow.load( std::memory_order_relaxed ) )
+    {
+    case overflow_block:
+        p = wait_for_buffer( mem, std::chrono::milliseconds( overflow_wait_ms.load( std::memory_order_relaxed ) ) );
+        break;
+
+    case overflow_grow:
+        p = std::calloc( 1, mem_pool_t::max_item_size );
+        break;
+
+    case overflow_write:
+        return nullptr;     // Not dropped, the caller writes it
+
+    default:
+        break;
+    }
+
+    if( p == nullptr )
+    {
+        if( count_drop )
+        {
+            dropped.fetch_add( 1, std::memory_order_relaxed );
+        }
+        return nullptr;
+    }
+
+    LogLine* l = static_cast<LogLine*>( p );
+
+    l->kind = text;
+    return l;
+}
+
+
+
+//---------------------------------------------------------------------------------------------------------------------
+//
+//  The fence keeps the waiters check from moving above the push back into the pool. (pairs
+//  with the seq_cst increment in wait_for_buffer)
+//
+void LogLine::release(LogLine* l)
+{
+    if( l->kind == binary )
+    {
+        binary_header header;
+
+        std::memcpy( &header, l->msg, sizeof( header ) );
+
+        for( LogLine* more = header.chain; more; )
+        {
+            LogLine* next = more->next;
+            release( more );
+            more = next;
+        }
+    }
+
+    if( !mem.release( l ) )
+    {
+        std::free( l );
+        return;
+    }
+
+    std::atomic_thread_fence( std::memory_order_seq_cst );
+
+    if( waiters.load( std::memory_order_relaxed ) )
+    {
+        released.fetch_add( 1 );
+        futex_wake( released, INT32_MAX );
+    }
+}
+
+
+
+void LogLine::line_deleter::operator()(LogLine* l)
+{
+    LogLine::release( l );
+}
+
+
+
+//---------------------------------------------------------------------------------------------------------------------
+//
+//  The calling thread's ring. The first call on a thread adopts the ring of a thread that has
+//  exited, or adds a new one.
+//
+ConsoleLogger::staging* ConsoleLogger::local()
+{
+    static ee5_thread_local staging_owner owner;
+
+    if( owner.s )
+    {
+        return owner.s;
+    }
+
+    for( staging* s = stagings.load( std::memory_order_acquire ); s; s = s->next )
+    {
+        bool expected = false;
+
+        if( !s->owned.load( std::memory_order_relaxed ) && s->owned.compare_exchange_strong( expected, true, std::memory_order_acquire ) )
+        {
+            owner.s = s;
+            return s;
+        }
+    }
+
+    // The ring is cache line aligned. (The memory is never released.)
+    //
+    char*       raw = new char[ sizeof( staging ) + CACHE_ALIGN ];
+    staging*    s   = new ( raw + CACHE_ALIGN - reinterpret_cast<uintptr_t>( raw ) % CACHE_ALIGN ) staging();
+
+    s->owned.store( true, std::memory_order_relaxed );
+    s->next = stagings.load( std::memory_order_relaxed );
+
+    while( !stagings.compare_exchange_weak( s->next, s, std::memory_order_release, std::memory_order_relaxed ) )
+    {
+    }
+
+    owner.s = s;
+    return s;
+}
+
+
+
+//---------------------------------------------------------------------------------------------------------------------
+//
+//  A line from the shared pool. (The thread's ring was full.)
+//
+void ConsoleLogger::post(LogLine* line)
+{
+    overflow.push( line );
+    wake.notify_one();
+}
+
+
+
+//---------------------------------------------------------------------------------------------------------------------
+//
+//
+//
+//
+bool ConsoleLogger::pending()
+{
+    if( !overflow.empty() )
+    {
+        return true;
+    }
+
+    for( staging* s = stagings.load( std::memory_order_acquire ); s; s = s->next )
+    {
+        if( !s->ring.empty() )
+        {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+
+
+//---------------------------------------------------------------------------------------------------------------------
+//
+//  Write out everything that is waiting, oldest line first. Each ring is already in order, so
+//  the next line is always the oldest of the lines at the front of the rings (and the front of
+//  the overflow list).
+//
+size_t ConsoleLogger::drain()
+{
+    // The overflow stack comes off newest first.
+    //
+    LogLine* spilled = nullptr;
+
+    for( LogLine* l = overflow.pop_all(); l; )
+    {
+        LogLine* next = l->next;
+        l->next = spilled;
+        spilled = l;
+        l = next;
+    }
+
+    size_t written = 0;
+
+    for(;;)
+    {
+        LogLine* oldest = spilled;
+        staging* from   = nullptr;
+
+        for( staging* s = stagings.load( std::memory_order_acquire ); s; s = s->next )
+        {
+            LogLine* l = static_cast<LogLine*>( s->ring.peek() );
+
+            if( l && ( oldest == nullptr || l->time < oldest->time ) )
+            {
+                oldest  = l;
+                from    = s;
+            }
+        }
+
+        if( oldest == nullptr )
+        {
+            break;
+        }
+
+        write( oldest );
+        ++written;
+
+        if( from )
+        {
+            from->ring.release_record();
+        }
+        else
+        {
+            spilled = spilled->next;
+            LogLine::release( oldest );
+        }
+    }
+
+    report_dropped();
+
+    return written;
+}
+
+
+
+//---------------------------------------------------------------------------------------------------------------------
+//
+//  The logger thread and overflow_write callers take turns. The sink may block on I/O with
+//  the lock held, so the lock parks its waiters rather than spinning them.
+//
+void ConsoleLogger::write(const LogLine* line)
+{
+    std::lock_guard<adaptive_mutex> hold( write_lock );
+
+    Doit( line );
+}
+
+
+
+//---------------------------------------------------------------------------------------------------------------------
+//
+//  The line is formatted here and handed to the sink, which decides when it hits the file.
+//
+void ConsoleLogger::Doit(const LogLine* pLL)
+{
+    char        when[log_timestamp::max_size];
+    const char* msg = pLL->msg;
+    char        text[LogLine::mem_pool_t::max_item_size];
+    char        line[LogLine::mem_pool_t::max_item_size + 512];
+
+    LogLine::binary_header  header;
+
+    stamp.render( when, pLL->time );
+
+    // A LOG_RECORD is a record, not a line.
+    //
+    if( pLL->kind == LogLine::deferred && pLL->info->fields )
+    {
+        char    record[log_record::max_size];
+        size_t  cb;
+
+        if( record_style == log_record::binary )
+        {
+            int64_t ns = c::duration_cast<c::nanoseconds>( pLL->time.time_since_epoch() ).count();
+
+            cb = log_record::render_binary( record, sizeof( record ), pLL->info, ns, pLL->id, pLL->msg, pLL->cb_msg );
+        }
+        else
+        {
+            cb = log_record::render_json( record, sizeof( record ), pLL->info, when, pLL->id, pLL->msg, pLL->cb_msg );
+        }
+
+        sink->write( record, cb );
+        return;
+    }
+
+    if( pLL->kind == LogLine::deferred )
+    {
+        log_args::format( text, sizeof( text ), pLL->info->format, pLL->msg, pLL->cb_msg );
+        msg = text;
+    }
+    else if( pLL->kind == LogLine::binary )
+    {
+        std::memcpy( &header, pLL->msg, sizeof( header ) );
+
+        log_args::format( text, sizeof( text ), pLL->info->format, pLL->msg + sizeof( header ), header.cb_args );
+        msg = text;
+    }
+
+#ifdef _MSC_VER
+#pragma warning(disable: 4996)
+#else
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wformat"
+#endif
+    int cb = snprintf( line, sizeof( line ), "[%s]|%s|:%lx %s %s\n", when, pLL->info->facility, pLL->id, pLL->info->function, msg );
+#ifdef _MSC_VER
+#pragma warning(default: 4996)
+#else
+#pragma GCC diagnostic pop
+#endif
+
+    if( cb < 0 )
+    {
+        return;
+    }
+
+    // Cut short, but still a line.
+    //
+    if( static_cast<size_t>( cb ) >= sizeof( line ) )
+    {
+        cb = sizeof( line ) - 1;
+        line[cb - 1] = '\n';
+    }
+
+    sink->write( line, cb );
+
+    if( pLL->kind == LogLine::binary )
+    {
+        binary_renderer dump( binary_style, [](const char* row,size_t cb_row,void*) { sink->write( row, cb_row ); }, nullptr );
+
+        dump.add( pLL->msg + sizeof( header ) + header.cb_args, header.cb_here );
+
+        for( const LogLine* more = header.chain; more; more = more->next )
+        {
+            dump.add( more->msg, more->cb_msg );
+        }
+
+        dump.finish();
+
+        if( header.cb_captured < header.cb_payload )
+        {
+            cb = snprintf( line, sizeof( line ), "    (%llu of %llu bytes, the log buffers ran out)\n",
+                           static_cast<unsigned long long>( header.cb_captured ),
+                           static_cast<unsigned long long>( header.cb_payload ) );
+            sink->write( line, cb );
+        }
+    }
+}
+
+
+
+//---------------------------------------------------------------------------------------------------------------------
+//
+//
+//
+//
+void ConsoleLogger::SetTimestamp(log_timestamp::style s)
+{
+    std::lock_guard<adaptive_mutex> hold( write_lock );
+
+    stamp.set_style( s );
+}
+
+
+
+//---------------------------------------------------------------------------------------------------------------------
+//
+//
+//
+//
+void ConsoleLogger::SetBinaryStyle(binary_renderer::style s)
+{
+    std::lock_guard<adaptive_mutex> hold( write_lock );
+
+    binary_style = s;
+}
+
+
+
+//---------------------------------------------------------------------------------------------------------------------
+//
+//
+//
+//
+void ConsoleLogger::SetRecordStyle(log_record::style s)
+{
+    std::lock_guard<adaptive_mutex> hold( write_lock );
+
+    record_style = s;
+}
+
+
+
+//---------------------------------------------------------------------------------------------------------------------
+//
+//
+//
+//
+void ConsoleLogger::flush_sink()
+{
+    std::lock_guard<adaptive_mutex> hold( write_lock );
+
+    if( sink )
+    {
+        sink->flush();
+    }
+}
+
+
+
+//---------------------------------------------------------------------------------------------------------------------
+//
+//
+//
+//
+RC ConsoleLogger::SetSink(log_sink* s)
+{
+    CBREx( s != nullptr, e_invalid_argument( 1, "a sink is required" ) );
+
+    std::unique_ptr<log_sink> old;
+    {
+        std::lock_guard<adaptive_mutex> hold( write_lock );
+
+        if( sink )
+        {
+            sink->flush();
+        }
+
+        old = std::move( sink );
+        sink.reset( s );
+    }
+
+    return s_ok();
+}
+
+
+
+//---------------------------------------------------------------------------------------------------------------------
+//
+//  Two idle passes after the call. The first one may have started before the lines were
+//  posted, the second one can't have.
+//
+void ConsoleLogger::Flush()
+{
+    uint64_t passes = idle_passes.load( std::memory_order_acquire );
+
+    while( logger.joinable() && !stopping.load() && idle_passes.load( std::memory_order_acquire ) < passes + 2 )
+    {
+        wake.notify_one();
+        std::this_thread::yield();
+    }
+
+    flush_sink();
+}
+
+
+
+//---------------------------------------------------------------------------------------------------------------------
+//
+//  Lines lost to an empty pool show up in the log as a count.
+//
+void ConsoleLogger::report_dropped()
+{
+    static const __info dropped_info = { 0, "ConsoleLogger", LOG_FACILITY, __FILE__, " - // %zu log lines dropped, the log buffers were exhausted", nullptr, __LINE__, log_zone_all, level_always, {}, {}, nullptr };
+
+    size_t lost = LogLine::dropped.exchange( 0, std::memory_order_relaxed );
+
+    if( lost == 0 )
+    {
+        return;
+    }
+
+    line_storage    storage;
+    LogLine*        l = reinterpret_cast<LogLine*>( &storage );
+
+    l->time     = hrc_t::now();
+    l->id       = work_thread_id();
+    l->info     = &dropped_info;
+    l->kind     = LogLine::text;
+    l->next     = nullptr;
+    l->cb_msg   = std::snprintf( l->msg, sizeof( storage ) - LogLine::msg_offset, dropped_info.format, lost );
+
+    write( l );
+}
+
+
+
+//---------------------------------------------------------------------------------------------------------------------
+//
+//  A line for each rate limited site that turned lines away, at most once a second unless
+//  now is set.
+//
+void ConsoleLogger::report_suppressed(bool now)
+{
+    static const __info suppressed_info = { 0, "ConsoleLogger", LOG_FACILITY, __FILE__, " - // %llu log lines suppressed at %s:%zu (%s)", nullptr, __LINE__, log_zone_all, level_always, {}, {}, nullptr };
+    static hrc_t::time_point last;
+
+    if( !now && hrc_t::now() - last < c::seconds( 1 ) )
+    {
+        return;
+    }
+
+    last = hrc_t::now();
+
+    log_take_suppressed( [](const __info* site,uint64_t suppressed,void*)
+    {
+        line_storage    storage;
+        LogLine*        l = reinterpret_cast<LogLine*>( &storage );
+
+        l->time     = hrc_t::now();
+        l->id       = work_thread_id();
+        l->info     = &suppressed_info;
+        l->kind     = LogLine::text;
+        l->next     = nullptr;
+        l->cb_msg   = std::snprintf( l->msg, sizeof( storage ) - LogLine::msg_offset, suppressed_info.format, static_cast<unsigned long long>( suppressed ), site->file, site->line, site->function );
+
+        write( l );
+    }, nullptr );
+}
+
+
+
+//---------------------------------------------------------------------------------------------------------------------
+//
+//  The logger thread.
+//
+void ConsoleLogger::run()
+{
+    for(;;)
+    {
+        if( drain() )
+        {
+            continue;
+        }
+
+        // Nothing left for now, whatever the sink is holding on to goes out.
+        //
+        report_suppressed( stopping.load() );
+        flush_sink();
+        idle_passes.fetch_add( 1, std::memory_order_release );
+
+        if( stopping.load() )
+        {
+            break;
+        }
+
+        auto key = wake.prepare_wait();
+
+        if( pending() || stopping.load() )
+        {
+            wake.cancel_wait();
+        }
+        else
+        {
+            wake.commit_wait( key );
+        }
+    }
+}
+
+
+
+//---------------------------------------------------------------------------------------------------------------------
+//
+//  Room for a line of cb_record bytes (header included). The thread's ring first, then the
+//  shared pool, then (overflow_write) the caller's stack. nullptr if the line is dropped.
+//
+LogLine* ConsoleLogger::claim(staging* s,const __info* i,size_t cb_record,LogLinePtr& pooled,line_storage& on_stack)
+{
+    LogLine* l = static_cast<LogLine*>( s->ring.reserve( cb_record ) );
+
+    if( l == nullptr )
+    {
+        if( LogLine::create_buffer( LogLine::mem_pool_t::max_item_size, pooled ) == s_ok() )
+        {
+            l = pooled.get();
+        }
+        else if( LogLine::overflow.load( std::memory_order_relaxed ) == LogLine::overflow_write )
+        {
+            l = reinterpret_cast<LogLine*>( &on_stack );
+        }
+        else
+        {
+            return nullptr;
+        }
+    }
+
+    l->time     = hrc_t::now();
+    l->id       = work_thread_id();
+    l->info     = i;
+    l->next     = nullptr;
+
+    return l;
+}
+
+
+
+//---------------------------------------------------------------------------------------------------------------------
+//
+//  Hand a claimed line to the logger thread (or write it, if it is on the stack).
+//
+void ConsoleLogger::publish(staging* s,LogLine* l,LogLinePtr& pooled,line_storage& on_stack,size_t cb_record)
+{
+    if( pooled )
+    {
+        Enqueue( std::move(pooled) );
+    }
+    else if( l == reinterpret_cast<LogLine*>( &on_stack ) )
+    {
+        write( l );
+    }
+    else
+    {
+        s->ring.commit( cb_record );
+        wake.notify_one();
+    }
+}
+
+
+
+//---------------------------------------------------------------------------------------------------------------------
+//
+//  The line is formatted straight into the thread's ring. Only if the ring is full does it go
+//  through the shared pool.
+//
 void ConsoleLogger::console_log(const __info* i,...)
 {
-    RC      rc  = s_ok();
-    size_t  c   = 0;
-    char*   p   = nullptr;
+    const size_t    max = LogLine::mem_pool_t::max_item_size;
+    staging*        s   = local();
+    LogLinePtr      pLogLine;
+    line_storage    on_stack;
+    LogLine*        l   = claim( s, i, max, pLogLine, on_stack );
+
+    if( l == nullptr )
+    {
+        return;
+    }
+
+    l->kind = LogLine::text;
+
+    size_t  c = max - LogLine::msg_offset;
+    char*   p = l->msg;
 
     va_list arg_list;
     va_start(arg_list, i);
 
-    LogLinePtr pLogLine;
+    // A line that is too long is cut short.
+    //
+    l->cb_msg = cb_vsnprintf( c, p, &c, &p, i->format, arg_list ) == s_ok() ? p - l->msg : max - LogLine::msg_offset - 1;
+
+    va_end(arg_list);
+
+    publish( s, l, pLogLine, on_stack, LogLine::msg_offset + l->cb_msg + 1 );
+}
+
+
+
+//---------------------------------------------------------------------------------------------------------------------
+//
+//  A line somebody else already formatted. (MappedLogRing's tee)
+//
+void ConsoleLogger::Write(const __info* i,const char* msg,size_t cb)
+{
+    cb = std::min( cb, LogLine::mem_pool_t::max_item_size - LogLine::msg_offset - 1 );
 
-    rc = LogLine::create_buffer( LogLine::mem_pool_t::max_item_size, pLogLine,&c, &p );
+    staging*        s   = local();
+    LogLinePtr      pLogLine;
+    line_storage    on_stack;
+    LogLine*        l   = claim( s, i, LogLine::msg_offset + cb + 1, pLogLine, on_stack );
 
-    if( rc == s_ok() )
+    if( l == nullptr )
     {
-        pLogLine->time  = hrc_t::now();
-        pLogLine->id    = work_thread_id();
-        pLogLine->info  = i;
+        return;
+    }
+
+    l->kind     = LogLine::text;
+    l->cb_msg   = cb;
 
-        rc = cb_vsnprintf(c, p, &c, &p, i->format, arg_list );
+    std::memcpy( l->msg, msg, cb );
+    l->msg[cb] = 0;
 
-        if( rc == s_ok() )
+    publish( s, l, pLogLine, on_stack, LogLine::msg_offset + cb + 1 );
+}
+
+
+
+//---------------------------------------------------------------------------------------------------------------------
+//
+//  No formatting here, the arguments are copied and the logger thread applies the format.
+//
+void ConsoleLogger::console_log_deferred(const __info* i,const void* args,size_t cb)
+{
+    cb = std::min( cb, LogLine::mem_pool_t::max_item_size - LogLine::msg_offset );
+
+    staging*        s   = local();
+    LogLinePtr      pLogLine;
+    line_storage    on_stack;
+    LogLine*        l   = claim( s, i, LogLine::msg_offset + cb, pLogLine, on_stack );
+
+    if( l == nullptr )
+    {
+        return;
+    }
+
+    l->kind     = LogLine::deferred;
+    l->cb_msg   = cb;
+
+    std::memcpy( l->msg, args, cb );
+
+    publish( s, l, pLogLine, on_stack, LogLine::msg_offset + cb );
+}
+
+
+
+//---------------------------------------------------------------------------------------------------------------------
+//
+//  The whole thing goes in the thread's ring if it fits (a record can be up to half of the
+//  ring). Otherwise the payload is spread over a chain of pool buffers, as many as it takes.
+//  If the pool runs dry part way the line says how much of the payload made it. (That's a
+//  short line, not a dropped one.) With overflow_write and no buffer at all, the first part
+//  is written from the caller's stack.
+//
+void ConsoleLogger::console_log_binary(const __info* i,const void* payload,size_t cb_payload,const void* args,size_t cb_args)
+{
+    const size_t    max     = LogLine::mem_pool_t::max_item_size;
+    const size_t    fixed   = LogLine::msg_offset + sizeof( LogLine::binary_header );
+    const uint8_t*  p       = static_cast<const uint8_t*>( payload );
+
+    cb_args = std::min( cb_args, max - fixed );
+
+    LogLine::binary_header  header  = { nullptr, cb_payload, cb_payload, static_cast<uint32_t>( cb_args ), 0 };
+    staging*                s       = local();
+    LogLine*                l       = static_cast<LogLine*>( s->ring.reserve( fixed + cb_args + cb_payload ) );
+    LogLinePtr              pLogLine;
+    line_storage            on_stack;
+
+    if( l )
+    {
+        header.cb_here = static_cast<uint32_t>( cb_payload );
+    }
+    else
+    {
+        if( LogLine::create_buffer( max, pLogLine ) == s_ok() )
         {
-            rc = Enqueue( std::move(pLogLine) );
+            l = pLogLine.get();
         }
+        else if( LogLine::overflow.load( std::memory_order_relaxed ) == LogLine::overflow_write )
+        {
+            l = reinterpret_cast<LogLine*>( &on_stack );
+        }
+        else
+        {
+            return;
+        }
+
+        header.cb_here = static_cast<uint32_t>( std::min( cb_payload, max - fixed - cb_args ) );
+    }
+
+    l->time     = hrc_t::now();
+    l->id       = work_thread_id();
+    l->info     = i;
+    l->kind     = LogLine::binary;
+    l->next     = nullptr;
+    l->cb_msg   = sizeof( header ) + cb_args + header.cb_here;
+
+    std::memcpy( l->msg + sizeof( header ), args, cb_args );
+    std::memcpy( l->msg + sizeof( header ) + cb_args, p, header.cb_here );
+
+    size_t      done = header.cb_here;
+    LogLine**   link = &header.chain;
+
+    while( done < cb_payload )
+    {
+        LogLine* more = LogLine::acquire( false );
+
+        if( more == nullptr )
+        {
+            header.cb_captured = done;
+            break;
+        }
+
+        more->kind      = LogLine::binary_more;
+        more->next      = nullptr;
+        more->cb_msg    = std::min( cb_payload - done, max - LogLine::msg_offset );
+
+        std::memcpy( more->msg, p + done, more->cb_msg );
+
+        done   += more->cb_msg;
+        *link   = more;
+        link    = &more->next;
+    }
+
+    std::memcpy( l->msg, &header, sizeof( header ) );
+
+    if( pLogLine )
+    {
+        Enqueue( std::move(pLogLine) );
+    }
+    else if( l == reinterpret_cast<LogLine*>( &on_stack ) )
+    {
+        write( l );
+
+        for( LogLine* more = header.chain; more; )
+        {
+            LogLine* next = more->next;
+            LogLine::release( more );
+            more = next;
+        }
+    }
+    else
+    {
+        s->ring.commit( LogLine::msg_offset + l->cb_msg );
+        wake.notify_one();
     }
 }
 
@@ -0,0 +1,546 @@
+//-------------------------------------------------------------------------------------------------
+// Copyright (C) 2014 Ernest R. Ewert
+//
+// Feel free to use this as you see fit.
+// I ask that you keep my name with the code.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+// MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+// IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+// OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+// ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+// OTHER DEALINGS IN THE SOFTWARE.
+//
+#include <ee5>
+
+#include "epoch.h"
+
+#include <algorithm>
+#include <cstring>
+#include <mutex>
+#include <new>
+#include <type_traits>
+
+BNS( ee5 )
+
+namespace
+{
+    // The domains the calling thread participates in. Almost always just the global one.
+    //
+    struct membership
+    {
+        epoch_domain*   domain;
+        void*           record;
+    };
+
+    const size_t max_memberships = 4;
+
+    ee5_thread_local membership joined[max_memberships];
+}
+
+
+
+//---------------------------------------------------------------------------------------------------------------------
+//
+//
+//
+//
+epoch_domain::block::block() : high_water( 0 ), next( nullptr )
+{
+    for( auto& r : records )
+    {
+        r.epoch.store( offline_epoch, relaxed );
+        r.used.store( false, relaxed );
+        r.ticks = 0;
+    }
+}
+
+
+
+//---------------------------------------------------------------------------------------------------------------------
+//
+//  Before C++17 operator new only promises alignof( max_align_t ), so the block is lined up on
+//  the cache line by hand. The pointer new returned is kept just in front of the block.
+//
+void* epoch_domain::block::operator new(size_t cb)
+{
+    char* raw   = static_cast<char*>( ::operator new( cb + CACHE_ALIGN + sizeof( void* ) ) );
+    char* p     = raw + sizeof( void* );
+
+    p += ( CACHE_ALIGN - reinterpret_cast<uintptr_t>( p ) % CACHE_ALIGN ) % CACHE_ALIGN;
+    std::memcpy( p - sizeof( void* ), &raw, sizeof( raw ) );
+
+    return p;
+}
+
+void epoch_domain::block::operator delete(void* p)
+{
+    void* raw;
+
+    std::memcpy( &raw, static_cast<char*>( p ) - sizeof( void* ), sizeof( raw ) );
+    ::operator delete( raw );
+}
+
+
+
+//---------------------------------------------------------------------------------------------------------------------
+//
+//
+//
+//
+epoch_domain::epoch_domain() : global_epoch( 1 ), orphaned( false )
+{
+}
+
+
+
+//---------------------------------------------------------------------------------------------------------------------
+//
+//  Nobody can be reading anymore, free what is left. (The deleters must still be valid.)
+//
+epoch_domain::~epoch_domain()
+{
+    reclaim( orphans, UINT64_MAX );
+
+    for( block* b = &first; b; )
+    {
+        block* next = b->next.load( acquire );
+
+        for( auto& r : b->records )
+        {
+            reclaim( r.limbo, UINT64_MAX );
+        }
+
+        if( b != &first )
+        {
+            delete b;
+        }
+        b = next;
+    }
+}
+
+
+
+//---------------------------------------------------------------------------------------------------------------------
+//
+//  Never destroyed. Pools and other statics the deleters release into may be gone by the time
+//  a static domain would be torn down.
+//
+epoch_domain& epoch_domain::global()
+{
+    static std::aligned_storage<sizeof( epoch_domain ),alignof( epoch_domain )>::type storage;
+    static epoch_domain* domain = new ( &storage ) epoch_domain();
+
+    return *domain;
+}
+
+
+
+//---------------------------------------------------------------------------------------------------------------------
+//
+//
+//
+//
+epoch_domain::record* epoch_domain::self()
+{
+    for( auto& m : joined )
+    {
+        if( m.domain == this )
+        {
+            return static_cast<record*>( m.record );
+        }
+    }
+
+    return nullptr;
+}
+
+
+
+//---------------------------------------------------------------------------------------------------------------------
+//
+//
+//
+//
+bool epoch_domain::participating()
+{
+    return self() != nullptr;
+}
+
+
+
+//---------------------------------------------------------------------------------------------------------------------
+//
+//
+//
+//
+RC epoch_domain::enter()
+{
+    if( self() )
+    {
+        return s_ok();
+    }
+
+    auto slot = std::find_if( std::begin( joined ), std::end( joined ), [](const membership& m) { return m.domain == nullptr; } );
+
+    CBREx( slot != std::end( joined ), e_overflow() );
+
+    for( block* b = &first; ; )
+    {
+        for( size_t i = 0; i < block_records; ++i )
+        {
+            bool expected = false;
+
+            if( b->records[i].used.compare_exchange_strong( expected, true, acquire, relaxed ) )
+            {
+                size_t water = b->high_water.load( relaxed );
+
+                while( water < i + 1 && !b->high_water.compare_exchange_weak( water, i + 1, release, relaxed ) )
+                {
+                }
+
+                slot->domain = this;
+                slot->record = &b->records[i];
+
+                online();
+                return s_ok();
+            }
+        }
+
+        // Every record in the block is taken. Chain on another one, unless someone beat us
+        // to it.
+        //
+        block* next = b->next.load( acquire );
+
+        if( next == nullptr )
+        {
+            block* grown = new block();
+
+            if( b->next.compare_exchange_strong( next, grown, std::memory_order_acq_rel, acquire ) )
+            {
+                next = grown;
+            }
+            else
+            {
+                delete grown;
+            }
+        }
+
+        b = next;
+    }
+}
+
+
+
+//---------------------------------------------------------------------------------------------------------------------
+//
+//
+//
+//
+void epoch_domain::leave()
+{
+    record* r = self();
+
+    if( r == nullptr )
+    {
+        return;
+    }
+
+    offline();
+    reclaim( r );
+
+    if( !r->limbo.empty() )
+    {
+        std::lock_guard<spin_mutex> hold( orphan_lock );
+
+        orphans.insert( orphans.end(), r->limbo.begin(), r->limbo.end() );
+        orphaned.store( true, relaxed );
+    }
+
+    r->limbo.clear();
+    r->ticks = 0;
+    r->used.store( false, release );
+
+    for( auto& m : joined )
+    {
+        if( m.domain == this )
+        {
+            m.domain = nullptr;
+            m.record = nullptr;
+        }
+    }
+}
+
+
+
+//---------------------------------------------------------------------------------------------------------------------
+//
+//
+//
+//
+void epoch_domain::quiescent()
+{
+    record* r = self();
+
+    if( r == nullptr )
+    {
+        return;
+    }
+
+    r->epoch.store( global_epoch.load( acquire ), release );
+
+    if( ( !r->limbo.empty() || orphaned.load( relaxed ) ) && ++r->ticks >= reclaim_interval )
+    {
+        r->ticks = 0;
+        reclaim( r );
+    }
+}
+
+
+
+//---------------------------------------------------------------------------------------------------------------------
+//
+//
+//
+//
+void epoch_domain::offline()
+{
+    record* r = self();
+
+    if( r )
+    {
+        r->epoch.store( offline_epoch, release );
+    }
+}
+
+
+
+//---------------------------------------------------------------------------------------------------------------------
+//
+//  The record has to be visible before this thread reads anything. Otherwise a reclaim pass
+//  could still see the thread as offline after it has picked up a pointer. (pairs with the
+//  fence in oldest)
+//
+void epoch_domain::online()
+{
+    record* r = self();
+
+    if( r )
+    {
+        r->epoch.store( global_epoch.load( acquire ), relaxed );
+        std::atomic_thread_fence( std::memory_order_seq_cst );
+    }
+}
+
+
+
+//---------------------------------------------------------------------------------------------------------------------
+//
+//  The oldest epoch any online participant (other than skip) may still be reading in.
+//
+uint64_t epoch_domain::oldest(const record* skip)
+{
+    std::atomic_thread_fence( std::memory_order_seq_cst );
+
+    uint64_t oldest = global_epoch.load( acquire );
+
+    for( const block* b = &first; b; b = b->next.load( acquire ) )
+    {
+        size_t water = b->high_water.load( acquire );
+
+        for( size_t i = 0; i < water; ++i )
+        {
+            const record& r = b->records[i];
+
+            if( &r != skip && r.used.load( acquire ) )
+            {
+                oldest = std::min( oldest, r.epoch.load( acquire ) );
+            }
+        }
+    }
+
+    return oldest;
+}
+
+
+
+//---------------------------------------------------------------------------------------------------------------------
+//
+//  Free everything in list that every participant has moved past. The deleters run after the
+//  list is updated, so they are free to retire more.
+//
+void epoch_domain::reclaim(limbo_list& list,uint64_t safe)
+{
+    auto split = std::partition( list.begin(), list.end(), [safe](const retired& r) { return r.epoch > safe; } );
+
+    limbo_list done( split, list.end() );
+    list.erase( split, list.end() );
+
+    for( auto& d : done )
+    {
+        d.release( d.item, d.context );
+    }
+}
+
+
+
+//---------------------------------------------------------------------------------------------------------------------
+//
+//
+//
+//
+void epoch_domain::reclaim(record* r)
+{
+    uint64_t safe = oldest( nullptr );
+
+    reclaim( r->limbo, safe );
+    reclaim_orphans( safe );
+}
+
+
+
+//---------------------------------------------------------------------------------------------------------------------
+//
+//  Whoever gets here first takes care of the orphans. Nobody waits for the lock.
+//
+void epoch_domain::reclaim_orphans(uint64_t safe)
+{
+    if( orphan_lock.try_lock() )
+    {
+        limbo_list done;
+
+        if( !orphans.empty() )
+        {
+            auto split = std::partition( orphans.begin(), orphans.end(), [safe](const retired& o) { return o.epoch > safe; } );
+
+            done.assign( split, orphans.end() );
+            orphans.erase( split, orphans.end() );
+        }
+
+        orphaned.store( !orphans.empty(), relaxed );
+        orphan_lock.unlock();
+
+        reclaim( done, UINT64_MAX );
+    }
+}
+
+
+
+//---------------------------------------------------------------------------------------------------------------------
+//
+//  Tagging with a new epoch (an RMW) makes the unlink that came before the retire visible to
+//  every thread that later sees the global epoch at or past the tag.
+//
+void epoch_domain::retire(void* item,deleter release,void* context)
+{
+    uint64_t    tag = global_epoch.fetch_add( 1, std::memory_order_acq_rel ) + 1;
+    record*     r   = self();
+
+    if( r )
+    {
+        r->limbo.push_back( { item, release, context, tag } );
+
+        if( r->limbo.size() >= reclaim_threshold )
+        {
+            reclaim( r );
+        }
+        return;
+    }
+
+    // Not a participant. Free what is already safe, and leave the rest to the participants'
+    // next passes. (Waiting here would tie the caller to the slowest participant.)
+    //
+    bool full;
+    {
+        std::lock_guard<spin_mutex> hold( orphan_lock );
+
+        orphans.push_back( { item, release, context, tag } );
+        orphaned.store( true, relaxed );
+        full = orphans.size() >= reclaim_threshold;
+    }
+
+    if( full )
+    {
+        reclaim_orphans( oldest( nullptr ) );
+    }
+}
+
+
+
+//---------------------------------------------------------------------------------------------------------------------
+//
+//
+//
+//
+void epoch_domain::synchronize()
+{
+    // Every retire so far has a tag at or below the current epoch. (No need to move it, a
+    // participant that has seen this epoch is past all of them.)
+    //
+    record*     r   = self();
+    uint64_t    tag = global_epoch.load( acquire );
+
+    if( r )
+    {
+        r->epoch.store( tag, release );
+    }
+
+    while( oldest( r ) < tag )
+    {
+        std::this_thread::yield();
+    }
+
+    limbo_list done;
+    {
+        std::lock_guard<spin_mutex> hold( orphan_lock );
+
+        done.swap( orphans );
+    }
+
+    if( r )
+    {
+        done.insert( done.end(), r->limbo.begin(), r->limbo.end() );
+        r->limbo.clear();
+    }
+
+    // Everything retired before the tag. (Items retired by other threads in the meantime may
+    // be newer, keep those.)
+    //
+    auto split = std::partition( done.begin(), done.end(), [tag](const retired& d) { return d.epoch > tag; } );
+
+    if( split != done.begin() )
+    {
+        if( r )
+        {
+            r->limbo.insert( r->limbo.end(), done.begin(), split );
+        }
+        else
+        {
+            std::lock_guard<spin_mutex> hold( orphan_lock );
+
+            orphans.insert( orphans.end(), done.begin(), split );
+        }
+        done.erase( done.begin(), split );
+    }
+
+    reclaim( done, UINT64_MAX );
+}
+
+
+
+//---------------------------------------------------------------------------------------------------------------------
+//
+//
+//
+//
+size_t epoch_domain::pending()
+{
+    record* r = self();
+    size_t  n = r ? r->limbo.size() : 0;
+
+    std::lock_guard<spin_mutex> hold( orphan_lock );
+
+    return n + orphans.size();
+}
+
+ENS( ee5 )
@@ -0,0 +1,362 @@
+//-------------------------------------------------------------------------------------------------
+// Copyright (C) 2014 Ernest R. Ewert
+//
+// Feel free to use this as you see fit.
+// I ask that you keep my name with the code.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+// MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+// IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+// OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+// ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+// OTHER DEALINGS IN THE SOFTWARE.
+//
+#include <ee5>
+
+#include "hazard.h"
+
+#include <algorithm>
+#include <array>
+#include <functional>
+#include <new>
+#include <thread>
+#include <type_traits>
+
+BNS( ee5 )
+
+
+
+//---------------------------------------------------------------------------------------------------------------------
+//
+//
+//
+//
+hazard_domain::hazard_domain()
+{
+    for( auto& r : records )
+    {
+        r.owned.store( false, relaxed );
+
+        for( auto& h : r.hazard )
+        {
+            h.store( nullptr, relaxed );
+        }
+
+        r.list  = nullptr;
+        r.count = 0;
+    }
+}
+
+
+
+//---------------------------------------------------------------------------------------------------------------------
+//
+//  Nobody can be reading anymore, free what is left. (The deleters must still be valid.)
+//
+hazard_domain::~hazard_domain()
+{
+    for( auto& r : records )
+    {
+        for( retired* e = r.list; e; )
+        {
+            retired* next = e->next;
+
+            e->release( e->item, e->context );
+            free_entry( e );
+
+            e = next;
+        }
+    }
+}
+
+
+
+//---------------------------------------------------------------------------------------------------------------------
+//
+//  Never destroyed. Pools and other statics the deleters release into may be gone by the time
+//  a static domain would be torn down.
+//
+hazard_domain& hazard_domain::global()
+{
+    static std::aligned_storage<sizeof( hazard_domain ),alignof( hazard_domain )>::type storage;
+    static hazard_domain* domain = new ( &storage ) hazard_domain();
+
+    return *domain;
+}
+
+
+
+//---------------------------------------------------------------------------------------------------------------------
+//
+//  Each thread starts looking at "its" record, which is almost always free unless there are
+//  more threads than records. (A signal handler finds the interrupted thread's record owned
+//  and moves on to the next one.)
+//
+hazard_domain::record* hazard_domain::claim()
+{
+    static ee5_thread_local size_t hint = 0;
+
+    if( hint == 0 )
+    {
+        hint = std::hash<std::thread::id>()( std::this_thread::get_id() ) | 1;
+    }
+
+    for( size_t i = hint;; ++i )
+    {
+        record* r = try_claim( records[ i % records_max ] );
+
+        if( r )
+        {
+            return r;
+        }
+
+        if( ( i - hint ) % records_max == records_max - 1 )
+        {
+            std::this_thread::yield();
+        }
+    }
+}
+
+
+
+//---------------------------------------------------------------------------------------------------------------------
+//
+//
+//
+//
+hazard_domain::record* hazard_domain::try_claim(record& r)
+{
+    if( !r.owned.load( relaxed ) && !r.owned.exchange( true, acquire ) )
+    {
+        return &r;
+    }
+
+    return nullptr;
+}
+
+
+
+//---------------------------------------------------------------------------------------------------------------------
+//
+//
+//
+//
+void hazard_domain::release_record(record* r)
+{
+    for( auto& h : r->hazard )
+    {
+        h.store( nullptr, release );
+    }
+
+    r->owned.store( false, release );
+}
+
+
+
+//---------------------------------------------------------------------------------------------------------------------
+//
+//
+//
+//
+void hazard_domain::retire(record* r,void* item,deleter release,void* context)
+{
+    retired* e = pool.acquire<retired>();
+
+    if( e == nullptr )
+    {
+        // Every entry is waiting in some list. Free what can be freed, and if that isn't
+        // enough go to the heap.
+        //
+        scan( r );
+        scan_idle();
+
+        e = pool.acquire<retired>();
+    }
+
+    if( e != nullptr )
+    {
+        e->heap = false;
+    }
+    else
+    {
+        e       = new retired;
+        e->heap = true;
+    }
+
+    e->item     = item;
+    e->release  = release;
+    e->context  = context;
+    e->next     = r->list;
+
+    r->list = e;
+
+    if( ++r->count >= scan_threshold )
+    {
+        scan( r );
+    }
+}
+
+
+
+//---------------------------------------------------------------------------------------------------------------------
+//
+//  Free every retired item that isn't in a hazard slot. The list is settled before any of the
+//  deleters run, so a deleter is free to retire more.
+//
+void hazard_domain::scan(record* r)
+{
+    std::atomic_thread_fence( std::memory_order_seq_cst );
+
+    std::array<void*,records_max * slots> in_use;
+    size_t used = 0;
+
+    for( auto& rec : records )
+    {
+        for( auto& h : rec.hazard )
+        {
+            void* p = h.load( acquire );
+
+            if( p )
+            {
+                in_use[used++] = p;
+            }
+        }
+    }
+
+    std::sort( in_use.begin(), in_use.begin() + used );
+
+    retired*    keep = nullptr;
+    retired*    done = nullptr;
+
+    r->count = 0;
+
+    for( retired* e = r->list; e; )
+    {
+        retired* next = e->next;
+
+        if( std::binary_search( in_use.begin(), in_use.begin() + used, e->item ) )
+        {
+            e->next = keep;
+            keep = e;
+            ++r->count;
+        }
+        else
+        {
+            e->next = done;
+            done = e;
+        }
+
+        e = next;
+    }
+
+    r->list = keep;
+
+    while( done )
+    {
+        retired* next = done->next;
+
+        done->release( done->item, done->context );
+        free_entry( done );
+
+        done = next;
+    }
+}
+
+
+
+//---------------------------------------------------------------------------------------------------------------------
+//
+//
+//
+//
+void hazard_domain::scan_idle()
+{
+    for( auto& rec : records )
+    {
+        record* r = try_claim( rec );
+
+        if( r )
+        {
+            if( r->list )
+            {
+                scan( r );
+            }
+            release_record( r );
+        }
+    }
+}
+
+
+
+//---------------------------------------------------------------------------------------------------------------------
+//
+//
+//
+//
+void hazard_domain::free_entry(retired* e)
+{
+    if( e->heap )
+    {
+        delete e;
+    }
+    else
+    {
+        pool.release( e );
+    }
+}
+
+
+
+//---------------------------------------------------------------------------------------------------------------------
+//
+//
+//
+//
+void hazard_domain::retire(void* item,deleter release,void* context)
+{
+    record* r = claim();
+
+    retire( r, item, release, context );
+
+    release_record( r );
+}
+
+
+
+//---------------------------------------------------------------------------------------------------------------------
+//
+//
+//
+//
+void hazard_domain::collect()
+{
+    scan_idle();
+}
+
+
+
+//---------------------------------------------------------------------------------------------------------------------
+//
+//
+//
+//
+size_t hazard_domain::pending()
+{
+    size_t n = 0;
+
+    for( auto& rec : records )
+    {
+        record* r = try_claim( rec );
+
+        if( r )
+        {
+            n += r->count;
+            release_record( r );
+        }
+    }
+
+    return n;
+}
+
+ENS( ee5 )
@@ -0,0 +1,169 @@
+//-------------------------------------------------------------------------------------------------
+// Copyright (C) 2014 Ernest R. Ewert
+//
+// Feel free to use this as you see fit.
+// I ask that you keep my name with the code.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+// MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+// IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+// OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+// ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+// OTHER DEALINGS IN THE SOFTWARE.
+//
+#include <ee5>
+
+#include "lock_profile.h"
+
+#ifdef EE5_LOCK_PROFILING
+
+#include "logging.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <vector>
+
+BNS( ee5 )
+
+ee5_thread_local uint64_t lock_profile_spins = 0;
+
+static std::atomic<lock_site*> sites( nullptr );
+
+
+
+//---------------------------------------------------------------------------------------------------------------------
+//
+//
+//
+//
+lock_site::lock_site(const char* n,const char* f,size_t l) :
+    name( n ),
+    file( f ),
+    line( l ),
+    acquired( 0 ),
+    contended( 0 ),
+    spins( 0 ),
+    wait_ns( 0 ),
+    hold_ns( 0 )
+{
+    for( size_t b = 0; b < buckets; ++b )
+    {
+        wait_histogram[b].store( 0, std::memory_order_relaxed );
+        hold_histogram[b].store( 0, std::memory_order_relaxed );
+    }
+
+    // Sites are never removed, so a plain push is all the registry needs.
+    //
+    next = sites.load( std::memory_order_relaxed );
+
+    while( !sites.compare_exchange_weak( next, this, std::memory_order_release, std::memory_order_relaxed ) )
+    {
+    }
+}
+
+
+
+//---------------------------------------------------------------------------------------------------------------------
+//
+//
+//
+//
+lock_site* lock_site::unnamed()
+{
+    static lock_site site( "(unnamed)", "", 0 );
+    return &site;
+}
+
+
+
+//---------------------------------------------------------------------------------------------------------------------
+//
+//  Non empty buckets as "2^n:count" pairs.
+//
+static void render_histogram(char* out,size_t cb,const lock_site::counter* histogram)
+{
+    size_t used = 0;
+
+    out[0] = 0;
+
+    for( size_t b = 0; b < lock_site::buckets && used < cb; ++b )
+    {
+        uint64_t count = histogram[b].load( std::memory_order_relaxed );
+
+        if( count )
+        {
+            int n = snprintf( out + used, cb - used, "%s2^%zu:%llu", used ? " " : "", b, static_cast<unsigned long long>( count ) );
+
+            if( n < 0 )
+            {
+                break;
+            }
+            used += n;
+        }
+    }
+}
+
+
+
+//---------------------------------------------------------------------------------------------------------------------
+//
+//  Ranked by the total time spent waiting, the locks that cost the most come first.
+//
+void lock_profile_report()
+{
+    if( __ee5_log == nullptr )
+    {
+        return;
+    }
+
+    std::vector<lock_site*> ranked;
+
+    for( lock_site* s = sites.load( std::memory_order_acquire ); s; s = s->next )
+    {
+        if( s->acquired.load( std::memory_order_relaxed ) )
+        {
+            ranked.push_back( s );
+        }
+    }
+
+    std::sort( ranked.begin(), ranked.end(), [](const lock_site* a,const lock_site* b)
+    {
+        return a->wait_ns.load( std::memory_order_relaxed ) > b->wait_ns.load( std::memory_order_relaxed );
+    });
+
+    LOG_ALWAYS( "lock profile: %zu locks", ranked.size() );
+
+    char wait[512];
+    char hold[512];
+
+    for( size_t rank = 0; rank < ranked.size(); ++rank )
+    {
+        const lock_site* s = ranked[rank];
+
+        unsigned long long acquired  = s->acquired.load( std::memory_order_relaxed );
+        unsigned long long contended = s->contended.load( std::memory_order_relaxed );
+
+        LOG_ALWAYS( "%2zu %s (%s:%zu) acquired %llu contended %llu (%.2f%%) spins %llu wait %.3f ms hold %.3f ms",
+                    rank + 1,
+                    s->name,
+                    s->file,
+                    s->line,
+                    acquired,
+                    contended,
+                    acquired ? 100.0 * contended / acquired : 0.0,
+                    static_cast<unsigned long long>( s->spins.load( std::memory_order_relaxed ) ),
+                    s->wait_ns.load( std::memory_order_relaxed ) / 1e6,
+                    s->hold_ns.load( std::memory_order_relaxed ) / 1e6 );
+
+        render_histogram( wait, sizeof( wait ), s->wait_histogram );
+        render_histogram( hold, sizeof( hold ), s->hold_histogram );
+
+        LOG_ALWAYS( "   wait ns [%s]", wait );
+        LOG_ALWAYS( "   hold ns [%s]", hold );
+    }
+}
+
+ENS( ee5 )
+
+#endif
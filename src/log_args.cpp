@@ -0,0 +1,360 @@
+//-------------------------------------------------------------------------------------------------
+// Copyright (C) 2014 Ernest R. Ewert
+//
+// Feel free to use this as you see fit.
+// I ask that you keep my name with the code.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+// MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+// IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+// OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+// ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+// OTHER DEALINGS IN THE SOFTWARE.
+//
+#include <ee5>
+
+#include "log_args.h"
+
+#include <cinttypes>
+#include <cstdio>
+
+BNS( ee5 )
+
+namespace
+{
+    // Appends to a fixed buffer the way snprintf does, keeping track of what is left.
+    //
+    struct output
+    {
+        char*   p;
+        size_t  cb;
+        size_t  used;
+
+        template<typename... A>
+        void printf(const char* spec,A... args)
+        {
+            int n = std::snprintf( p + used, cb - used, spec, args... );
+
+            if( n > 0 )
+            {
+                used = std::min( cb - 1, used + n );
+            }
+        }
+
+        void put(const char* s,size_t n)
+        {
+            n = std::min( n, cb - 1 - used );
+            std::memcpy( p + used, s, n );
+            used += n;
+            p[used] = 0;
+        }
+    };
+
+    double as_double(log_args::tag t,uint64_t v)
+    {
+        switch( t )
+        {
+        case log_args::arg_double:  { double d; std::memcpy( &d, &v, sizeof( d ) ); return d; }
+        case log_args::arg_signed:  return static_cast<double>( static_cast<int64_t>( v ) );
+        default:                    return static_cast<double>( v );
+        }
+    }
+
+    uint64_t as_integer(log_args::tag t,uint64_t v)
+    {
+        return t == log_args::arg_double ? static_cast<uint64_t>( static_cast<int64_t>( as_double( t, v ) ) ) : v;
+    }
+}
+
+
+
+//---------------------------------------------------------------------------------------------------------------------
+//
+//  A string is handed back in place (s and cb) with its pointer in value, everything else as
+//  the raw 8 bytes.
+//
+bool log_args::reader::next(tag& t,uint64_t& value,const char*& s,size_t& cb)
+{
+    if( p >= end )
+    {
+        return false;
+    }
+
+    t = static_cast<tag>( *p++ );
+
+    if( t == arg_string )
+    {
+        uint16_t n;
+
+        if( end - p < static_cast<ptrdiff_t>( sizeof( value ) + sizeof( n ) ) )
+        {
+            p = end;
+            return false;
+        }
+
+        std::memcpy( &value, p, sizeof( value ) );
+        p += sizeof( value );
+        std::memcpy( &n, p, sizeof( n ) );
+        p += sizeof( n );
+
+        s   = reinterpret_cast<const char*>( p );
+        cb  = std::min<size_t>( n, end - p );
+        p  += cb;
+        return true;
+    }
+
+    if( end - p < static_cast<ptrdiff_t>( sizeof( value ) ) )
+    {
+        p = end;
+        return false;
+    }
+
+    std::memcpy( &value, p, sizeof( value ) );
+    p += sizeof( value );
+    return true;
+}
+
+
+
+//---------------------------------------------------------------------------------------------------------------------
+//
+//  Each conversion in fmt is handed to snprintf on its own, with the value cast to the type
+//  the length modifier asks for. (There is no portable way to build a va_list.) A * width or
+//  precision takes the next argument and is written into the spec.
+//
+size_t log_args::format(char* out,size_t cb,const char* fmt,const void* args,size_t cb_args)
+{
+    if( cb == 0 )
+    {
+        return 0;
+    }
+
+    reader  in( args, cb_args );
+    output  o   = { out, cb, 0 };
+
+    out[0] = 0;
+
+    while( *fmt )
+    {
+        const char* pct = std::strchr( fmt, '%' );
+
+        if( pct == nullptr )
+        {
+            o.put( fmt, std::strlen( fmt ) );
+            break;
+        }
+
+        o.put( fmt, pct - fmt );
+        fmt = pct + 1;
+
+        if( *fmt == '%' )
+        {
+            o.put( "%", 1 );
+            ++fmt;
+            continue;
+        }
+
+        // %[flags][width][.precision][length]conversion
+        //
+        char        spec[64] = "%";
+        size_t      used     = 1;
+        bool        missing  = false;
+
+        auto append = [&](const char* s,size_t n)
+        {
+            n = std::min( n, sizeof( spec ) - 8 - used );
+            std::memcpy( spec + used, s, n );
+            used += n;
+            spec[used] = 0;
+        };
+
+        auto star = [&]()
+        {
+            log_args::tag   t = log_args::arg_signed;
+            uint64_t        v = 0;
+            const char*     s;
+            size_t          n;
+            char            number[24];
+
+            if( !in.next( t, v, s, n ) || t == log_args::arg_string )
+            {
+                missing = true;
+                v = 0;
+            }
+
+            int c = std::snprintf( number, sizeof( number ), "%d", static_cast<int>( as_integer( t, v ) ) );
+            append( number, c );
+        };
+
+        const char* start = fmt;
+
+        while( *fmt && std::strchr( "-+ #0'", *fmt ) )
+        {
+            ++fmt;
+        }
+        append( start, fmt - start );
+
+        if( *fmt == '*' )
+        {
+            star();
+            ++fmt;
+        }
+        start = fmt;
+        while( *fmt >= '0' && *fmt <= '9' )
+        {
+            ++fmt;
+        }
+        append( start, fmt - start );
+
+        size_t dot_at = 0;
+
+        if( *fmt == '.' )
+        {
+            dot_at = used;
+            append( ".", 1 );
+            ++fmt;
+
+            if( *fmt == '*' )
+            {
+                star();
+                ++fmt;
+            }
+            start = fmt;
+            while( *fmt >= '0' && *fmt <= '9' )
+            {
+                ++fmt;
+            }
+            append( start, fmt - start );
+        }
+
+        // The length modifier is only used to pick the type, the spec gets the one that goes
+        // with the cast below.
+        //
+        char length[3] = { 0, 0, 0 };
+
+        while( *fmt && std::strchr( "hlLqjzt", *fmt ) )
+        {
+            if( length[1] == 0 )
+            {
+                length[ length[0] ? 1 : 0 ] = *fmt;
+            }
+            ++fmt;
+        }
+
+        char conversion = *fmt;
+
+        if( conversion == 0 )
+        {
+            break;
+        }
+        ++fmt;
+
+        log_args::tag   t = log_args::arg_pointer;
+        uint64_t        v = 0;
+        const char*     s = nullptr;
+        size_t          n = 0;
+
+        if( !in.next( t, v, s, n ) )
+        {
+            missing = true;
+        }
+
+        if( missing )
+        {
+            o.put( "(?)", 3 );
+            continue;
+        }
+
+        bool is_long       = length[0] == 'l' && length[1] == 0;
+        bool is_long_long  = ( length[0] == 'l' && length[1] == 'l' ) || length[0] == 'q';
+        bool is_size       = length[0] == 'z' || length[0] == 't' || length[0] == 'j';
+
+        switch( conversion )
+        {
+        case 'd':
+        case 'i':
+            {
+                int64_t i = static_cast<int64_t>( as_integer( t, v ) );
+
+                if( is_long )           { append( "ld", 2 );     o.printf( spec, static_cast<long>( i ) ); }
+                else if( is_long_long ) { append( "lld", 3 );    o.printf( spec, static_cast<long long>( i ) ); }
+                else if( is_size )      { append( PRId64, std::strlen( PRId64 ) ); o.printf( spec, i ); }
+                else                    { append( "d", 1 );      o.printf( spec, static_cast<int>( i ) ); }
+            }
+            break;
+
+        case 'u':
+        case 'o':
+        case 'x':
+        case 'X':
+            {
+                uint64_t u = as_integer( t, v );
+
+                if( is_long )           { append( "l", 1 );  append( &conversion, 1 ); o.printf( spec, static_cast<unsigned long>( u ) ); }
+                else if( is_long_long || is_size )
+                                        { append( "ll", 2 ); append( &conversion, 1 ); o.printf( spec, static_cast<unsigned long long>( u ) ); }
+                else if( length[0] == 'h' && length[1] == 'h' )
+                                        { append( &conversion, 1 ); o.printf( spec, static_cast<unsigned>( static_cast<unsigned char>( u ) ) ); }
+                else if( length[0] == 'h' )
+                                        { append( &conversion, 1 ); o.printf( spec, static_cast<unsigned>( static_cast<unsigned short>( u ) ) ); }
+                else                    { append( &conversion, 1 ); o.printf( spec, static_cast<unsigned>( u ) ); }
+            }
+            break;
+
+        case 'c':
+            append( "c", 1 );
+            o.printf( spec, static_cast<int>( as_integer( t, v ) ) );
+            break;
+
+        case 'f': case 'F':
+        case 'e': case 'E':
+        case 'g': case 'G':
+        case 'a': case 'A':
+            append( &conversion, 1 );
+            o.printf( spec, as_double( t, v ) );
+            break;
+
+        case 's':
+            if( t == log_args::arg_string )
+            {
+                // The copy isn't terminated, so the length goes in as the precision. A
+                // precision in the original spec still applies.
+                //
+                if( dot_at )
+                {
+                    n = std::min<size_t>( n, std::atoi( spec + dot_at + 1 ) );
+                    used = dot_at;
+                    spec[used] = 0;
+                }
+
+                append( ".*s", 3 );
+                o.printf( spec, static_cast<int>( n ), s );
+            }
+            else if( t == log_args::arg_pointer && v == 0 )
+            {
+                append( "s", 1 );
+                o.printf( spec, "(null)" );
+            }
+            else
+            {
+                o.put( "(?)", 3 );
+            }
+            break;
+
+        case 'p':
+            append( "p", 1 );
+            o.printf( spec, reinterpret_cast<void*>( static_cast<uintptr_t>( v ) ) );
+            break;
+
+        default:
+            // %n and anything unknown is left out.
+            //
+            break;
+        }
+    }
+
+    return o.used;
+}
+
+ENS( ee5 )
@@ -0,0 +1,169 @@
+//-------------------------------------------------------------------------------------------------
+// Copyright (C) 2014 Ernest R. Ewert
+//
+// Feel free to use this as you see fit.
+// I ask that you keep my name with the code.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+// MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+// IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+// OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+// ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+// OTHER DEALINGS IN THE SOFTWARE.
+//
+#include <ee5>
+
+#include "log_binary.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+
+BNS( ee5 )
+
+const size_t binary_renderer::hex_row;
+const size_t binary_renderer::base64_row;
+
+
+
+//---------------------------------------------------------------------------------------------------------------------
+//
+//
+//
+//
+binary_renderer::binary_renderer(style s,emit_fn e,void* c) :
+    format( s ),
+    emit( e ),
+    context( c ),
+    offset( 0 ),
+    cb_pending( 0 )
+{
+}
+
+
+
+//---------------------------------------------------------------------------------------------------------------------
+//
+//  A whole row (or the last, short one).
+//
+void binary_renderer::row(const uint8_t* p,size_t cb)
+{
+    static const char digits[]  = "0123456789abcdef";
+    static const char b64[]     = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+
+    char    text[128];
+    char*   out = text;
+
+    if( format == hex )
+    {
+        out += snprintf( out, 32, "    %08llx: ", static_cast<unsigned long long>( offset ) );
+
+        for( size_t n = 0; n < hex_row; ++n )
+        {
+            if( n < cb )
+            {
+                *out++ = digits[ p[n] >> 4 ];
+                *out++ = digits[ p[n] & 0xf ];
+            }
+            else
+            {
+                *out++ = ' ';
+                *out++ = ' ';
+            }
+            *out++ = ' ';
+        }
+
+        *out++ = ' ';
+        *out++ = '|';
+
+        for( size_t n = 0; n < cb; ++n )
+        {
+            *out++ = p[n] >= 0x20 && p[n] < 0x7f ? static_cast<char>( p[n] ) : '.';
+        }
+
+        *out++ = '|';
+    }
+    else
+    {
+        *out++ = ' ';
+        *out++ = ' ';
+        *out++ = ' ';
+        *out++ = ' ';
+
+        for( size_t n = 0; n < cb; n += 3 )
+        {
+            uint32_t v = p[n] << 16;
+
+            v |= n + 1 < cb ? p[n + 1] << 8 : 0;
+            v |= n + 2 < cb ? p[n + 2] : 0;
+
+            *out++ = b64[ ( v >> 18 ) & 0x3f ];
+            *out++ = b64[ ( v >> 12 ) & 0x3f ];
+            *out++ = n + 1 < cb ? b64[ ( v >> 6 ) & 0x3f ] : '=';
+            *out++ = n + 2 < cb ? b64[ v & 0x3f ] : '=';
+        }
+    }
+
+    *out++ = '\n';
+
+    emit( text, out - text, context );
+
+    offset += cb;
+}
+
+
+
+//---------------------------------------------------------------------------------------------------------------------
+//
+//  Whole rows straight from the piece, the left over bytes wait for the next piece.
+//
+void binary_renderer::add(const void* data,size_t cb)
+{
+    const uint8_t*  p       = static_cast<const uint8_t*>( data );
+    const size_t    width   = format == hex ? hex_row : base64_row;
+
+    if( cb_pending )
+    {
+        size_t n = std::min( width - cb_pending, cb );
+
+        std::memcpy( pending + cb_pending, p, n );
+        cb_pending += n;
+        p          += n;
+        cb         -= n;
+
+        if( cb_pending < width )
+        {
+            return;
+        }
+
+        row( pending, width );
+        cb_pending = 0;
+    }
+
+    for( ; cb >= width; p += width, cb -= width )
+    {
+        row( p, width );
+    }
+
+    std::memcpy( pending, p, cb );
+    cb_pending = cb;
+}
+
+
+
+//---------------------------------------------------------------------------------------------------------------------
+//
+//
+//
+//
+void binary_renderer::finish()
+{
+    if( cb_pending )
+    {
+        row( pending, cb_pending );
+        cb_pending = 0;
+    }
+}
+
+ENS( ee5 )
@@ -0,0 +1,311 @@
+//-------------------------------------------------------------------------------------------------
+// Copyright (C) 2014 Ernest R. Ewert
+//
+// Feel free to use this as you see fit.
+// I ask that you keep my name with the code.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+// MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+// IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+// OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+// ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+// OTHER DEALINGS IN THE SOFTWARE.
+//
+#include <ee5>
+
+#include "logging.h"
+#include "spin_locking.h"
+
+#include <cstring>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#ifndef _MSC_VER
+#include <pthread.h>
+#endif
+
+BNS( ee5 )
+
+namespace
+{
+    struct facility_settings
+    {
+        log_level       level;
+        std::uint32_t   zones;
+    };
+
+    // All of this is only touched under the lock. The sites only ever read their own state.
+    //
+    spin_mutex                                  lock;
+    const __info*                               sites       = nullptr;
+    facility_settings                           defaults    = { level_info, log_zone_all };
+    std::map<std::string,facility_settings>     facilities;
+    std::map<const __info*,bool>                overrides;
+    std::vector<std::unique_ptr<log_limit>>     limits;     // From log_set_limit, never freed
+
+    bool decide(const __info* i)
+    {
+        auto o = overrides.find( i );
+
+        if( o != overrides.end() )
+        {
+            return o->second;
+        }
+
+        const facility_settings* f = &defaults;
+
+        if( i->facility )
+        {
+            auto found = facilities.find( i->facility );
+
+            if( found != facilities.end() )
+            {
+                f = &found->second;
+            }
+        }
+
+        return i->level <= f->level && ( i->zone & f->zones ) != 0;
+    }
+
+    // An ALWAYS site isn't filtered, so turning it off doesn't take its limit away. (log_always
+    // logs an ALWAYS site that is off, off only means it has no limit.)
+    //
+    void store(const __info* i)
+    {
+        bool            limited = i->limit.load( std::memory_order_relaxed ) != nullptr;
+        std::uint32_t   state   = __info::site_off;
+
+        if( limited && i->level == level_always )
+        {
+            state = __info::site_limited;
+        }
+        else if( decide( i ) )
+        {
+            state = limited ? __info::site_limited : __info::site_on;
+        }
+
+        i->state.store( state, std::memory_order_relaxed );
+    }
+
+    // Whether the site logs at all. (A limited site logs some of its lines.)
+    //
+    bool logs(const __info* i)
+    {
+        std::uint32_t state = i->state.load( std::memory_order_relaxed );
+
+        return state == __info::site_on || state == __info::site_limited || i->level == level_always;
+    }
+
+    void join(const __info* i)
+    {
+        if( i->state.load( std::memory_order_relaxed ) == __info::site_unknown )
+        {
+            i->next = sites;
+            sites   = i;
+        }
+    }
+
+    // Every site reached so far gets the new answer. A site racing with this sees either the
+    // old answer or the new one.
+    //
+    void refresh()
+    {
+        for( const __info* i = sites; i; i = i->next )
+        {
+            store( i );
+        }
+    }
+
+    // A fork taken while another thread (the logger reporting suppressed lines, say) holds
+    // the lock would leave the child's copy locked for good, and the child's first new site
+    // would spin forever. fork waits for the lock instead.
+    //
+#ifndef _MSC_VER
+    struct fork_guard
+    {
+        fork_guard()
+        {
+            pthread_atfork( [] { lock.lock(); }, [] { lock.unlock(); }, [] { lock.unlock(); } );
+        }
+    };
+
+    fork_guard  guard_fork;
+#endif
+
+    facility_settings& settings(const char* facility)
+    {
+        if( facility == nullptr )
+        {
+            return defaults;
+        }
+
+        auto found = facilities.find( facility );
+
+        if( found == facilities.end() )
+        {
+            found = facilities.emplace( facility, defaults ).first;
+        }
+
+        return found->second;
+    }
+}
+
+
+
+//---------------------------------------------------------------------------------------------------------------------
+//
+//  The first time a site is reached it joins the list, so later changes reach it too.
+//
+bool log_resolve(const __info* i)
+{
+    std::uint32_t state;
+    {
+        std::lock_guard<spin_mutex> hold( lock );
+
+        if( i->state.load( std::memory_order_relaxed ) == __info::site_unknown )
+        {
+            join( i );
+            store( i );
+        }
+
+        state = i->state.load( std::memory_order_relaxed );
+    }
+
+    return state == __info::site_on || ( state == __info::site_limited && log_admit( i ) );
+}
+
+
+
+//---------------------------------------------------------------------------------------------------------------------
+//
+//
+//
+//
+void log_set_level(const char* facility,log_level level)
+{
+    std::lock_guard<spin_mutex> hold( lock );
+
+    settings( facility ).level = level;
+    refresh();
+}
+
+
+
+//---------------------------------------------------------------------------------------------------------------------
+//
+//
+//
+//
+void log_set_zones(const char* facility,std::uint32_t zones)
+{
+    std::lock_guard<spin_mutex> hold( lock );
+
+    settings( facility ).zones = zones;
+    refresh();
+}
+
+
+
+//---------------------------------------------------------------------------------------------------------------------
+//
+//  A site that hasn't been reached yet is added to the list now, it would pick the override
+//  up on its first call anyway.
+//
+void log_set_site(const __info* site,bool on)
+{
+    std::lock_guard<spin_mutex> hold( lock );
+
+    overrides[site] = on;
+
+    join( site );
+    store( site );
+}
+
+
+
+//---------------------------------------------------------------------------------------------------------------------
+//
+//
+//
+//
+void log_reset_sites()
+{
+    std::lock_guard<spin_mutex> hold( lock );
+
+    overrides.clear();
+    refresh();
+}
+
+
+
+//---------------------------------------------------------------------------------------------------------------------
+//
+//  The visitor is called under the lock, it can't change the settings.
+//
+void log_visit_sites(void (*visit)(const __info* site,bool on,void* context),void* context)
+{
+    std::lock_guard<spin_mutex> hold( lock );
+
+    for( const __info* i = sites; i; i = i->next )
+    {
+        visit( i, logs( i ), context );
+    }
+}
+
+
+
+//---------------------------------------------------------------------------------------------------------------------
+//
+//  The old limit is left where it is, a thread may still be in the middle of admit().
+//
+void log_set_limit(const __info* site,log_limit::limit_mode mode,std::uint32_t n,std::uint32_t burst)
+{
+    std::lock_guard<spin_mutex> hold( lock );
+
+    log_limit* l = nullptr;
+
+    if( n )
+    {
+        limits.emplace_back( new log_limit( mode, n, burst ) );
+        l = limits.back().get();
+    }
+
+    site->limit.store( l, std::memory_order_release );
+
+    join( site );
+    store( site );
+}
+
+
+
+//---------------------------------------------------------------------------------------------------------------------
+//
+//
+//
+//
+void log_take_suppressed(void (*visit)(const __info* site,std::uint64_t suppressed,void* context),void* context)
+{
+    std::lock_guard<spin_mutex> hold( lock );
+
+    for( const __info* i = sites; i; i = i->next )
+    {
+        log_limit* l = i->limit.load( std::memory_order_acquire );
+
+        if( l )
+        {
+            std::uint64_t total = l->suppressed();
+
+            if( total != l->reported )
+            {
+                visit( i, total - l->reported, context );
+                l->reported = total;
+            }
+        }
+    }
+}
+
+ENS( ee5 )
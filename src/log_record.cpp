@@ -0,0 +1,340 @@
+//-------------------------------------------------------------------------------------------------
+// Copyright (C) 2014 Ernest R. Ewert
+//
+// Feel free to use this as you see fit.
+// I ask that you keep my name with the code.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+// MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+// IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+// OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+// ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+// OTHER DEALINGS IN THE SOFTWARE.
+//
+#include <ee5>
+
+#include "log_record.h"
+#include "log_args.h"
+
+#include <algorithm>
+#include <cinttypes>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <initializer_list>
+
+BNS( ee5 )
+
+namespace
+{
+    // Appends to a fixed buffer. Once something doesn't fit, nothing more goes in.
+    //
+    struct output
+    {
+        char*   p;
+        size_t  cb;
+        size_t  used;
+        bool    full;
+
+        void put(const void* s,size_t n)
+        {
+            if( full || cb - used < n )
+            {
+                full = true;
+                return;
+            }
+
+            std::memcpy( p + used, s, n );
+            used += n;
+        }
+
+        void put(const char* s)
+        {
+            put( s, std::strlen( s ) );
+        }
+
+        template<typename... A>
+        void printf(const char* spec,A... args)
+        {
+            char    buffer[64];
+            int     n = std::snprintf( buffer, sizeof( buffer ), spec, args... );
+
+            put( buffer, n < 0 ? 0 : std::min<size_t>( n, sizeof( buffer ) - 1 ) );
+        }
+
+        void escaped(const char* s,size_t n)
+        {
+            put( "\"", 1 );
+
+            for( size_t at = 0; at < n; ++at )
+            {
+                unsigned char c = s[at];
+
+                switch( c )
+                {
+                case '"':   put( "\\\"", 2 );   break;
+                case '\\':  put( "\\\\", 2 );   break;
+                case '\n':  put( "\\n", 2 );    break;
+                case '\r':  put( "\\r", 2 );    break;
+                case '\t':  put( "\\t", 2 );    break;
+                default:
+                    if( c < 0x20 )
+                    {
+                        printf( "\\u%04x", c );
+                    }
+                    else
+                    {
+                        put( &s[at], 1 );
+                    }
+                }
+            }
+
+            put( "\"", 1 );
+        }
+
+        void escaped(const char* s)
+        {
+            escaped( s ? s : "", s ? std::strlen( s ) : 0 );
+        }
+
+        template<typename T>
+        void value(T v)
+        {
+            put( &v, sizeof( v ) );
+        }
+
+        void text(const char* s,size_t n)
+        {
+            uint16_t cb16 = static_cast<uint16_t>( std::min<size_t>( n, UINT16_MAX ) );
+
+            value( cb16 );
+            put( s, cb16 );
+        }
+    };
+
+    // The field names one at a time, without the spaces around them.
+    //
+    struct names
+    {
+        const char* p;
+
+        bool next(const char*& name,size_t& cb)
+        {
+            if( p == nullptr || *p == 0 )
+            {
+                return false;
+            }
+
+            const char* comma = std::strchr( p, ',' );
+            const char* stop  = comma ? comma : p + std::strlen( p );
+
+            while( p < stop && *p == ' ' )
+            {
+                ++p;
+            }
+
+            name = p;
+            cb   = stop - p;
+
+            while( cb && name[cb - 1] == ' ' )
+            {
+                --cb;
+            }
+
+            p = comma ? comma + 1 : stop;
+            return true;
+        }
+    };
+}
+
+
+
+//---------------------------------------------------------------------------------------------------------------------
+//
+//  Room for the closing brace is held back, so a record that is cut short is still a line of
+//  JSON.
+//
+size_t log_record::render_json(char* out,size_t cb,const __info* i,const char* when,size_t thread,const void* args,size_t cb_args)
+{
+    if( cb < 2 )
+    {
+        return 0;
+    }
+
+    output o = { out, cb - 2, 0, false };
+
+    o.put( "{\"time\":" );
+    o.escaped( when );
+    o.put( ",\"facility\":" );
+    o.escaped( i->facility );
+    o.printf( ",\"thread\":%llu,\"function\":", static_cast<unsigned long long>( thread ) );
+    o.escaped( i->function );
+    o.put( ",\"file\":" );
+    o.escaped( i->file );
+    o.printf( ",\"line\":%zu,\"msg\":", i->line );
+    o.escaped( i->format );
+
+    log_args::reader    in( args, cb_args );
+    names               fields = { i->fields };
+    const char*         name;
+    size_t              cb_name;
+
+    while( !o.full && fields.next( name, cb_name ) )
+    {
+        size_t mark = o.used;
+
+        o.put( ",", 1 );
+        o.escaped( name, cb_name );
+        o.put( ":", 1 );
+
+        log_args::tag   t;
+        uint64_t        v = 0;
+        const char*     s = nullptr;
+        size_t          n = 0;
+
+        if( !in.next( t, v, s, n ) )
+        {
+            o.put( "null" );
+        }
+        else
+        {
+            switch( t )
+            {
+            case log_args::arg_signed:
+                o.printf( "%lld", static_cast<long long>( static_cast<int64_t>( v ) ) );
+                break;
+
+            case log_args::arg_unsigned:
+                o.printf( "%llu", static_cast<unsigned long long>( v ) );
+                break;
+
+            case log_args::arg_double:
+            {
+                double d;
+                std::memcpy( &d, &v, sizeof( d ) );
+
+                if( std::isfinite( d ) )
+                {
+                    o.printf( "%.17g", d );
+                }
+                else
+                {
+                    o.put( "null" );
+                }
+                break;
+            }
+
+            case log_args::arg_pointer:
+                if( v )
+                {
+                    o.printf( "\"0x%llx\"", static_cast<unsigned long long>( v ) );
+                }
+                else
+                {
+                    o.put( "null" );
+                }
+                break;
+
+            case log_args::arg_string:
+                o.escaped( s, n );
+                break;
+
+            default:
+                o.put( "null" );
+            }
+        }
+
+        // Whole fields or none at all.
+        //
+        if( o.full )
+        {
+            o.used = mark;
+        }
+    }
+
+    o.cb    = cb;
+    o.full  = false;
+    o.put( "}\n", 2 );
+
+    return o.used;
+}
+
+
+
+//---------------------------------------------------------------------------------------------------------------------
+//
+//  A frame without room for its header is left out altogether (0), one without room for all
+//  of its fields has the ones that fit.
+//
+size_t log_record::render_binary(char* out,size_t cb,const __info* i,int64_t ns,size_t thread,const void* args,size_t cb_args)
+{
+    output o = { out, cb, 0, false };
+
+    o.value( uint32_t( 0 ) );
+    o.value( version );
+    o.value( ns );
+    o.value( static_cast<uint64_t>( thread ) );
+    o.value( static_cast<uint32_t>( i->line ) );
+
+    for( const char* s : { i->facility, i->function, i->file, i->format } )
+    {
+        o.text( s ? s : "", s ? std::strlen( s ) : 0 );
+    }
+
+    size_t  count_at    = o.used;
+    uint8_t count       = 0;
+
+    o.value( count );
+
+    if( o.full )
+    {
+        return 0;
+    }
+
+    log_args::reader    in( args, cb_args );
+    names               fields = { i->fields };
+    const char*         name;
+    size_t              cb_name;
+
+    log_args::tag   t;
+    uint64_t        v = 0;
+    const char*     s = nullptr;
+    size_t          n = 0;
+
+    while( count < UINT8_MAX && fields.next( name, cb_name ) && in.next( t, v, s, n ) )
+    {
+        size_t  mark    = o.used;
+        uint8_t cb8     = static_cast<uint8_t>( std::min<size_t>( cb_name, UINT8_MAX ) );
+
+        o.value( cb8 );
+        o.put( name, cb8 );
+        o.value( static_cast<uint8_t>( t ) );
+
+        if( t == log_args::arg_string )
+        {
+            o.text( s, n );
+        }
+        else
+        {
+            o.value( v );
+        }
+
+        if( o.full )
+        {
+            o.used = mark;
+            break;
+        }
+
+        ++count;
+    }
+
+    uint32_t cb_frame = static_cast<uint32_t>( o.used - sizeof( cb_frame ) );
+
+    std::memcpy( out, &cb_frame, sizeof( cb_frame ) );
+    std::memcpy( out + count_at, &count, sizeof( count ) );
+
+    return o.used;
+}
+
+ENS( ee5 )
@@ -0,0 +1,448 @@
+//-------------------------------------------------------------------------------------------------
+// Copyright (C) 2014 Ernest R. Ewert
+//
+// Feel free to use this as you see fit.
+// I ask that you keep my name with the code.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+// MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+// IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+// OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+// ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+// OTHER DEALINGS IN THE SOFTWARE.
+//
+#include <ee5>
+
+#include "log_ring.h"
+#include "console_logger.h"
+#include "log_binary.h"
+#include "log_record.h"
+#include "log_timestamp.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdarg>
+#include <cstring>
+#include <map>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+BNS( ee5 )
+
+size_t work_thread_id();
+
+const size_t    MappedLogRing::header_size;
+const uint32_t  MappedLogRing::version;
+
+std::atomic<MappedLogRing::file_header*>    MappedLogRing::header( nullptr );
+bool                                        MappedLogRing::tee                  = false;
+program_log                                 MappedLogRing::previous             = nullptr;
+program_log_deferred                        MappedLogRing::previous_deferred    = nullptr;
+program_log_binary                          MappedLogRing::previous_binary      = nullptr;
+
+namespace
+{
+    const char  ring_magic[8]   = { 'e', 'e', '5', 'r', 'i', 'n', 'g', 0 };
+    const size_t max_line       = 4096;
+
+    size_t power_of_2(size_t v,size_t least)
+    {
+        size_t p = least;
+
+        while( p < v )
+        {
+            p <<= 1;
+        }
+        return p;
+    }
+
+    int64_t now_ns()
+    {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>( std::chrono::system_clock::now().time_since_epoch() ).count();
+    }
+}
+
+
+
+//---------------------------------------------------------------------------------------------------------------------
+//
+//  A ring of the same shape is picked up where it left off, anything else is started over.
+//
+RC MappedLogRing::Install(const options& o)
+{
+    CBREx( !o.path.empty(), e_invalid_argument( 1, "a path is required" ) );
+
+    size_t slots        = power_of_2( o.slots, 16 );
+    size_t slot_size    = power_of_2( o.slot_size, 64 );
+    size_t cb           = header_size + slots * slot_size;
+
+    int fd = ::open( o.path.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0644 );
+
+    CBREx( fd >= 0, e_io_failure() );
+
+    struct stat st;
+    bool        same = ::fstat( fd, &st ) == 0 && static_cast<size_t>( st.st_size ) == cb;
+
+    if( !same && ( ::ftruncate( fd, 0 ) != 0 || ::ftruncate( fd, cb ) != 0 ) )
+    {
+        ::close( fd );
+        return e_io_failure();
+    }
+
+    void* p = ::mmap( nullptr, cb, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0 );
+
+    ::close( fd );
+
+    CBREx( p != MAP_FAILED, e_io_failure() );
+
+    file_header* h = static_cast<file_header*>( p );
+
+    if( !same || std::memcmp( h->magic, ring_magic, sizeof( ring_magic ) ) != 0 || h->version != version || h->slot_size != slot_size || h->slots != slots )
+    {
+        std::memset( p, 0, cb );
+
+        h->version      = version;
+        h->slot_size    = static_cast<uint32_t>( slot_size );
+        h->slots        = slots;
+        h->created      = now_ns();
+        h->next.store( 0, std::memory_order_relaxed );
+
+        std::memcpy( h->magic, ring_magic, sizeof( ring_magic ) );
+    }
+
+    // The first install takes over from the logger. A second one only moves to the new file.
+    //
+    if( header.exchange( h, std::memory_order_acq_rel ) == nullptr )
+    {
+        previous            = __ee5_log;
+        previous_deferred   = __ee5_log_deferred;
+        previous_binary     = __ee5_log_binary;
+    }
+
+    tee = o.tee;
+
+    __ee5_log           = ring_log;
+    __ee5_log_deferred  = ring_log_deferred;
+    __ee5_log_binary    = ring_log_binary;
+
+    return s_ok();
+}
+
+
+
+//---------------------------------------------------------------------------------------------------------------------
+//
+//
+//
+//
+void MappedLogRing::Uninstall()
+{
+    if( header.exchange( nullptr, std::memory_order_acq_rel ) == nullptr )
+    {
+        return;
+    }
+
+    __ee5_log           = previous;
+    __ee5_log_deferred  = previous_deferred;
+    __ee5_log_binary    = previous_binary;
+}
+
+
+
+//---------------------------------------------------------------------------------------------------------------------
+//
+//  One fetch_add hands out every slot the record needs. A record is never more than half of
+//  the ring, so it can't lap itself.
+//
+//  begin is stored before anything else in the slot and end after everything else. (The
+//  release fence keeps the slot's stores from moving above begin.) A reader that finds them
+//  equal has the whole slot.
+//
+void MappedLogRing::record(const char* text,size_t cb_text,const void* payload,size_t cb_payload)
+{
+    file_header* h = header.load( std::memory_order_acquire );
+
+    if( h == nullptr )
+    {
+        return;
+    }
+
+    const size_t body   = h->slot_size - offsetof( slot, data );
+    const size_t most   = ( h->slots / 2 ) * body;
+
+    cb_text     = std::min( cb_text, most );
+    cb_payload  = std::min( cb_payload, most - cb_text );
+
+    size_t      total   = cb_text + cb_payload;
+    uint32_t    parts   = static_cast<uint32_t>( std::max<size_t>( 1, ( total + body - 1 ) / body ) );
+    uint64_t    first   = h->next.fetch_add( parts, std::memory_order_relaxed );
+    uint64_t    seq     = first + 1;
+    int64_t     time    = now_ns();
+    size_t      done    = 0;
+
+    for( uint32_t part = 0; part < parts; ++part )
+    {
+        slot* s = at( h, first + part );
+
+        s->begin.store( seq, std::memory_order_relaxed );
+        std::atomic_thread_fence( std::memory_order_release );
+
+        s->time         = time;
+        s->parts        = parts;
+        s->part         = part;
+        s->cb_text      = static_cast<uint32_t>( cb_text );
+        s->cb_payload   = static_cast<uint32_t>( cb_payload );
+
+        size_t n = std::min( body, total - done );
+
+        for( size_t used = 0; used < n; )
+        {
+            size_t offset = done + used;
+            size_t chunk;
+
+            if( offset < cb_text )
+            {
+                chunk = std::min( n - used, cb_text - offset );
+                std::memcpy( s->data + used, text + offset, chunk );
+            }
+            else
+            {
+                chunk = n - used;
+                std::memcpy( s->data + used, static_cast<const char*>( payload ) + offset - cb_text, chunk );
+            }
+
+            used += chunk;
+        }
+
+        done += n;
+
+        s->end.store( seq, std::memory_order_release );
+    }
+}
+
+
+
+//---------------------------------------------------------------------------------------------------------------------
+//
+//  The same line ConsoleLogger writes, less the time stamp. (The slot has the time.)
+//
+size_t MappedLogRing::line(char* out,size_t cb,const __info* i,const char* msg)
+{
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wformat"
+    int n = snprintf( out, cb, "|%s|:%lx %s %s", i->facility, work_thread_id(), i->function, msg );
+#pragma GCC diagnostic pop
+
+    return n < 0 ? 0 : std::min( static_cast<size_t>( n ), cb - 1 );
+}
+
+
+
+//---------------------------------------------------------------------------------------------------------------------
+//
+//
+//
+//
+void MappedLogRing::ring_log(const __info* i,...)
+{
+    char msg[max_line];
+    char text[max_line + 256];
+
+    va_list arg_list;
+    va_start( arg_list, i );
+    int n = vsnprintf( msg, sizeof( msg ), i->format, arg_list );
+    va_end( arg_list );
+
+    if( n < 0 )
+    {
+        return;
+    }
+
+    record( text, line( text, sizeof( text ), i, msg ), nullptr, 0 );
+
+    if( tee )
+    {
+        ConsoleLogger::Write( i, msg, std::min( static_cast<size_t>( n ), sizeof( msg ) - 1 ) );
+    }
+}
+
+
+
+//---------------------------------------------------------------------------------------------------------------------
+//
+//  The format is applied here, the reader can't do it. A LOG_RECORD goes in as its JSON line.
+//
+void MappedLogRing::ring_log_deferred(const __info* i,const void* args,size_t cb)
+{
+    char msg[max_line];
+    char text[max_line + 256];
+
+    if( i->fields )
+    {
+        char            json[log_record::max_size];
+        char            when[log_timestamp::max_size];
+        log_timestamp   stamp;
+
+        stamp.render( when, std::chrono::system_clock::now() );
+
+        size_t cb_json = log_record::render_json( json, sizeof( json ), i, when, work_thread_id(), args, cb );
+
+        // Without the newline, Dump adds one.
+        //
+        record( json, cb_json ? cb_json - 1 : 0, nullptr, 0 );
+    }
+    else
+    {
+        log_args::format( msg, sizeof( msg ), i->format, args, cb );
+
+        record( text, line( text, sizeof( text ), i, msg ), nullptr, 0 );
+    }
+
+    if( tee && previous_deferred )
+    {
+        previous_deferred( i, args, cb );
+    }
+}
+
+
+
+//---------------------------------------------------------------------------------------------------------------------
+//
+//
+//
+//
+void MappedLogRing::ring_log_binary(const __info* i,const void* payload,size_t cb_payload,const void* args,size_t cb_args)
+{
+    char msg[max_line];
+    char text[max_line + 256];
+
+    log_args::format( msg, sizeof( msg ), i->format, args, cb_args );
+
+    record( text, line( text, sizeof( text ), i, msg ), payload, cb_payload );
+
+    if( tee && previous_binary )
+    {
+        previous_binary( i, payload, cb_payload, args, cb_args );
+    }
+}
+
+
+
+//---------------------------------------------------------------------------------------------------------------------
+//
+//  Every record whose slots are all whole is collected, the last count of them (in sequence
+//  order) are written out. Records that were torn or lapped are left out.
+//
+RC MappedLogRing::Dump(const char* path,size_t count,FILE* out)
+{
+    int fd = ::open( path, O_RDONLY | O_CLOEXEC );
+
+    CBREx( fd >= 0, e_io_failure() );
+
+    struct stat st;
+
+    if( ::fstat( fd, &st ) != 0 || static_cast<size_t>( st.st_size ) < header_size )
+    {
+        ::close( fd );
+        return e_invalid_argument( 1, "not a log ring" );
+    }
+
+    size_t  cb  = st.st_size;
+    void*   p   = ::mmap( nullptr, cb, PROT_READ, MAP_SHARED, fd, 0 );
+
+    ::close( fd );
+
+    CBREx( p != MAP_FAILED, e_io_failure() );
+
+    file_header* h = static_cast<file_header*>( p );
+
+    if( std::memcmp( h->magic, ring_magic, sizeof( ring_magic ) ) != 0 ||
+        h->version != version ||
+        h->slots == 0 || ( h->slots & ( h->slots - 1 ) ) != 0 ||
+        h->slot_size < 64 ||
+        header_size + h->slots * h->slot_size != cb )
+    {
+        ::munmap( p, cb );
+        return e_invalid_argument( 1, "not a log ring" );
+    }
+
+    const size_t body = h->slot_size - offsetof( slot, data );
+
+    // seq -> first slot
+    //
+    std::map<uint64_t,uint64_t> records;
+
+    for( uint64_t n = 0; n < h->slots; ++n )
+    {
+        slot*       s   = at( h, n );
+        uint64_t    seq = s->end.load( std::memory_order_acquire );
+
+        if( seq == 0 || s->part != 0 || s->begin.load( std::memory_order_relaxed ) != seq )
+        {
+            continue;
+        }
+
+        bool whole = s->parts <= h->slots / 2;
+
+        for( uint32_t part = 1; whole && part < s->parts; ++part )
+        {
+            slot* more = at( h, seq - 1 + part );
+
+            whole = more->end.load( std::memory_order_acquire ) == seq && more->begin.load( std::memory_order_relaxed ) == seq && more->part == part;
+        }
+
+        if( whole )
+        {
+            records[seq] = seq - 1;
+        }
+    }
+
+    while( records.size() > count )
+    {
+        records.erase( records.begin() );
+    }
+
+    log_timestamp       stamp;
+    std::vector<char>   record;
+
+    for( auto& r : records )
+    {
+        slot*   s       = at( h, r.second );
+        size_t  total   = s->cb_text + s->cb_payload;
+
+        record.resize( total + 1 );
+
+        for( uint32_t part = 0, done = 0; part < s->parts; ++part )
+        {
+            size_t n = std::min( body, total - done );
+
+            std::memcpy( record.data() + done, at( h, r.second + part )->data, n );
+            done += n;
+        }
+
+        char when[log_timestamp::max_size];
+
+        stamp.render( when, std::chrono::system_clock::time_point( std::chrono::duration_cast<std::chrono::system_clock::duration>( std::chrono::nanoseconds( s->time ) ) ) );
+
+        fprintf( out, "[%s]%.*s\n", when, static_cast<int>( s->cb_text ), record.data() );
+
+        if( s->cb_payload )
+        {
+            binary_renderer dump( binary_renderer::hex, [](const char* row,size_t cb_row,void* f) { fwrite( row, 1, cb_row, static_cast<FILE*>( f ) ); }, out );
+
+            dump.add( record.data() + s->cb_text, s->cb_payload );
+            dump.finish();
+        }
+    }
+
+    ::munmap( p, cb );
+
+    return s_ok();
+}
+
+ENS( ee5 )
@@ -0,0 +1,489 @@
+//-------------------------------------------------------------------------------------------------
+// Copyright (C) 2014 Ernest R. Ewert
+//
+// Feel free to use this as you see fit.
+// I ask that you keep my name with the code.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+// MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+// IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+// OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+// ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+// OTHER DEALINGS IN THE SOFTWARE.
+//
+#include <ee5>
+
+#include "log_sink.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+BNS( ee5 )
+
+const size_t file_sink::block;
+
+namespace
+{
+    // Until all of it is written (or the write fails).
+    //
+    bool write_all(int fd,struct iovec* iov,int count,size_t& calls)
+    {
+        while( count )
+        {
+            ssize_t n = ::writev( fd, iov, count );
+            ++calls;
+
+            if( n < 0 )
+            {
+                if( errno == EINTR )
+                {
+                    continue;
+                }
+                return false;
+            }
+
+            size_t done = static_cast<size_t>( n );
+
+            while( count && done >= iov->iov_len )
+            {
+                done -= iov->iov_len;
+                ++iov;
+                --count;
+            }
+
+            if( count )
+            {
+                iov->iov_base = static_cast<char*>( iov->iov_base ) + done;
+                iov->iov_len -= done;
+            }
+        }
+
+        return true;
+    }
+}
+
+
+
+//---------------------------------------------------------------------------------------------------------------------
+//
+//  The buffer size is rounded up to whole blocks, a direct write has to be.
+//
+file_sink::file_sink(const options& o) :
+    opts( o ),
+    fd( -1 ),
+    direct( false ),
+    capacity( 0 ),
+    fill( 0 ),
+    tail_written( 0 ),
+    file_size( 0 ),
+    calls( 0 ),
+    written_at( clock::now() ),
+    synced_at( clock::now() )
+{
+    opts.buffer_size    = std::max<size_t>( ( opts.buffer_size + block - 1 ) & ~( block - 1 ), block );
+    opts.buffers        = std::max<size_t>( opts.buffers, 1 );
+
+    for( size_t b = 0; b < opts.buffers; ++b )
+    {
+        void* p = nullptr;
+
+        if( posix_memalign( &p, block, opts.buffer_size ) != 0 )
+        {
+            break;
+        }
+
+        buffers.push_back( static_cast<char*>( p ) );
+    }
+
+    capacity = buffers.size() * opts.buffer_size;
+
+    if( capacity )
+    {
+        open_file();
+    }
+}
+
+
+
+//---------------------------------------------------------------------------------------------------------------------
+//
+//
+//
+//
+file_sink::~file_sink()
+{
+    close_file();
+
+    for( char* b : buffers )
+    {
+        std::free( b );
+    }
+}
+
+
+
+//---------------------------------------------------------------------------------------------------------------------
+//
+//  O_DIRECT writes go to explicit offsets. If the file ends part way into a block, that part is
+//  read back into the buffer so the block can be written again whole.
+//
+void file_sink::open_file()
+{
+    direct = false;
+
+    if( opts.direct )
+    {
+        // (read write, the partial block is read back)
+        //
+        fd      = ::open( opts.path.c_str(), O_RDWR | O_CREAT | O_CLOEXEC | O_DIRECT, 0644 );
+        direct  = fd >= 0;
+    }
+
+    if( fd < 0 )
+    {
+        fd = ::open( opts.path.c_str(), O_WRONLY | O_CREAT | O_CLOEXEC | O_APPEND, 0644 );
+    }
+
+    if( fd < 0 )
+    {
+        return;
+    }
+
+    fill            = 0;
+    tail_written    = 0;
+    file_size       = 0;
+
+    if( !direct )
+    {
+        file_size = std::max<off_t>( ::lseek( fd, 0, SEEK_END ), 0 );
+    }
+    else
+    {
+        struct stat st;
+
+        if( fstat( fd, &st ) == 0 )
+        {
+            size_t partial = static_cast<size_t>( st.st_size % block );
+
+            file_size = st.st_size - partial;
+
+            if( partial && ::pread( fd, buffers[0], block, file_size ) == static_cast<ssize_t>( partial ) )
+            {
+                fill            = partial;
+                tail_written    = partial;
+            }
+            else
+            {
+                // Can't rewrite what isn't there, start on the next block.
+                //
+                file_size += partial ? block : 0;
+            }
+        }
+    }
+}
+
+
+
+//---------------------------------------------------------------------------------------------------------------------
+//
+//
+//
+//
+void file_sink::close_file()
+{
+    if( fd < 0 )
+    {
+        return;
+    }
+
+    push();
+
+    if( opts.sync != sync_never )
+    {
+        ::fdatasync( fd );
+    }
+
+    ::close( fd );
+    fd = -1;
+}
+
+
+
+//---------------------------------------------------------------------------------------------------------------------
+//
+//  path.(keep - 1) -> path.keep ... path -> path.1, the oldest one is overwritten.
+//
+void file_sink::rotate()
+{
+    close_file();
+
+    for( size_t n = opts.rotate_keep; n > 1; --n )
+    {
+        std::string from    = opts.path + "." + std::to_string( n - 1 );
+        std::string to      = opts.path + "." + std::to_string( n );
+
+        ::rename( from.c_str(), to.c_str() );
+    }
+
+    if( opts.rotate_keep )
+    {
+        ::rename( opts.path.c_str(), ( opts.path + ".1" ).c_str() );
+    }
+    else
+    {
+        ::unlink( opts.path.c_str() );
+    }
+
+    open_file();
+}
+
+
+
+//---------------------------------------------------------------------------------------------------------------------
+//
+//  Everything buffered goes out. Only ever called between lines, so a rotation never splits a
+//  line.
+//
+void file_sink::push()
+{
+    if( fd < 0 || fill == tail_written )
+    {
+        return;
+    }
+
+    if( direct )
+    {
+        write_direct();
+    }
+    else
+    {
+        write_buffered( 0 );
+    }
+
+    clock::time_point now = clock::now();
+
+    written_at = now;
+
+    if( opts.sync == sync_flush || ( opts.sync == sync_interval && now - synced_at >= opts.sync_every ) )
+    {
+        ::fdatasync( fd );
+        synced_at = now;
+    }
+
+    if( opts.rotate_size && file_size + fill >= opts.rotate_size )
+    {
+        // The direct tail is already in the file.
+        //
+        fill            = 0;
+        tail_written    = 0;
+
+        rotate();
+    }
+}
+
+
+
+//---------------------------------------------------------------------------------------------------------------------
+//
+//
+//
+//
+void file_sink::write_buffered(size_t done)
+{
+    struct iovec    iov[64];
+
+    while( done < fill )
+    {
+        int count = 0;
+
+        for( ; done < fill && count < 64; ++count )
+        {
+            size_t b    = done / opts.buffer_size;
+            size_t at   = done % opts.buffer_size;
+            size_t cb   = std::min( opts.buffer_size - at, fill - done );
+
+            iov[count].iov_base = buffers[b] + at;
+            iov[count].iov_len  = cb;
+            done += cb;
+        }
+
+        if( !write_all( fd, iov, count, calls ) )
+        {
+            break;
+        }
+    }
+
+    file_size  += fill;
+    fill        = 0;
+}
+
+
+
+//---------------------------------------------------------------------------------------------------------------------
+//
+//  The whole blocks are written directly. The rest is written through the page cache, and
+//  stays at the front of the first buffer to be written again once it is a whole block.
+//
+void file_sink::write_direct()
+{
+    size_t whole    = fill & ~( block - 1 );
+    size_t tail     = fill - whole;
+    size_t done     = 0;
+
+    while( done < whole )
+    {
+        struct iovec    iov[64];
+        int             count   = 0;
+
+        for( size_t at = done; at < whole && count < 64; ++count )
+        {
+            size_t offset = at % opts.buffer_size;
+
+            iov[count].iov_base = buffers[ at / opts.buffer_size ] + offset;
+            iov[count].iov_len  = std::min( opts.buffer_size - offset, whole - at );
+            at += iov[count].iov_len;
+        }
+
+        ssize_t n = ::pwritev( fd, iov, count, file_size + done );
+        ++calls;
+
+        if( n <= 0 || ( static_cast<size_t>( n ) & ( block - 1 ) ) != 0 )
+        {
+            break;
+        }
+
+        done += n;
+    }
+
+    if( done < whole )
+    {
+        // The file system won't take it. The rest of the file is written the ordinary way,
+        // starting where the direct writes stopped.
+        //
+        ::fcntl( fd, F_SETFL, ::fcntl( fd, F_GETFL ) & ~O_DIRECT );
+        ::lseek( fd, file_size + done, SEEK_SET );
+
+        direct          = false;
+        tail_written    = 0;
+
+        write_buffered( done );
+        return;
+    }
+
+    if( whole )
+    {
+        file_size += whole;
+
+        if( tail )
+        {
+            std::memcpy( buffers[0], buffers[ whole / opts.buffer_size ] + whole % opts.buffer_size, tail );
+        }
+
+        fill            = tail;
+        tail_written    = 0;
+    }
+
+    if( tail > tail_written )
+    {
+        int flags = ::fcntl( fd, F_GETFL );
+
+        ::fcntl( fd, F_SETFL, flags & ~O_DIRECT );
+
+        if( ::pwrite( fd, buffers[0], tail, file_size ) == static_cast<ssize_t>( tail ) )
+        {
+            tail_written = tail;
+        }
+        ++calls;
+
+        ::fcntl( fd, F_SETFL, flags );
+    }
+}
+
+
+
+//---------------------------------------------------------------------------------------------------------------------
+//
+//
+//
+//
+void file_sink::copy_in(const char* line,size_t cb)
+{
+    while( cb )
+    {
+        size_t b    = fill / opts.buffer_size;
+        size_t at   = fill % opts.buffer_size;
+        size_t n    = std::min( opts.buffer_size - at, cb );
+
+        std::memcpy( buffers[b] + at, line, n );
+
+        fill   += n;
+        line   += n;
+        cb     -= n;
+    }
+}
+
+
+
+//---------------------------------------------------------------------------------------------------------------------
+//
+//  A line that doesn't fit in what is left of the buffers pushes what is there first.
+//
+void file_sink::write(const char* line,size_t cb)
+{
+    if( fd < 0 )
+    {
+        return;
+    }
+
+    if( fill + cb > capacity )
+    {
+        push();
+    }
+
+    // Longer than all of the buffers put together, the only time a line is split.
+    //
+    while( fill + cb > capacity )
+    {
+        size_t n = capacity - fill;
+
+        copy_in( line, n );
+        line   += n;
+        cb     -= n;
+
+        push();
+
+        if( fd < 0 )
+        {
+            return;
+        }
+    }
+
+    copy_in( line, cb );
+
+    if( clock::now() - written_at >= opts.flush_interval )
+    {
+        push();
+    }
+}
+
+
+
+//---------------------------------------------------------------------------------------------------------------------
+//
+//
+//
+//
+void file_sink::flush()
+{
+    push();
+}
+
+ENS( ee5 )
@@ -16,13 +16,16 @@
 
 #include "system.h"
 #include "console_logger.h"
+#include "lock_profile.h"
 
 
 #include <atomic>
 
 BNS( ee5 )
 
-program_log __ee5_log = nullptr;
+program_log             __ee5_log           = nullptr;
+program_log_deferred    __ee5_log_deferred  = nullptr;
+program_log_binary      __ee5_log_binary    = nullptr;
 
 
 
@@ -37,7 +40,7 @@ int Startup(size_t c,const char* s)
 
     if( ++cStartCount == 1 )
     {
-        ConsoleLogger::Startup(&__ee5_log);
+        ConsoleLogger::Startup(&__ee5_log,&__ee5_log_deferred,&__ee5_log_binary);
     }
 
     return s_ok();
@@ -52,6 +55,8 @@ int Startup(size_t c,const char* s)
 //
 void Shutdown()
 {
+    lock_profile_report();
+
     ConsoleLogger::Shutdown();
 }
 
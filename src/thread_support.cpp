@@ -0,0 +1,175 @@
+//-------------------------------------------------------------------------------------------------
+// Copyright (C) 2014 Ernest R. Ewert
+//
+// Feel free to use this as you see fit.
+// I ask that you keep my name with the code.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+// MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+// IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+// OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+// ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+// OTHER DEALINGS IN THE SOFTWARE.
+//
+#include <ee5>
+
+#include "thread_support.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+
+#ifdef __linux__
+#include <dirent.h>
+#include <sched.h>
+#endif
+
+BNS( ee5 )
+
+namespace
+{
+
+//---------------------------------------------------------------------------------------------------------------------
+//
+//  cpu -> node map
+//
+struct topology
+{
+    std::vector<size_t> node_of;
+    size_t              nodes = 1;
+
+    topology()
+    {
+#ifdef __linux__
+        DIR* d = opendir( "/sys/devices/system/node" );
+
+        if( d == nullptr )
+        {
+            return;
+        }
+
+        size_t highest = 0;
+        bool   found   = false;
+
+        while( dirent* e = readdir( d ) )
+        {
+            unsigned node = 0;
+
+            if( sscanf( e->d_name, "node%u", &node ) != 1 )
+            {
+                continue;
+            }
+
+            char path[sizeof( "/sys/devices/system/node//cpulist" ) + sizeof( e->d_name )];
+            snprintf( path, sizeof( path ), "/sys/devices/system/node/%s/cpulist", e->d_name );
+
+            if( FILE* f = fopen( path, "r" ) )
+            {
+                char list[4096] = { };
+
+                if( fgets( list, sizeof( list ), f ) )
+                {
+                    parse( list, node );
+                    found   = true;
+                    highest = node > highest ? node : highest;
+                }
+
+                fclose( f );
+            }
+        }
+
+        closedir( d );
+
+        if( found )
+        {
+            nodes = highest + 1;
+        }
+#endif
+    }
+
+    // cpulist is a comma separated list of cpus and ranges. i.e.: "0-3,8-11"
+    //
+    void parse(const char* list,size_t node)
+    {
+        const char* p = list;
+
+        while( *p >= '0' && *p <= '9' )
+        {
+            char*   end;
+            size_t  first   = strtoul( p, &end, 10 );
+            size_t  last    = first;
+
+            if( *end == '-' )
+            {
+                last = strtoul( end + 1, &end, 10 );
+            }
+
+            if( node_of.size() <= last )
+            {
+                node_of.resize( last + 1, 0 );
+            }
+
+            for( size_t cpu = first; cpu <= last; ++cpu )
+            {
+                node_of[cpu] = node;
+            }
+
+            p = *end == ',' ? end + 1 : end;
+        }
+    }
+
+    static const topology& get()
+    {
+        static const topology t;
+        return t;
+    }
+};
+
+}
+
+
+
+//---------------------------------------------------------------------------------------------------------------------
+//
+//
+//
+//
+size_t numa_node_count()
+{
+    return topology::get().nodes;
+}
+
+
+
+//---------------------------------------------------------------------------------------------------------------------
+//
+//
+//
+//
+size_t numa_node_of_cpu(size_t cpu)
+{
+    const topology& t = topology::get();
+
+    return cpu < t.node_of.size() ? t.node_of[cpu] : 0;
+}
+
+
+
+//---------------------------------------------------------------------------------------------------------------------
+//
+//
+//
+//
+size_t current_numa_node()
+{
+#ifdef __linux__
+    int cpu = sched_getcpu();
+
+    return cpu < 0 ? 0 : numa_node_of_cpu( cpu );
+#else
+    return 0;
+#endif
+}
+
+ENS( ee5 )
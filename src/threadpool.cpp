@@ -90,12 +90,15 @@ private:
     using qitem_t = std::unique_ptr < i_marshaled_call, deleter >;
     using work_thread_t = WorkThread < qitem_t >;
     using tvec_t = std::vector < work_thread_t >;
+    using wvec_t = std::vector < work_thread_t* >;
 
     ee5_alignas( 64 ) spin_shared_mutex_t active;
 
     mem_pool_t          mem;
     tvec_t              threads;
+    wvec_t              working;    // The threads that started, work goes to these
     size_t              t_count;
+    bool                open    = false;
 
     std::atomic_size_t  x;
 
@@ -130,7 +133,7 @@ protected:
         size_t v = std::rand() % t_count;
         //        size_t v = x%t_count;
 
-        threads[v].Enqueue( qitem_t( p, deleter( *this ) ) );
+        working[v]->Enqueue( qitem_t( p, deleter( *this ) ) );
 
         ++x;
         return s_ok();
@@ -155,7 +158,13 @@ public:
 
     void Shutdown( bool abandon = false )
     {
-        active.lock();
+        // A pool that never opened still has active locked.
+        //
+        if( open )
+        {
+            active.lock();
+            open = false;
+        }
 
         for( auto& k : threads )
         {
@@ -163,7 +172,7 @@ public:
         }
     }
 
-    void Start( size_t t = std::thread::hardware_concurrency() )
+    RC Start( size_t t = std::thread::hardware_concurrency() )
     {
         std::srand( static_cast<unsigned int>( std::time( 0 ) ) );
 
@@ -176,13 +185,43 @@ public:
             threads.push_back( work_thread_t( c, []( qitem_t& p ) { p->Execute(); } ) );
         }
 
-        // Start them.
+        // Start them. A thread that can't join the epoch domain has already quit, the pool runs
+        // on the rest. If none of them started the pool never opens. (active stays locked, so
+        // every Async is turned away.)
+        //
+        RC rc = s_ok();
+
         for( auto& s : threads )
         {
-            s.Startup();
+            RC started = s.Startup();
+
+            if( started == s_ok() )
+            {
+                working.push_back( &s );
+            }
+            else
+            {
+                rc = started;
+            }
         }
 
+        if( working.empty() )
+        {
+            threads.clear();
+            t_count = 0;
+            return rc;
+        }
+
+        if( rc != s_ok() )
+        {
+            LOG_WARNING( "%zu of %zu work threads failed to start (%016llx)", t_count - working.size(), t_count, static_cast<unsigned long long>( rc ) );
+        }
+
+        t_count = working.size();
+        open    = true;
+
         active.unlock();
+        return s_ok();
     }
 
     size_t Count()
@@ -209,10 +248,11 @@ async_call async;
 
 i_marshal_work* async_call::tp;
 
-void tp_start( size_t c )
+RC tp_start( size_t c )
 {
-    tp.Start( c );
+    RC rc = tp.Start( c );
     async.tp = &tp;
+    return rc;
 }
 void tp_stop()
 {
@@ -438,13 +438,28 @@ int main()
     {
         LOG_ALWAYS("Good day!", "");
 
+        void tst_lock_checks();
         void tst_spin_locks();
         void tst_atomic_queue();
+        void tst_atomic_stack();
+        void tst_epoch();
+        void tst_hazard();
+        void tst_logging();
         void tst_threading();
         
-        //tst_spin_locks();
+        tst_lock_checks();
+
+        //tst_spin_locks();     // Benchmarks, minutes
         
-        //tst_atomic_queue();
+        tst_atomic_queue();
+
+        tst_atomic_stack();
+
+        tst_epoch();
+
+        tst_hazard();
+
+        tst_logging();
         
         tst_threading();
 
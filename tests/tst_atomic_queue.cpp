@@ -17,16 +17,591 @@
 
 
 #include <alert_queue.h>
+#include <spsc_queue.h>
+#include <stopwatch.h>
 
 #include <array>
+#include <cassert>
+#include <cstdint>
+#include <cstring>
 #include <vector>
 #include <forward_list>
+#include <thread>
+#include <cstdio>
 
 using namespace ee5;
 
 
-void tst_atomic_queue()
+struct q_item
+{
+    q_item* next;
+    size_t  producer;
+    size_t  value;
+};
+
+
+//-------------------------------------------------------------------------------------------------
+//
+//
+//
+//
+static void tst_smp_ring_single()
+{
+    smp_c_ring_t<q_item,8>  ring;
+    std::array<q_item,10>   items;
+
+    for( size_t i = 0; i < items.size(); ++i )
+    {
+        items[i].value = i;
+    }
+
+    // Fill the ring, the last two won't fit.
+    //
+    size_t placed = 0;
+    for( auto& i : items )
+    {
+        if( ring.try_enqueue( &i ) )
+        {
+            ++placed;
+        }
+    }
+    assert( placed == 8 );
+    assert( ring.count() == 8 );
+
+    // FIFO order is maintained
+    //
+    for( size_t i = 0; i < placed; ++i )
+    {
+        q_item* p = ring.try_dequeue();
+        assert( p != nullptr && p->value == i );
+        (void)p;
+    }
+    assert( ring.try_dequeue() == nullptr );
+    assert( ring.count() == 0 );
+
+    // Bulk operations wrap around the end of the ring.
+    //
+    std::array<q_item*,10> in;
+    std::array<q_item*,10> out;
+    for( size_t i = 0; i < in.size(); ++i )
+    {
+        in[i] = &items[i];
+    }
+
+    for( size_t lap = 0; lap < 5; ++lap )
+    {
+        size_t n = ring.try_enqueue_bulk( in.data(), 5 );
+        assert( n == 5 );
+
+        n = ring.try_enqueue_bulk( in.data() + 5, 5 );
+        assert( n == 3 );
+
+        n = ring.try_dequeue_bulk( out.data(), out.size() );
+        assert( n == 8 );
+
+        for( size_t i = 0; i < n; ++i )
+        {
+            assert( out[i] == in[i] );
+        }
+    }
+}
+
+
+
+//-------------------------------------------------------------------------------------------------
+//
+//
+//
+//
+static void tst_smp_ring_threads()
 {
+    const size_t producers  = 4;
+    const size_t consumers  = 4;
+    const size_t per_thread = 100000;
+
+    // The ring is cache aligned and C++11 new doesn't honor that. The ring
+    // is "only" 64k so the stack works fine for the test.
+    //
+    smp_c_ring_t<q_item,1024>   ring;
+    std::vector<q_item>         items( producers * per_thread );
+    std::vector<std::thread>    threads;
+    std::atomic_size_t          consumed( 0 );
+    std::atomic_size_t          sum( 0 );
+
+    us_stopwatch_s sw;
 
+    for( size_t p = 0; p < producers; ++p )
+    {
+        threads.push_back( std::thread( [&,p]()
+        {
+            for( size_t i = 0; i < per_thread; ++i )
+            {
+                q_item* item    = &items[ p * per_thread + i ];
+                item->producer  = p;
+                item->value     = i;
+
+                while( !ring.try_enqueue( item ) )
+                {
+                    std::this_thread::yield();
+                }
+            }
+        } ) );
+    }
+
+    for( size_t c = 0; c < consumers; ++c )
+    {
+        threads.push_back( std::thread( [&]()
+        {
+            std::array<q_item*,16>  batch;
+            std::array<size_t,producers> last;
+            last.fill( 0 );
+
+            while( consumed.load() < items.size() )
+            {
+                size_t n = ring.try_dequeue_bulk( batch.data(), batch.size() );
+
+                for( size_t i = 0; i < n; ++i )
+                {
+                    // Items from a single producer come out in order.
+                    //
+                    assert( batch[i]->value + 1 > last[ batch[i]->producer ] );
+                    last[ batch[i]->producer ] = batch[i]->value + 1;
+                    sum += batch[i]->value;
+                }
+
+                if( n )
+                {
+                    consumed += n;
+                }
+                else
+                {
+                    std::this_thread::yield();
+                }
+            }
+        } ) );
+    }
+
+    for( auto& t : threads )
+    {
+        t.join();
+    }
+
+    assert( consumed == items.size() );
+    assert( sum == producers * ( per_thread * ( per_thread - 1 ) / 2 ) );
+    assert( ring.count() == 0 );
+
+    printf( "smp_ring    %lu x %lu items %lu us\n", producers, per_thread, sw.delta() );
 }
 
+
+
+//-------------------------------------------------------------------------------------------------
+//
+//
+//
+//
+static void tst_smp_lf_queue()
+{
+    const size_t producers  = 4;
+    const size_t consumers  = 4;
+    const size_t per_thread = 100000;
+
+    smp_lf_c_queue_t<q_item>    queue;
+    std::vector<q_item>         items( producers * per_thread );
+    std::vector<std::thread>    threads;
+    std::atomic_size_t          consumed( 0 );
+    std::atomic_size_t          sum( 0 );
+
+    assert( queue.dequeue() == nullptr );
+
+    us_stopwatch_s sw;
+
+    for( size_t p = 0; p < producers; ++p )
+    {
+        threads.push_back( std::thread( [&,p]()
+        {
+            for( size_t i = 0; i < per_thread; ++i )
+            {
+                q_item* item    = &items[ p * per_thread + i ];
+                item->producer  = p;
+                item->value     = i;
+
+                queue.enqueue( item );
+            }
+        } ) );
+    }
+
+    for( size_t c = 0; c < consumers; ++c )
+    {
+        threads.push_back( std::thread( [&]()
+        {
+            std::array<size_t,producers> last;
+            last.fill( 0 );
+
+            while( consumed.load() < items.size() )
+            {
+                q_item* p = queue.dequeue();
+
+                if( p )
+                {
+                    assert( p->value + 1 > last[ p->producer ] );
+                    last[ p->producer ] = p->value + 1;
+                    sum += p->value;
+                    ++consumed;
+                }
+                else
+                {
+                    std::this_thread::yield();
+                }
+            }
+        } ) );
+    }
+
+    for( auto& t : threads )
+    {
+        t.join();
+    }
+
+    assert( consumed == items.size() );
+    assert( sum == producers * ( per_thread * ( per_thread - 1 ) / 2 ) );
+    assert( queue.count() == 0 );
+    assert( queue.dequeue() == nullptr );
+
+    printf( "smp_lf_queue %lu x %lu items %lu us\n", producers, per_thread, sw.delta() );
+}
+
+
+
+template<typename Q>
+static void put( Q& queue, q_item* item )
+{
+    queue.enqueue( item );
+}
+
+template<typename T, size_t N, typename B>
+static void put( aq::smp_ring<T,N,B>& ring, q_item* item )
+{
+    while( !ring.try_enqueue( item ) )
+    {
+        std::this_thread::yield();
+    }
+}
+
+
+
+//-------------------------------------------------------------------------------------------------
+// Consumers sleep in dequeue_wait while producers trickle items in. Every item has to come out
+// (no lost wake ups) and an empty queue has to time out.
+//
+template<typename Q>
+static void tst_dequeue_wait( const char* name )
+{
+    using namespace std::chrono;
+
+    const size_t producers  = 2;
+    const size_t consumers  = 3;
+    const size_t per_thread = 20000;
+
+    Q                           queue;
+    std::vector<q_item>         items( producers * per_thread );
+    std::vector<std::thread>    threads;
+    std::atomic_size_t          consumed( 0 );
+    std::atomic_size_t          timeouts( 0 );
+
+    ms_stopwatch_s empty_wait;
+    assert( queue.dequeue_wait( milliseconds( 20 ) ) == nullptr );
+    assert( empty_wait.delta() >= 19 );
+
+    us_stopwatch_s sw;
+
+    for( size_t c = 0; c < consumers; ++c )
+    {
+        threads.push_back( std::thread( [&]()
+        {
+            std::array<q_item*,8> batch;
+
+            while( consumed.load() < items.size() )
+            {
+                size_t n = queue.dequeue_bulk_wait( batch.data(), batch.size(), milliseconds( 5 ) );
+
+                if( n == 0 )
+                {
+                    ++timeouts;
+                }
+                consumed += n;
+            }
+        } ) );
+    }
+
+    for( size_t p = 0; p < producers; ++p )
+    {
+        threads.push_back( std::thread( [&,p]()
+        {
+            for( size_t i = 0; i < per_thread; ++i )
+            {
+                put( queue, &items[ p * per_thread + i ] );
+
+                if( ( i & 0xFF ) == 0 )
+                {
+                    std::this_thread::sleep_for( microseconds( 50 ) );
+                }
+            }
+        } ) );
+    }
+
+    for( auto& t : threads )
+    {
+        t.join();
+    }
+
+    assert( consumed == items.size() );
+    assert( queue.dequeue_wait( milliseconds( 1 ) ) == nullptr );
+
+    printf( "%-18s dequeue_wait %lu items %lu us (%lu timeouts)\n", name, consumed.load(), sw.delta(), timeouts.load() );
+}
+
+
+
+//-------------------------------------------------------------------------------------------------
+//
+//
+//
+//
+static void tst_spsc_ring_single()
+{
+    spsc_ring<std::unique_ptr<size_t>,4> ring;
+
+    for( size_t lap = 0; lap < 3; ++lap )
+    {
+        for( size_t i = 0; i < 4; ++i )
+        {
+            bool pushed = ring.push( std::unique_ptr<size_t>( new size_t( i ) ) );
+            assert( pushed );
+            (void)pushed;
+        }
+
+        std::unique_ptr<size_t> extra( new size_t( 99 ) );
+        bool pushed = ring.push( std::move( extra ) );
+        assert( !pushed );
+        (void)pushed;
+        assert( extra && *extra == 99 );
+        assert( ring.size() == 4 );
+
+        std::array<std::unique_ptr<size_t>,8> out;
+        size_t n = ring.pop_bulk( out.data(), out.size() );
+        assert( n == 4 );
+
+        for( size_t i = 0; i < n; ++i )
+        {
+            assert( *out[i] == i );
+        }
+        assert( ring.empty() );
+    }
+
+    std::array<std::unique_ptr<size_t>,3> in;
+    for( size_t i = 0; i < in.size(); ++i )
+    {
+        in[i].reset( new size_t( i ) );
+    }
+    size_t pushed = ring.push_bulk( in.data(), in.size() );
+    assert( pushed == 3 );
+    (void)pushed;
+
+    std::unique_ptr<size_t> v;
+    bool popped = ring.pop( v );
+    assert( popped && *v == 0 );
+    (void)popped;
+}
+
+
+
+//-------------------------------------------------------------------------------------------------
+//
+//  Records of every size from 1 to 300 bytes go through a 1 KB ring, so the records wrap at
+//  every possible offset. Each record is filled with its own sequence number.
+//
+static void tst_spsc_record_ring()
+{
+    spsc_record_ring<1024> ring;
+
+    assert( ring.peek() == nullptr );
+    assert( ring.reserve( ring.max_record + 1 ) == nullptr );
+
+    const size_t count = 20000;
+
+    std::thread producer( [&ring,count]()
+    {
+        for( size_t i = 0; i < count; ++i )
+        {
+            size_t      cb = 1 + i % 300;
+            uint8_t*    p;
+
+            while( ( p = static_cast<uint8_t*>( ring.reserve( cb + sizeof( i ) ) ) ) == nullptr )
+            {
+                std::this_thread::yield();
+            }
+
+            std::memcpy( p, &i, sizeof( i ) );
+            std::memset( p + sizeof( i ), static_cast<int>( i & 0xff ), cb );
+
+            ring.commit( cb + sizeof( i ) );
+        }
+    } );
+
+    for( size_t i = 0; i < count; ++i )
+    {
+        size_t          cb;
+        const uint8_t*  p;
+
+        while( ( p = static_cast<const uint8_t*>( ring.peek( &cb ) ) ) == nullptr )
+        {
+            std::this_thread::yield();
+        }
+
+        size_t seq;
+        std::memcpy( &seq, p, sizeof( seq ) );
+
+        assert( seq == i );
+        assert( cb == sizeof( seq ) + 1 + i % 300 );
+        assert( p[cb - 1] == ( i & 0xff ) );
+
+        ring.release_record();
+    }
+
+    producer.join();
+
+    assert( ring.empty() );
+}
+
+
+
+//-------------------------------------------------------------------------------------------------
+// One producer thread handing items to one consumer thread through each of the queue types.
+// The smp_queue and smp_ring both carry the multi-producer machinery, the spsc_ring does not.
+//
+template<typename P, typename C>
+static size_t pipe_time( size_t count, P producer, C consumer )
+{
+    us_stopwatch_s sw;
+
+    std::thread c( [&]()
+    {
+        for( size_t got = 0; got < count; )
+        {
+            size_t n = consumer();
+
+            if( n == 0 )
+            {
+                std::this_thread::yield();
+            }
+            got += n;
+        }
+    } );
+
+    for( size_t i = 0; i < count; ++i )
+    {
+        producer( i );
+    }
+
+    c.join();
+
+    return sw.delta();
+}
+
+static void tst_spsc_throughput()
+{
+    const size_t count = 2000000;
+
+    std::vector<q_item>             items( 1024 );
+    smp_queue_t<q_item>             queue;
+    smp_ring_t<q_item,1024>         ring;
+    spsc_ring<q_item*,1024>         spsc;
+    spsc_blocking_ring<q_item*,1024> blocking;
+
+    std::atomic_size_t drained( 0 );
+
+    size_t t_queue = pipe_time( count,
+        [&]( size_t i )
+        {
+            // The queue is unbounded, but the items are recycled so keep the
+            // producer from lapping the consumer.
+            //
+            while( ( i & 1023 ) == 0 && drained.load( std::memory_order_acquire ) != i )
+            {
+                std::this_thread::yield();
+            }
+            queue.enqueue( &items[ i & 1023 ] );
+        },
+        [&]()->size_t
+        {
+            if( queue.dequeue() )
+            {
+                drained.fetch_add( 1, std::memory_order_release );
+                return 1;
+            }
+            return 0;
+        } );
+
+    size_t t_ring = pipe_time( count,
+        [&]( size_t i )
+        {
+            while( !ring.try_enqueue( &items[ i & 1023 ] ) )
+            {
+                std::this_thread::yield();
+            }
+        },
+        [&]()->size_t
+        {
+            std::array<q_item*,32> out;
+            return ring.try_dequeue_bulk( out.data(), out.size() );
+        } );
+
+    size_t t_spsc = pipe_time( count,
+        [&]( size_t i )
+        {
+            q_item* p = &items[ i & 1023 ];
+            while( !spsc.push( std::move( p ) ) )
+            {
+                std::this_thread::yield();
+            }
+        },
+        [&]()->size_t
+        {
+            std::array<q_item*,32> out;
+            return spsc.pop_bulk( out.data(), out.size() );
+        } );
+
+    size_t t_blocking = pipe_time( count,
+        [&]( size_t i )
+        {
+            blocking.push_wait( &items[ i & 1023 ] );
+        },
+        [&]()->size_t
+        {
+            std::array<q_item*,32> out;
+            return blocking.pop_bulk_wait( out.data(), out.size() );
+        } );
+
+    printf( "\nSingle producer -> single consumer, %lu items\n", count );
+    printf( "------------------------- ------------ ---------\n" );
+    printf( "%-25s %9lu us %6.2f M/s\n", "smp_queue_t (spin_flag)", t_queue,    count / double( t_queue ) );
+    printf( "%-25s %9lu us %6.2f M/s\n", "smp_ring_t (mpmc)",       t_ring,     count / double( t_ring ) );
+    printf( "%-25s %9lu us %6.2f M/s\n", "spsc_ring",               t_spsc,     count / double( t_spsc ) );
+    printf( "%-25s %9lu us %6.2f M/s\n", "spsc_blocking_ring",      t_blocking, count / double( t_blocking ) );
+    printf( "------------------------- ------------ ---------\n\n" );
+}
+
+
+
+void tst_atomic_queue()
+{
+    tst_smp_ring_single();
+    tst_smp_ring_threads();
+    tst_smp_lf_queue();
+    tst_dequeue_wait<smp_cv_queue_t<q_item>>( "smp_cv_queue_t" );
+    tst_dequeue_wait<smp_lf_cv_queue_t<q_item>>( "smp_lf_cv_queue_t" );
+    tst_dequeue_wait<smp_ccv_ring_t<q_item,256>>( "smp_ccv_ring_t" );
+    tst_spsc_ring_single();
+    tst_spsc_record_ring();
+    tst_spsc_throughput();
+}
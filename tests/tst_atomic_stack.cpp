@@ -1,2 +1,227 @@
+//-------------------------------------------------------------------------------------------------
+// Copyright (C) 2014 Ernest R. Ewert
+//
+// Feel free to use this as you see fit.
+// I ask that you keep my name with the code.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+// MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+// IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+// OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+// ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+// OTHER DEALINGS IN THE SOFTWARE.
+//
 
 
+
+
+#include <atomic_stack.h>
+#include <static_memory_pool.h>
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <vector>
+#include <cstdio>
+
+using namespace ee5;
+
+
+struct s_item
+{
+    s_item* next;
+    size_t  value;
+};
+
+
+//-------------------------------------------------------------------------------------------------
+//
+//
+//
+//
+static void tst_stack_bulk()
+{
+    atomic_stack<s_item>    stack;
+    std::array<s_item,10>   items;
+
+    for( size_t i = 0; i < items.size(); ++i )
+    {
+        items[i].value = i;
+    }
+
+    // Build 0 -> 1 -> ... -> 9 and push it in one go. 0 ends up on top.
+    //
+    for( size_t i = 0; i + 1 < items.size(); ++i )
+    {
+        items[i].next = &items[i+1];
+    }
+    stack.push_chain( &items.front(), &items.back() );
+
+    size_t  n = 0;
+    s_item* p = stack.pop_n( 4, &n );
+    assert( n == 4 );
+
+    for( size_t i = 0; i < 4; ++i, p = p->next )
+    {
+        assert( p != nullptr && p->value == i );
+    }
+    assert( p == nullptr );
+
+    p = stack.pop();
+    assert( p != nullptr && p->value == 4 );
+
+    p = stack.pop_n( 100, &n );
+    assert( n == 5 && p->value == 5 );
+
+    p = stack.pop_n( 1, &n );
+    assert( p == nullptr && n == 0 );
+
+    stack.push( &items[0] );
+    stack.push( &items[1] );
+
+    p = stack.pop_all();
+    assert( p == &items[1] && p->next == &items[0] && items[0].next == nullptr );
+
+    p = stack.pop();
+    assert( p == nullptr );
+}
+
+
+
+//-------------------------------------------------------------------------------------------------
+//
+//
+//
+//
+template<typename mem_pool>
+static void tst_pool_bulk()
+{
+    mem_pool                mem;
+    std::array<void*,150>   buffers;
+
+    size_t n = mem.acquire( buffers.data(), 60 );
+    assert( n == 60 );
+
+    n += mem.acquire( buffers.data() + n, buffers.size() - n );
+    assert( n == 100 );
+    assert( mem.acquire() == nullptr );
+
+    for( size_t i = 0; i < n; ++i )
+    {
+        assert( mem.is_valid_pointer( buffers[i] ) );
+        *reinterpret_cast<size_t*>( buffers[i] ) = i;
+    }
+
+    // Buffers come back zeroed.
+    //
+    size_t released = mem.release( buffers.data(), n );
+    assert( released == n );
+
+    n = mem.acquire( buffers.data(), buffers.size() );
+    assert( n == 100 );
+
+    for( size_t i = 0; i < n; ++i )
+    {
+        assert( *reinterpret_cast<size_t*>( buffers[i] ) == 0 );
+    }
+
+    int not_ours = 0;
+    buffers[0] = &not_ours;
+    released = mem.release( buffers.data(), n );
+    assert( released == n - 1 );
+    (void)released;
+}
+
+
+
+//-------------------------------------------------------------------------------------------------
+//
+//  Every thread pops an item and pushes it back. Each thread owns one item, so the stack is
+//  never empty for long and every pop has a push to meet.
+//
+template<typename S>
+static double stack_contention(size_t thread_count, size_t ops)
+{
+    S                       stack;
+    std::vector<s_item>     items( thread_count );
+    std::vector<std::thread> threads;
+    std::atomic_bool        go( false );
+
+    for( auto& i : items )
+    {
+        stack.push( &i );
+    }
+
+    for( size_t t = 0; t < thread_count; ++t )
+    {
+        threads.emplace_back( [&stack,&go,ops]()
+        {
+            while( !go.load( std::memory_order_acquire ) )
+            {
+                std::this_thread::yield();
+            }
+
+            for( size_t i = 0; i < ops; ++i )
+            {
+                s_item* item;
+
+                while( ( item = stack.pop() ) == nullptr )
+                {
+                    std::this_thread::yield();
+                }
+
+                item->value++;
+                stack.push( item );
+            }
+        });
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    go.store( true, std::memory_order_release );
+
+    for( auto& t : threads )
+    {
+        t.join();
+    }
+
+    auto    us      = std::chrono::duration_cast<std::chrono::microseconds>( std::chrono::steady_clock::now() - start ).count();
+    size_t  total   = 0;
+    size_t  count   = 0;
+
+    for( s_item* i = stack.pop(); i; i = stack.pop() )
+    {
+        total += i->value;
+        count++;
+    }
+    assert( count == thread_count && total == thread_count * ops );
+
+    return us ? ( thread_count * ops * 2 ) / static_cast<double>( us ) : 0.0;
+}
+
+
+static void tst_stack_contention()
+{
+    const size_t ops = 20000;
+
+    printf( "\n%-8s %16s %16s\n", "threads", "atomic op/us", "elimination op/us" );
+
+    for( size_t threads = 1; threads <= 64; threads *= 2 )
+    {
+        double a = stack_contention<atomic_stack<s_item>>( threads, ops );
+        double e = stack_contention<elimination_stack<s_item>>( threads, ops );
+
+        printf( "%-8zu %16.2f %16.2f\n", threads, a, e );
+    }
+}
+
+
+
+void tst_atomic_stack()
+{
+    tst_stack_bulk();
+    tst_pool_bulk<static_memory_pool<64,100>>();
+    tst_pool_bulk<static_memory_pool<64,100,cache_alignment_intel_x86_64,eliminating_stack>>();
+    tst_stack_contention();
+}
@@ -0,0 +1,353 @@
+//-------------------------------------------------------------------------------------------------
+// Copyright (C) 2014 Ernest R. Ewert
+//
+// Feel free to use this as you see fit.
+// I ask that you keep my name with the code.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+// MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+// IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+// OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+// ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+// OTHER DEALINGS IN THE SOFTWARE.
+//
+
+
+
+
+#include <epoch.h>
+#include <static_memory_pool.h>
+
+#include <atomic>
+#include <cassert>
+#include <chrono>
+#include <cstdio>
+#include <thread>
+#include <vector>
+
+using namespace ee5;
+
+
+struct e_node
+{
+    std::atomic<e_node*>    next;
+    size_t                  value;
+};
+
+typedef static_memory_pool<sizeof(e_node),64> e_pool;
+
+
+
+//-------------------------------------------------------------------------------------------------
+//
+//  A retired item waits for every online participant, and only those.
+//
+static void tst_epoch_order()
+{
+    epoch_domain        domain;
+    e_pool              pool;
+    epoch_thread        main_thread( domain );
+
+    std::atomic_int     step( 0 );
+
+    auto wait_for = [&step](int s)
+    {
+        while( step.load() != s )
+        {
+            std::this_thread::yield();
+        }
+    };
+
+    std::thread reader( [&]()
+    {
+        epoch_thread participant( domain );
+
+        step = 1;
+        wait_for( 2 );
+
+        domain.quiescent();
+
+        step = 3;
+        wait_for( 4 );
+
+        domain.offline();
+
+        step = 5;
+        wait_for( 6 );
+    });
+
+    wait_for( 1 );
+
+    void* item = pool.acquire();
+    domain.retire_to( pool, item );
+    domain.quiescent();
+
+    // The reader hasn't been quiescent since the retire.
+    //
+    assert( domain.pending() == 1 );
+
+    step = 2;
+    wait_for( 3 );
+
+    domain.synchronize();
+    assert( domain.pending() == 0 );
+
+    // An offline reader holds nothing up.
+    //
+    step = 4;
+    wait_for( 5 );
+
+    domain.retire_to( pool, pool.acquire() );
+    domain.synchronize();
+    assert( domain.pending() == 0 );
+
+    step = 6;
+    reader.join();
+}
+
+
+
+//-------------------------------------------------------------------------------------------------
+//
+//  Readers walk a list while the writer keeps replacing the head. Every node handed back to the
+//  pool is zeroed on release, so a reader that was still on a released node would see the
+//  value change under it.
+//
+static void tst_epoch_readers()
+{
+    epoch_domain            domain;
+    e_pool                  pool;
+    std::atomic<e_node*>    head( nullptr );
+    std::atomic_bool        done( false );
+    std::atomic_size_t      reads( 0 );
+    std::atomic_size_t      started( 0 );
+    std::vector<std::thread> readers;
+
+    const size_t            updates = 20000;
+
+    auto make = [&pool,&domain](size_t v) -> e_node*
+    {
+        void* p;
+
+        // Everything is in limbo, wait for the readers to let go.
+        //
+        while( ( p = pool.acquire() ) == nullptr )
+        {
+            domain.synchronize();
+        }
+
+        e_node* n = new ( p ) e_node();
+        n->next.store( nullptr );
+        n->value = v;
+        return n;
+    };
+
+    head = make( 1 );
+
+    for( size_t r = 0; r < 3; ++r )
+    {
+        readers.emplace_back( [&]()
+        {
+            epoch_thread participant( domain );
+
+            size_t count = 0;
+
+            started++;
+
+            while( !done.load( std::memory_order_relaxed ) )
+            {
+                e_node* n = head.load( std::memory_order_acquire );
+                size_t  v = n->value;
+
+                std::this_thread::yield();
+
+                assert( v != 0 && n->value == v );
+                (void)v;
+                count++;
+
+                domain.quiescent();
+            }
+
+            reads += count;
+        });
+    }
+
+    {
+        epoch_thread writer( domain );
+
+        while( started.load() < readers.size() )
+        {
+            std::this_thread::yield();
+        }
+
+        for( size_t u = 2; u <= updates; ++u )
+        {
+            e_node* old = head.exchange( make( u ), std::memory_order_acq_rel );
+
+            domain.retire_to( pool, old );
+            domain.quiescent();
+
+            if( u % 16 == 0 )
+            {
+                std::this_thread::yield();
+            }
+        }
+
+        done = true;
+
+        for( auto& t : readers )
+        {
+            t.join();
+        }
+
+        domain.synchronize();
+        assert( domain.pending() == 0 );
+    }
+
+    printf( "epoch: %zu updates, %zu reads\n", updates, reads.load() );
+}
+
+
+
+//-------------------------------------------------------------------------------------------------
+//
+//  With every record in the first block taken, the next threads get records in a chained on
+//  block, and those hold up reclamation like any other. A thread that is already in too many
+//  domains is told it didn't get in.
+//
+static void tst_epoch_full()
+{
+    epoch_domain                domain;
+    std::atomic_size_t          in( 0 );
+    std::atomic_bool            done( false );
+    std::vector<std::thread>    threads;
+
+    for( size_t t = 0; t < epoch_domain::block_records; ++t )
+    {
+        threads.emplace_back( [&]()
+        {
+            epoch_thread participant( domain );
+
+            if( participant.status() == s_ok() )
+            {
+                domain.offline();
+                in++;
+            }
+
+            while( !done.load() )
+            {
+                std::this_thread::yield();
+            }
+        });
+    }
+
+    while( in.load() != epoch_domain::block_records )
+    {
+        std::this_thread::yield();
+    }
+
+    {
+        epoch_thread        extra( domain );
+        std::atomic_int     freed( 0 );
+        std::atomic_bool    retired( false );
+
+        assert( extra.status() == s_ok() );
+        assert( domain.participating() );
+
+        std::thread writer( [&]()
+        {
+            epoch_thread participant( domain );
+
+            domain.retire( &freed, [](void* i,void*) { ++*static_cast<std::atomic_int*>( i ); } );
+            retired = true;
+            domain.synchronize();
+        });
+
+        while( !retired.load() )
+        {
+            std::this_thread::yield();
+        }
+
+        std::this_thread::sleep_for( std::chrono::milliseconds( 20 ) );
+        assert( freed.load() == 0 );
+
+        domain.quiescent();
+        writer.join();
+        assert( freed.load() == 1 );
+    }
+
+    done = true;
+
+    for( auto& t : threads )
+    {
+        t.join();
+    }
+
+    // A thread only keeps track of a handful of domains.
+    //
+    epoch_domain    d[5];
+    RC              rc      = s_ok();
+    size_t          joined  = 0;
+
+    while( joined < 5 && ( rc = d[joined].enter() ) == s_ok() )
+    {
+        joined++;
+    }
+
+    assert( joined < 5 && rc == e_overflow() );
+    assert( !d[joined].participating() );
+
+    for( auto& e : d )
+    {
+        e.leave();
+    }
+}
+
+
+
+//-------------------------------------------------------------------------------------------------
+//
+//  A thread that isn't a participant never waits on one. What it retires is freed by the
+//  participants' reclaim passes.
+//
+static void tst_epoch_orphans()
+{
+    epoch_domain        domain;
+    epoch_thread        main_thread( domain );
+    std::atomic_int     freed( 0 );
+    const int           count   = 500;
+
+    // This thread hasn't been quiescent since it got in, so none of these can be freed yet.
+    // (Waiting for them would never finish.)
+    //
+    std::thread outsider( [&]()
+    {
+        for( int i = 0; i < count; ++i )
+        {
+            domain.retire( &freed, [](void* i,void*) { ++*static_cast<std::atomic_int*>( i ); } );
+        }
+    });
+    outsider.join();
+
+    assert( freed.load() == 0 );
+    assert( domain.pending() == count );
+
+    for( int i = 0; i < 1000 && freed.load() != count; ++i )
+    {
+        domain.quiescent();
+    }
+
+    assert( freed.load() == count );
+    assert( domain.pending() == 0 );
+}
+
+
+
+void tst_epoch()
+{
+    tst_epoch_order();
+    tst_epoch_readers();
+    tst_epoch_full();
+    tst_epoch_orphans();
+}
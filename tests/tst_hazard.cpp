@@ -0,0 +1,235 @@
+//-------------------------------------------------------------------------------------------------
+// Copyright (C) 2014 Ernest R. Ewert
+//
+// Feel free to use this as you see fit.
+// I ask that you keep my name with the code.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+// MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+// IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+// OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+// ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+// OTHER DEALINGS IN THE SOFTWARE.
+//
+
+
+
+
+#include <hazard.h>
+#include <atomic_stack.h>
+#include <static_memory_pool.h>
+
+#include <atomic>
+#include <cassert>
+#include <cstdio>
+#include <memory>
+#include <thread>
+#include <vector>
+
+using namespace ee5;
+
+
+struct h_node
+{
+    h_node*     next;
+    size_t      value;
+};
+
+typedef static_memory_pool<sizeof(h_node),64> h_pool;
+
+
+
+//-------------------------------------------------------------------------------------------------
+//
+//  A retired item stays put for as long as a slot refers to it.
+//
+static void tst_hazard_order()
+{
+    hazard_domain           domain;
+    h_pool                  pool;
+    std::atomic<h_node*>    shared( pool.acquire<h_node>() );
+    std::atomic_int         step( 0 );
+
+    auto wait_for = [&step](int s)
+    {
+        while( step.load() != s )
+        {
+            std::this_thread::yield();
+        }
+    };
+
+    std::thread reader( [&]()
+    {
+        {
+            hazard_domain::guard hazards( domain );
+
+            h_node* n = hazards.protect( 0, shared );
+            assert( n != nullptr );
+            (void)n;
+
+            step = 1;
+            wait_for( 2 );
+        }
+
+        step = 3;
+    });
+
+    wait_for( 1 );
+
+    domain.retire_to( pool, shared.exchange( nullptr ) );
+    domain.collect();
+
+    assert( domain.pending() == 1 );
+
+    step = 2;
+    wait_for( 3 );
+
+    domain.collect();
+    assert( domain.pending() == 0 );
+
+    reader.join();
+}
+
+
+
+//-------------------------------------------------------------------------------------------------
+//
+//  Every thread pops a node, deletes it (through the domain) and pushes a new one. A pop that
+//  read next from a deleted node is a use after free. (Run this one under a sanitizer.)
+//
+static void tst_hazard_stack()
+{
+    hazard_domain           domain;
+    atomic_stack<h_node>    stack;
+    std::atomic_size_t      live( 0 );
+    std::atomic_size_t      popped( 0 );
+    std::vector<std::thread> threads;
+
+    const size_t            nodes   = 16;
+    const size_t            ops     = 20000;
+
+    auto make = [&live](size_t v) -> h_node*
+    {
+        live++;
+        return new h_node{ nullptr, v };
+    };
+
+    auto destroy = [](void* n,void* live)
+    {
+        delete static_cast<h_node*>( n );
+        (*static_cast<std::atomic_size_t*>( live ))--;
+    };
+
+    for( size_t n = 1; n <= nodes; ++n )
+    {
+        stack.push( make( n ) );
+    }
+
+    for( size_t t = 0; t < 4; ++t )
+    {
+        threads.emplace_back( [&]()
+        {
+            size_t count = 0;
+
+            for( size_t i = 0; i < ops; ++i )
+            {
+                hazard_domain::guard hazards( domain );
+
+                h_node* n = stack.pop( hazards );
+
+                if( n )
+                {
+                    assert( n->value != 0 );
+
+                    size_t v = n->value;
+
+                    hazards.retire( n, destroy, &live );
+                    stack.push( make( v ) );
+                    count++;
+                }
+
+                if( i % 64 == 0 )
+                {
+                    std::this_thread::yield();
+                }
+            }
+
+            popped += count;
+        });
+    }
+
+    for( auto& t : threads )
+    {
+        t.join();
+    }
+
+    domain.collect();
+    assert( domain.pending() == 0 );
+
+    size_t on_stack = 0;
+
+    while( h_node* n = stack.pop() )
+    {
+        delete n;
+        on_stack++;
+    }
+
+    assert( on_stack == nodes );
+    assert( live.load() == nodes );
+
+    printf( "hazard: %zu pops, %zu nodes\n", popped.load(), on_stack );
+}
+
+
+
+//-------------------------------------------------------------------------------------------------
+//
+//  Guards that stay alive keep their retired lists, and no one else can scan those. With enough
+//  of them (and everything they retired still in a slot) the pool runs dry, and the retire has
+//  to go to the heap instead of waiting for an entry that never comes back.
+//
+static void tst_hazard_held()
+{
+    hazard_domain           domain;
+    std::atomic_size_t      freed( 0 );
+    std::vector<std::unique_ptr<hazard_domain::guard>> held;
+    int                     item;
+
+    const size_t            guards  = 24;
+    const size_t            each    = hazard_domain::scan_threshold - 1;
+
+    auto count = [](void*,void* freed)
+    {
+        (*static_cast<std::atomic_size_t*>( freed ))++;
+    };
+
+    for( size_t g = 0; g < guards; ++g )
+    {
+        held.emplace_back( new hazard_domain::guard( domain ) );
+        held.back()->set( 0, &item );
+
+        for( size_t i = 0; i < each; ++i )
+        {
+            held.back()->retire( &item, count, &freed );
+        }
+    }
+
+    assert( guards * each > hazard_domain::retire_capacity );
+    assert( freed.load() == 0 );
+
+    held.clear();
+    domain.collect();
+
+    assert( domain.pending() == 0 );
+    assert( freed.load() == guards * each );
+}
+
+
+
+void tst_hazard()
+{
+    tst_hazard_order();
+    tst_hazard_stack();
+    tst_hazard_held();
+}
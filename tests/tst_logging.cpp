@@ -0,0 +1,1249 @@
+//-------------------------------------------------------------------------------------------------
+// Copyright (C) 2014 Ernest R. Ewert
+//
+// Feel free to use this as you see fit.
+// I ask that you keep my name with the code.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+// MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+// IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+// OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+// ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+// OTHER DEALINGS IN THE SOFTWARE.
+//
+
+
+
+
+#include <console_logger.h>
+#include <logging.h>
+#include <log_binary.h>
+#include <log_record.h>
+#include <log_ring.h>
+#include <log_sink.h>
+#include <log_timestamp.h>
+#include <stopwatch.h>
+
+#include <cassert>
+#include <cstdarg>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <signal.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+using namespace ee5;
+
+
+//-------------------------------------------------------------------------------------------------
+//
+//  The deferred output has to match what printf makes of the same call.
+//
+template<typename... A>
+static void check_format(const char* fmt,A... args)
+{
+    uint8_t encoded[log_args::max_size];
+    char    expected[512];
+    char    actual[512];
+
+    size_t cb = log_args::encode( encoded, sizeof( encoded ), args... );
+
+    snprintf( expected, sizeof( expected ), fmt, args... );
+    log_args::format( actual, sizeof( actual ), fmt, encoded, cb );
+
+    if( strcmp( expected, actual ) != 0 )
+    {
+        printf( "log_args: \"%s\" expected \"%s\" got \"%s\"\n", fmt, expected, actual );
+        assert( !"log_args::format doesn't match snprintf" );
+    }
+}
+
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wformat"
+#pragma GCC diagnostic ignored "-Wformat-security"
+#pragma GCC diagnostic ignored "-Wpragmas"
+#pragma GCC diagnostic ignored "-Wformat-truncation"
+
+static void tst_log_args_format()
+{
+    const char* name = "widget";
+    char        buffer[] = "mutable";
+    void*       where = &buffer;
+
+    check_format( "plain text", 0 );
+    check_format( "%d %i %u", -42, 17, 42u );
+    check_format( "%ld %lu %lld %llu", -1L, 2UL, -3LL, 4ULL );
+    check_format( "%zu %zd", size_t( 12345 ), ptrdiff_t( -6789 ) );
+    check_format( "%x %X %08x %#o", 0xbeefu, 0xCAFEu, 0x12u, 8u );
+    check_format( "%c%c%c", 'a', 'b', 'c' );
+    check_format( "%f %.3f %10.2e %g", 3.5, 2.0 / 3.0, 12345.678, 0.0001 );
+    check_format( "%s|%10s|%-10s|%.3s", name, name, name, name );
+    check_format( "%s %s", buffer, static_cast<const char*>( nullptr ) );
+    check_format( "%*d|%-*d|%.*f", 6, 42, 6, 42, 2, 3.14159 );
+    check_format( "%.*s", 2, name );
+    check_format( "100%% %s", name );
+    check_format( "%p", where );
+    check_format( "%p %s %p", name, buffer, buffer );
+    check_format( "%hhu %hu", 300, 70000 );
+    check_format( "%d %s", true, "" );
+
+    // Fewer arguments than conversions.
+    //
+    uint8_t encoded[log_args::max_size];
+    char    out[64];
+    size_t  cb = log_args::encode( encoded, sizeof( encoded ), 1 );
+
+    log_args::format( out, sizeof( out ), "%d %d", encoded, cb );
+    assert( strcmp( out, "1 (?)" ) == 0 );
+
+    // Output is cut short, not overrun.
+    //
+    cb = log_args::encode( encoded, sizeof( encoded ), name, name );
+    log_args::format( out, 8, "%s %s", encoded, cb );
+    assert( strcmp( out, "widget " ) == 0 );
+}
+
+#pragma GCC diagnostic pop
+
+
+
+//-------------------------------------------------------------------------------------------------
+//
+//  What the caller pays for a line: vsnprintf into a buffer (console_log) or copying the
+//  arguments (log_deferred).
+//
+static void format_now(char* out,size_t cb,const char* fmt,...)
+{
+    va_list v;
+    va_start( v, fmt );
+    vsnprintf( out, cb, fmt, v );
+    va_end( v );
+}
+
+static void tst_log_args_cost()
+{
+    const size_t    count   = 200000;
+    const char*     fmt     = " - // request %s from %p took %.3f ms (%zu bytes, status %d)";
+    const char*     host    = "host.example.com";
+    char            line[2048];
+    uint8_t         encoded[log_args::max_size];
+    size_t          sink    = 0;
+
+    us_stopwatch_d sw_text;
+
+    for( size_t i = 0; i < count; ++i )
+    {
+        format_now( line, sizeof( line ), fmt, host, static_cast<void*>( line ), i * 0.001, i, 200 );
+        sink += line[3];
+    }
+
+    double text = sw_text.delta() * 1000 / count;
+
+    us_stopwatch_d sw_deferred;
+
+    for( size_t i = 0; i < count; ++i )
+    {
+        sink += log_args::encode( encoded, sizeof( encoded ), host, static_cast<void*>( line ), i * 0.001, i, 200 );
+    }
+
+    double deferred = sw_deferred.delta() * 1000 / count;
+
+    us_stopwatch_d sw_render;
+
+    size_t cb = log_args::encode( encoded, sizeof( encoded ), host, static_cast<void*>( line ), 1.5, count, 200 );
+
+    for( size_t i = 0; i < count; ++i )
+    {
+        sink += log_args::format( line, sizeof( line ), fmt, encoded, cb );
+    }
+
+    double render = sw_render.delta() * 1000 / count;
+
+    printf( "\n%-32s %10s\n", "caller cost", "ns/line" );
+    printf( "%-32s %10.1f\n", "vsnprintf (console_log)", text );
+    printf( "%-32s %10.1f\n", "log_args::encode (deferred)", deferred );
+    printf( "%-32s %10.1f\n", "log_args::format (logger side)", render );
+    printf( "(%zu)\n", sink & 1 );
+
+    // And once all the way through the logger.
+    //
+    LOG_DEFERRED( "deferred %s %d %.2f", "line", 42, 1.5 );
+}
+
+
+
+//-------------------------------------------------------------------------------------------------
+//
+//  Every LogLine buffer is taken, and each of the overflow policies gets a turn. (The logger
+//  resets the dropped count when it reports it, so the count isn't checked here.)
+//
+static void tst_log_overflow()
+{
+    std::vector<void*> held;
+
+    while( void* p = LogLine::mem.acquire() )
+    {
+        held.push_back( p );
+    }
+
+    LogLine::set_overflow( LogLine::overflow_drop );
+    LogLine* none_dropped = LogLine::acquire();
+
+    LogLine::set_overflow( LogLine::overflow_write );
+    LogLine* none_written = LogLine::acquire();
+
+    assert( none_dropped == nullptr && none_written == nullptr );
+    (void)none_dropped; (void)none_written;
+
+    LogLine::set_overflow( LogLine::overflow_grow );
+    LogLine* grown = LogLine::acquire();
+    assert( grown != nullptr && !LogLine::mem.is_valid_pointer( grown ) );
+    LogLine::release( grown );
+
+    // Times out, and then a buffer handed back part way through the wait.
+    //
+    LogLine::set_overflow( LogLine::overflow_block, std::chrono::milliseconds( 20 ) );
+
+    us_stopwatch_s  waited;
+    LogLine*        timed_out = LogLine::acquire();
+
+    assert( timed_out == nullptr && waited.delta() >= 20000 );
+    (void)timed_out;
+
+    LogLine::set_overflow( LogLine::overflow_block, std::chrono::milliseconds( 5000 ) );
+
+    std::thread giver( [&held]()
+    {
+        std::this_thread::sleep_for( std::chrono::milliseconds( 10 ) );
+        LogLine::release( static_cast<LogLine*>( held.back() ) );
+    });
+
+    LogLine* l = LogLine::acquire();
+    assert( l == held.back() );
+    (void)l;
+    giver.join();
+
+    for( void* p : held )
+    {
+        LogLine::release( static_cast<LogLine*>( p ) );
+    }
+
+    LogLine::set_overflow( LogLine::overflow_block );
+
+    // The logger writes the dropped count into the log the next time it wakes up.
+    //
+    LOG_ALWAYS( "overflow policies done", "" );
+}
+
+
+
+//-------------------------------------------------------------------------------------------------
+//
+//
+//
+//
+static std::string slurp(const std::string& path)
+{
+    std::string text;
+    FILE*       f = fopen( path.c_str(), "rb" );
+
+    if( f )
+    {
+        char    chunk[4096];
+        size_t  n;
+
+        while( ( n = fread( chunk, 1, sizeof( chunk ), f ) ) > 0 )
+        {
+            text.append( chunk, n );
+        }
+        fclose( f );
+    }
+
+    return text;
+}
+
+
+
+static std::string scratch_path(const char* name)
+{
+    return std::string( "/tmp/ee5_" ) + name + "_" + std::to_string( getpid() ) + ".log";
+}
+
+
+
+//-------------------------------------------------------------------------------------------------
+//
+//  Everything written comes out in order, whole lines at a time, in a few system calls. With
+//  rotation the files (oldest first) put back together are the same text, and every file ends
+//  on a line.
+//
+static void tst_file_sink()
+{
+    std::string expected;
+    char        line[300];
+
+    auto lines = [&](file_sink& sink,size_t first,size_t count)
+    {
+        for( size_t n = first; n < first + count; ++n )
+        {
+            int cb = snprintf( line, sizeof( line ), "line %zu %.*s\n", n, static_cast<int>( n % 200 ), "abcdefghijklmnopqrstuvwxyzabcdefghijklmnopqrstuvwxyzabcdefghijklmnopqrstuvwxyzabcdefghijklmnopqrstuvwxyzabcdefghijklmnopqrstuvwxyzabcdefghijklmnopqrstuvwxyzabcdefghijklmnopqrstuvwxyzabcdefghijklmnopqrstuvwxyz" );
+
+            sink.write( line, cb );
+            expected.append( line, cb );
+        }
+    };
+
+    for( bool direct : { false, true } )
+    {
+        file_sink::options  o;
+        std::string         path = scratch_path( "file_sink" );
+
+        o.path          = path;
+        o.buffer_size   = 8192;
+        o.buffers       = 4;
+        o.direct        = direct;
+        o.sync          = file_sink::sync_flush;
+
+        unlink( path.c_str() );
+        expected.clear();
+
+        size_t calls;
+        {
+            file_sink sink( o );
+            assert( sink.is_open() );
+
+            lines( sink, 0, 5000 );
+            sink.flush();
+
+            assert( slurp( path ) == expected );
+
+            lines( sink, 5000, 3 );
+            calls = sink.system_calls();
+        }
+
+        // Opened again, the new lines go on the end (for O_DIRECT, rewriting the partial
+        // block at the end).
+        //
+        {
+            file_sink sink( o );
+
+            lines( sink, 5003, 1000 );
+            calls += sink.system_calls();
+        }
+
+        assert( slurp( path ) == expected );
+
+        printf( "file_sink%s: 6003 lines, %zu bytes, %zu writes\n", direct ? " (direct)" : "", expected.size(), calls );
+
+        unlink( path.c_str() );
+    }
+
+    // Rotation
+    //
+    file_sink::options  o;
+    std::string         path = scratch_path( "rotate" );
+
+    o.path          = path;
+    o.buffer_size   = 4096;
+    o.buffers       = 2;
+    o.rotate_size   = 64 * 1024;
+    o.rotate_keep   = 100;
+
+    unlink( path.c_str() );
+    expected.clear();
+    {
+        file_sink sink( o );
+
+        lines( sink, 0, 5000 );
+    }
+
+    std::string rebuilt;
+    size_t      files = 0;
+
+    for( size_t n = o.rotate_keep; n > 0; --n )
+    {
+        std::string rotated = path + "." + std::to_string( n );
+
+        if( access( rotated.c_str(), F_OK ) == 0 )
+        {
+            std::string text = slurp( rotated );
+
+            assert( !text.empty() && text.back() == '\n' );
+            assert( text.size() <= o.rotate_size + o.buffer_size * o.buffers );
+
+            rebuilt += text;
+            ++files;
+
+            unlink( rotated.c_str() );
+        }
+    }
+
+    rebuilt += slurp( path );
+    unlink( path.c_str() );
+
+    assert( files > 1 );
+    assert( rebuilt == expected );
+}
+
+
+
+//-------------------------------------------------------------------------------------------------
+//
+//  The logger writing to a file. Every line from every thread makes it into the file.
+//
+static void tst_log_to_file()
+{
+    const size_t    threads     = 4;
+    const size_t    per_thread  = 5000;
+
+    file_sink::options  o;
+    std::string         path = scratch_path( "log_to_file" );
+
+    o.path = path;
+
+    unlink( path.c_str() );
+
+    file_sink* sink = new file_sink( o );
+    assert( sink->is_open() );
+
+    ConsoleLogger::Flush();
+    ConsoleLogger::SetSink( sink );
+
+    std::vector<std::thread>    loggers;
+    ms_stopwatch_d              sw;
+
+    for( size_t t = 0; t < threads; ++t )
+    {
+        loggers.emplace_back( [t,per_thread]()
+        {
+            for( size_t n = 0; n < per_thread; ++n )
+            {
+                LOG_ALWAYS( "file sink thread %zu line %zu", t, n );
+            }
+        });
+    }
+
+    for( auto& l : loggers )
+    {
+        l.join();
+    }
+
+    ConsoleLogger::Flush();
+
+    double ms = sw.delta();
+
+    size_t writes = sink->system_calls();
+
+    ConsoleLogger::SetSink( new stdio_sink() );
+
+    std::string text    = slurp( path );
+    size_t      count   = 0;
+
+    for( size_t at = text.find( "file sink thread" ); at != std::string::npos; at = text.find( "file sink thread", at + 1 ) )
+    {
+        ++count;
+    }
+
+    unlink( path.c_str() );
+
+    printf( "log to file: %zu lines in %.3f ms, %zu writes\n", count, ms, writes );
+
+    assert( count == threads * per_thread );
+}
+
+
+
+//-------------------------------------------------------------------------------------------------
+//
+//  Lines right at the size of a line buffer. A line that only just doesn't fit is cut short
+//  like any other long line, and the rings keep going around without stepping on anything.
+//
+static void tst_log_line_limit()
+{
+    const size_t    cb_max  = LogLine::mem_pool_t::max_item_size - LogLine::msg_offset;
+    const size_t    rounds  = 200;
+
+    file_sink::options  o;
+    std::string         path = scratch_path( "log_line_limit" );
+
+    o.path = path;
+
+    unlink( path.c_str() );
+
+    ConsoleLogger::Flush();
+    ConsoleLogger::SetSink( new file_sink( o ) );
+
+    std::string lines[3];
+
+    for( size_t n = 0; n < 3; ++n )
+    {
+        // "@" + body is cb_max - 1 + n characters: fits, no room for the terminator, one over.
+        //
+        lines[n] = std::string( cb_max - 2 + n, char( 'a' + n ) );
+    }
+
+    for( size_t r = 0; r < rounds; ++r )
+    {
+        for( auto& l : lines )
+        {
+            LOG_ALWAYS( "@%s", l.c_str() );
+        }
+    }
+
+    ConsoleLogger::Flush();
+    ConsoleLogger::SetSink( new stdio_sink() );
+
+    std::string text    = slurp( path );
+    size_t      seen[3] = { };
+
+    for( size_t at = text.find( '@' ); at != std::string::npos; at = text.find( '@', at + 1 ) )
+    {
+        size_t end  = text.find( '\n', at );
+        size_t n    = text[at + 1] - 'a';
+
+        assert( end != std::string::npos && n < 3 );
+        assert( text.compare( at + 1, end - at - 1, lines[n], 0, end - at - 1 ) == 0 );
+        (void)end; (void)n;
+
+        seen[n]++;
+    }
+
+    unlink( path.c_str() );
+
+    printf( "line limit: %zu / %zu / %zu lines\n", seen[0], seen[1], seen[2] );
+
+    assert( seen[0] == rounds && seen[1] == rounds && seen[2] == rounds );
+}
+
+
+
+//-------------------------------------------------------------------------------------------------
+//
+//  The cached prefix has to give the same text as formatting every stamp from scratch, across
+//  second (and day) boundaries and before the epoch.
+//
+static void old_stamp(char* out,size_t cb,std::chrono::system_clock::time_point t)
+{
+    using namespace std::chrono;
+
+    time_t                      now     = system_clock::to_time_t( t );
+    system_clock::time_point    now_s   = system_clock::from_time_t( now );
+    char                        buf[32];
+
+    if( now_s > t )
+    {
+        now_s -= seconds( 1 );
+        now   -= 1;
+    }
+
+    std::strftime( buf, sizeof( buf ), "%Y-%m-%dT%H:%M:%S", std::gmtime( &now ) );
+    snprintf( out, cb, "%s.%06lluZ", buf, static_cast<unsigned long long>( duration_cast<microseconds>( t - now_s ).count() ) );
+}
+
+static void tst_log_timestamp()
+{
+    using namespace std::chrono;
+    using sys = system_clock;
+
+    log_timestamp   stamp;
+    char            expected[64];
+    char            actual[log_timestamp::max_size];
+
+    sys::time_point start = sys::from_time_t( 1401667199 );     // 2014-06-01T23:59:59
+
+    for( int64_t step = 0; step < 4000; ++step )
+    {
+        sys::time_point t = start + microseconds( step * 997 );
+
+        old_stamp( expected, sizeof( expected ), t );
+        size_t cb = stamp.render( actual, t );
+
+        assert( cb == strlen( actual ) );
+        assert( strcmp( expected, actual ) == 0 );
+        (void)cb;
+    }
+
+    sys::time_point early = sys::from_time_t( -1 ) + microseconds( 250 );
+
+    old_stamp( expected, sizeof( expected ), early );
+    stamp.render( actual, early );
+    assert( strcmp( actual, "1969-12-31T23:59:59.000250Z" ) == 0 );
+    assert( strcmp( expected, actual ) == 0 );
+
+    stamp.set_style( log_timestamp::iso_milli );
+    stamp.render( actual, start + microseconds( 1234567 ) );
+    assert( strcmp( actual, "2014-06-02T00:00:00.234Z" ) == 0 );
+
+    stamp.set_style( log_timestamp::raw_ns );
+    stamp.render( actual, start + nanoseconds( 5 ) );
+    assert( strcmp( actual, "1401667199000000005" ) == 0 );
+
+    // What it saves the logger thread.
+    //
+    const size_t    count   = 1000000;
+    size_t          sum     = 0;
+
+    stamp.set_style( log_timestamp::iso_micro );
+
+    ms_stopwatch_d sw_old;
+    for( size_t n = 0; n < count; ++n )
+    {
+        old_stamp( expected, sizeof( expected ), start + nanoseconds( n * 713 ) );
+        sum += expected[25];
+    }
+    double old_ns = sw_old.delta() * 1000000 / count;
+
+    ms_stopwatch_d sw_cached;
+    for( size_t n = 0; n < count; ++n )
+    {
+        sum += stamp.render( actual, start + nanoseconds( n * 713 ) );
+    }
+    double cached_ns = sw_cached.delta() * 1000000 / count;
+
+    printf( "\ntime stamp                          ns/line\n" );
+    printf( "gmtime + strftime                 %9.1f\n", old_ns );
+    printf( "log_timestamp (cached second)     %9.1f\n", cached_ns );
+    printf( "(%zu)\n", sum & 1 );
+}
+
+
+
+//-------------------------------------------------------------------------------------------------
+//
+//  A site that is off doesn't evaluate its arguments. The facility settings and the per site
+//  switch both reach sites that have already been called.
+//
+static size_t evaluated = 0;
+
+static int counted(int v)
+{
+    ++evaluated;
+    return v;
+}
+
+static void filtered_site(int v)
+{
+    LOG_DEBUG( 0x2, "filtered %d", counted( v ) );
+}
+
+static void find_filtered(const __info* site,bool,void* context)
+{
+    if( strstr( site->format, "filtered %d" ) )
+    {
+        *static_cast<const __info**>( context ) = site;
+    }
+}
+
+static void tst_log_filter()
+{
+    evaluated = 0;
+
+    // LOG_DEBUG is off by default.
+    //
+    filtered_site( 1 );
+    assert( evaluated == 0 );
+
+    log_set_level( LOG_FACILITY, level_debug );
+    filtered_site( 2 );
+    assert( evaluated == 1 );
+
+    // Not in the zone mask.
+    //
+    log_set_zones( LOG_FACILITY, 0x1 );
+    filtered_site( 3 );
+    assert( evaluated == 1 );
+
+    log_set_zones( LOG_FACILITY, log_zone_all );
+    filtered_site( 4 );
+    assert( evaluated == 2 );
+
+    // Just this site.
+    //
+    const __info* site = nullptr;
+
+    log_visit_sites( find_filtered, &site );
+    assert( site != nullptr );
+
+    log_set_site( site, false );
+    filtered_site( 5 );
+    assert( evaluated == 2 );
+
+    log_set_level( LOG_FACILITY, level_info );
+    log_set_site( site, true );
+    filtered_site( 6 );
+    assert( evaluated == 3 );
+
+    log_reset_sites();
+    filtered_site( 7 );
+    assert( evaluated == 3 );
+
+    // A site that is off costs a load and a branch.
+    //
+    const size_t    count   = 10000000;
+    ms_stopwatch_d  sw;
+
+    for( size_t n = 0; n < count; ++n )
+    {
+        LOG_DEBUG( 0x2, "never %zu", n );
+    }
+
+    printf( "\ndisabled LOG_DEBUG                  %5.2f ns/call\n", sw.delta() * 1000000 / count );
+}
+
+
+
+//-------------------------------------------------------------------------------------------------
+//
+//  Limited sites don't evaluate the arguments of the lines they turn away either. What they
+//  turned away is reported by the logger.
+//
+static void sampled_site(int v)
+{
+    LOG_SAMPLED( 10, "sampled %d", counted( v ) );
+}
+
+static void rated_site(int v)
+{
+    LOG_LIMITED( 5, "rated %d", counted( v ) );
+}
+
+static void always_site(int v)
+{
+    LOG_ALWAYS( "always %d", counted( v ) );
+}
+
+static void find_always(const __info* site,bool,void* context)
+{
+    if( strstr( site->format, "always %d" ) )
+    {
+        *static_cast<const __info**>( context ) = site;
+    }
+}
+
+static void tst_log_limit()
+{
+    file_sink::options  o;
+    std::string         path = scratch_path( "log_limit" );
+
+    o.path = path;
+    unlink( path.c_str() );
+
+    ConsoleLogger::Flush();
+    ConsoleLogger::SetSink( new file_sink( o ) );
+
+    evaluated = 0;
+
+    for( int n = 0; n < 200; ++n )
+    {
+        sampled_site( n );
+    }
+    assert( evaluated == 20 );
+
+    // A burst of 5 and nothing more for 200 ms.
+    //
+    evaluated = 0;
+
+    for( int n = 0; n < 1000; ++n )
+    {
+        rated_site( n );
+    }
+    assert( evaluated == 5 );
+
+    // A limit on a site that didn't have one, and off again.
+    //
+    const __info* site = nullptr;
+
+    evaluated = 0;
+    always_site( 0 );
+    log_visit_sites( find_always, &site );
+    assert( site != nullptr );
+
+    log_set_limit( site, log_limit::limit_every, 4 );
+
+    for( int n = 0; n < 8; ++n )
+    {
+        always_site( n );
+    }
+    assert( evaluated == 3 );
+    assert( site->limit.load()->suppressed() == 6 );
+
+    log_set_limit( site, log_limit::limit_every, 0 );
+    always_site( 0 );
+    assert( evaluated == 4 );
+
+    // Bursts worth more than 4.29 seconds of tokens.
+    //
+    const std::uint32_t bursts[][2] = { { 1, 5 }, { 2, 20 } };
+
+    for( auto& b : bursts )
+    {
+        log_set_limit( site, log_limit::limit_rate, b[0], b[1] );
+        evaluated = 0;
+
+        for( int n = 0; n < 100; ++n )
+        {
+            always_site( n );
+        }
+        assert( evaluated == b[1] );
+    }
+    log_set_limit( site, log_limit::limit_every, 0 );
+
+    // Filtering doesn't apply to an ALWAYS site, and turning it off doesn't lift its limit.
+    //
+    log_set_limit( site, log_limit::limit_every, 4 );
+    log_set_zones( nullptr, 0 );
+    log_set_site( site, false );
+
+    evaluated = 0;
+
+    for( int n = 0; n < 8; ++n )
+    {
+        always_site( n );
+    }
+    assert( evaluated == 2 );
+
+    bool on = false;
+
+    log_visit_sites( [](const __info* s,bool on,void* context)
+    {
+        if( strstr( s->format, "always %d" ) )
+        {
+            *static_cast<bool*>( context ) = on;
+        }
+    }, &on );
+    assert( on );
+
+    log_set_limit( site, log_limit::limit_every, 0 );
+    log_reset_sites();
+    log_set_zones( nullptr, log_zone_all );
+
+    // The report is held back until a second after the last one.
+    //
+    std::this_thread::sleep_for( std::chrono::milliseconds( 1100 ) );
+    LOG_ALWAYS( "%s", "wake the logger" );
+
+    ConsoleLogger::Flush();
+    ConsoleLogger::SetSink( new stdio_sink() );
+
+    std::string         text = slurp( path );
+    unsigned long long  sampled = 0;
+    unsigned long long  rated   = 0;
+
+    unlink( path.c_str() );
+
+    for( size_t at = text.find( "// " ); at != std::string::npos; at = text.find( "// ", at + 1 ) )
+    {
+        unsigned long long count;
+        char               where[256];
+
+        if( sscanf( text.c_str() + at, "// %llu log lines suppressed at %255[^\n]", &count, where ) == 2 )
+        {
+            sampled += strstr( where, "sampled_site" ) ? count : 0;
+            rated   += strstr( where, "rated_site" ) ? count : 0;
+        }
+    }
+
+    assert( sampled == 180 );
+    assert( rated == 995 );
+
+    // What a sampled site costs when the line is turned away.
+    //
+    const size_t    count   = 10000000;
+    ms_stopwatch_d  sw;
+
+    for( size_t n = 0; n < count; ++n )
+    {
+        LOG_SAMPLED( 1000000, "sampled %zu", n );
+    }
+
+    printf( "\nLOG_SAMPLED (turned away)          %5.2f ns/call\n", sw.delta() * 1000000 / count );
+}
+
+
+//-------------------------------------------------------------------------------------------------
+//
+//  Rows come out the same however the payload is split up. Through the logger, every byte of
+//  a payload in the ring, and of one spread over a chain of pool buffers, can be read back out
+//  of the hex dump.
+//
+static void collect_rows(const char* row,size_t cb,void* context)
+{
+    static_cast<std::string*>( context )->append( row, cb );
+}
+
+static std::string render(binary_renderer::style style,const char* data,size_t cb,size_t piece)
+{
+    std::string     rows;
+    binary_renderer dump( style, collect_rows, &rows );
+
+    for( size_t at = 0; at < cb; at += piece )
+    {
+        dump.add( data + at, std::min( piece, cb - at ) );
+    }
+    dump.finish();
+
+    return rows;
+}
+
+static void tst_log_binary()
+{
+    const char* request = "GET / HTTP/1.1\r\nHost: x\r\n";
+
+    std::string hex = render( binary_renderer::hex, request, strlen( request ), 1000 );
+
+    assert( hex ==  "    00000000: 47 45 54 20 2f 20 48 54 54 50 2f 31 2e 31 0d 0a  |GET / HTTP/1.1..|\n"
+                    "    00000010: 48 6f 73 74 3a 20 78 0d 0a                       |Host: x..|\n" );
+
+    for( size_t piece = 1; piece < 20; ++piece )
+    {
+        assert( render( binary_renderer::hex, request, strlen( request ), piece ) == hex );
+    }
+
+    assert( render( binary_renderer::base64, "Man", 3, 1 ) == "    TWFu\n" );
+    assert( render( binary_renderer::base64, "Ma", 2, 1 ) == "    TWE=\n" );
+    assert( render( binary_renderer::base64, "M", 1, 1 ) == "    TQ==\n" );
+
+    // Through the logger
+    //
+    file_sink::options  o;
+    std::string         path = scratch_path( "log_binary" );
+
+    o.path = path;
+    unlink( path.c_str() );
+
+    const size_t            sizes[] = { 100, 20000, 100000 };
+    std::vector<uint8_t>    payload( 100000 );
+
+    for( size_t n = 0; n < payload.size(); ++n )
+    {
+        payload[n] = static_cast<uint8_t>( n * 7 + n / 256 );
+    }
+
+    ConsoleLogger::Flush();
+    ConsoleLogger::SetSink( new file_sink( o ) );
+
+    for( size_t cb : sizes )
+    {
+        LOG_BINARY( 0x1, cb, payload.data(), "payload of %zu", cb );
+    }
+
+    ConsoleLogger::Flush();
+    ConsoleLogger::SetSink( new stdio_sink() );
+
+    std::string text = slurp( path );
+    unlink( path.c_str() );
+
+    // Each dump follows its line, and reads back to the payload.
+    //
+    size_t at = 0;
+
+    for( size_t cb : sizes )
+    {
+        char title[64];
+        snprintf( title, sizeof( title ), "payload of %zu\n", cb );
+
+        at = text.find( title, at );
+        assert( at != std::string::npos );
+        at = text.find( '\n', at ) + 1;
+
+        std::vector<uint8_t> back;
+
+        while( at < text.size() && text.compare( at, 4, "    " ) == 0 )
+        {
+            size_t          eol     = text.find( '\n', at );
+            const char*     row     = text.c_str() + text.find( ": ", at ) + 2;
+            unsigned        byte;
+
+            for( size_t n = 0; n < binary_renderer::hex_row && sscanf( row + n * 3, "%2x", &byte ) == 1 && row[n * 3] != ' '; ++n )
+            {
+                back.push_back( static_cast<uint8_t>( byte ) );
+            }
+
+            at = eol + 1;
+        }
+
+        assert( back.size() == cb );
+        assert( memcmp( back.data(), payload.data(), cb ) == 0 );
+    }
+
+    printf( "log binary: %zu bytes of dump\n", text.size() );
+
+    // overflow_write with the pool empty. The line is written from the caller's stack with as
+    // much of the payload as fits, and a short line isn't a dropped line.
+    //
+    unlink( path.c_str() );
+
+    ConsoleLogger::SetSink( new file_sink( o ) );
+    ConsoleLogger::Flush();
+
+    std::vector<void*> held;
+
+    while( void* p = LogLine::mem.acquire() )
+    {
+        held.push_back( p );
+    }
+
+    size_t dropped = LogLine::dropped.load();
+
+    LogLine::set_overflow( LogLine::overflow_write );
+
+    LOG_BINARY( 0x1, payload.size(), payload.data(), "payload on the %s", "stack" );
+
+    // One buffer for the line itself, none for the rest of the payload. Still not a drop.
+    //
+    LogLine::set_overflow( LogLine::overflow_drop );
+    LogLine::release( static_cast<LogLine*>( held.back() ) );
+    held.pop_back();
+
+    LOG_BINARY( 0x1, payload.size(), payload.data(), "payload in %s buffer", "one" );
+
+    LogLine::set_overflow( LogLine::overflow_block );
+
+    assert( LogLine::dropped.load() == dropped );
+    (void)dropped;
+
+    for( void* p : held )
+    {
+        LogLine::release( static_cast<LogLine*>( p ) );
+    }
+
+    ConsoleLogger::Flush();
+    ConsoleLogger::SetSink( new stdio_sink() );
+
+    text = slurp( path );
+    unlink( path.c_str() );
+
+    assert( text.find( "payload on the stack\n" ) != std::string::npos );
+    assert( text.find( "payload in one buffer\n" ) != std::string::npos );
+    assert( text.find( "of 100000 bytes, the log buffers ran out)" ) != std::string::npos );
+}
+
+
+
+//-------------------------------------------------------------------------------------------------
+//
+//  Records render the values with the types they were captured with. What doesn't fit is
+//  left off whole, the JSON is still a line of JSON. Through the logger, in both styles.
+//
+template<typename... A>
+static std::string json(size_t cb,const __info* i,A... args)
+{
+    uint8_t             encoded[log_args::max_size];
+    size_t              cb_args = log_args::encode( encoded, sizeof( encoded ), args... );
+    std::vector<char>   out( cb );
+
+    return std::string( out.data(), log_record::render_json( out.data(), cb, i, "T", 7, encoded, cb_args ) );
+}
+
+static void tst_log_record()
+{
+    static const __info site = { 0, "f", "F", "f.cpp", "done", "method, status,elapsed,where,none", 12, log_zone_all, level_info, {}, {}, nullptr };
+
+    const char* head = "{\"time\":\"T\",\"facility\":\"F\",\"thread\":7,\"function\":\"f\",\"file\":\"f.cpp\",\"line\":12,\"msg\":\"done\"";
+
+    assert( json( 1024, &site, "GET", 200, 1.5, static_cast<const void*>( nullptr ), -3 ) ==
+            std::string( head ) + ",\"method\":\"GET\",\"status\":200,\"elapsed\":1.5,\"where\":null,\"none\":-3}\n" );
+
+    // Escapes, a double that isn't a number, and values that never made it.
+    //
+    assert( json( 1024, &site, "a\"b\\c\n\x01", 0.0 / 0.0 ) ==
+            std::string( head ) + ",\"method\":\"a\\\"b\\\\c\\n\\u0001\",\"status\":null,\"elapsed\":null,\"where\":null,\"none\":null}\n" );
+
+    // Cut short
+    //
+    std::string whole = json( 1024, &site, "GET", 200u, 1.5, &site, 4 );
+
+    for( size_t cb = strlen( head ) + 2; cb < whole.size(); ++cb )
+    {
+        std::string part = json( cb, &site, "GET", 200u, 1.5, &site, 4 );
+
+        assert( part.size() <= cb && part.back() == '\n' && part[part.size() - 2] == '}' );
+        assert( whole.compare( 0, part.size() - 2, part, 0, part.size() - 2 ) == 0 );
+        assert( part.size() == strlen( head ) + 2 || whole[part.size() - 2] == ',' );
+    }
+
+    // Through the logger
+    //
+    file_sink::options  o;
+    std::string         path = scratch_path( "log_record" );
+
+    o.path = path;
+    unlink( path.c_str() );
+
+    ConsoleLogger::Flush();
+    ConsoleLogger::SetSink( new file_sink( o ) );
+
+    LOG_RECORD( 0x1, "request done", "method,status,elapsed_ms", "GET", 200, 1.25 );
+
+    ConsoleLogger::Flush();
+    ConsoleLogger::SetRecordStyle( log_record::binary );
+
+    LOG_RECORD( 0x1, "binary record", "id,name", 42u, "widget" );
+
+    ConsoleLogger::Flush();
+    ConsoleLogger::SetRecordStyle( log_record::json );
+    ConsoleLogger::SetSink( new stdio_sink() );
+
+    std::string text = slurp( path );
+    unlink( path.c_str() );
+
+    size_t at   = text.find( "\"msg\":\"request done\"" );
+    size_t eol  = text.find( '\n', at );
+
+    assert( at != std::string::npos && eol != std::string::npos );
+    (void)eol;
+    assert( text.compare( at, eol - at, "\"msg\":\"request done\",\"method\":\"GET\",\"status\":200,\"elapsed_ms\":1.25}" ) == 0 );
+
+    // The fields of the binary frame follow its msg.
+    //
+    at = text.find( "binary record" );
+    assert( at != std::string::npos );
+
+    const uint8_t* p = reinterpret_cast<const uint8_t*>( text.data() ) + at + strlen( "binary record" );
+    uint64_t       v;
+    uint16_t       n;
+
+    assert( *p++ == 2 );
+    assert( *p++ == 2 && memcmp( p, "id", 2 ) == 0 );
+    p += 2;
+    assert( *p++ == log_args::arg_unsigned );
+    memcpy( &v, p, sizeof( v ) );
+    assert( v == 42 );
+    p += sizeof( v );
+    assert( *p++ == 4 && memcmp( p, "name", 4 ) == 0 );
+    p += 4;
+    assert( *p++ == log_args::arg_string );
+    memcpy( &n, p, sizeof( n ) );
+    assert( n == 6 && memcmp( p + sizeof( n ), "widget", 6 ) == 0 );
+
+    printf( "log record: %s", text.substr( text.find( "{\"time\"" ), text.find( '\n', text.find( "{\"time\"" ) ) - text.find( "{\"time\"" ) + 1 ).c_str() );
+}
+
+
+//-------------------------------------------------------------------------------------------------
+//
+//  A child logs into a ring and is killed outright, nothing gets a chance to flush. The
+//  parent reads the ring back from the file.
+//
+static void tst_log_ring()
+{
+    std::string path    = scratch_path( "log_ring" );
+    const int   lines   = 1000;
+
+    unlink( path.c_str() );
+
+    // The logger thread keeps running across the fork. (The log filter holds fork off while
+    // its lock is taken, so the child never starts with it locked.)
+    //
+    ConsoleLogger::Flush();
+
+    pid_t child = fork();
+
+    if( child == 0 )
+    {
+        MappedLogRing::options o;
+
+        o.path  = path;
+        o.slots = 64;
+
+        if( MappedLogRing::Install( o ) < 0 )
+        {
+            _exit( 1 );
+        }
+
+        for( int n = 1; n <= lines; ++n )
+        {
+            LOG_ALWAYS( "ring line %d", n );
+        }
+
+        LOG_DEFERRED( "deferred %d %s", lines + 1, "after" );
+
+        const char payload[] = "0123456789abcdef0123456789abcdef0123456789abcdef0123456789abcdef"
+                               "0123456789abcdef0123456789abcdef0123456789abcdef0123456789abcdef";
+
+        LOG_BINARY( 0x1, sizeof( payload ) - 1, payload, "binary %d", lines + 2 );
+        LOG_RECORD( 0x1, "ring record", "n", lines + 3 );
+
+        kill( getpid(), SIGKILL );
+        _exit( 1 );
+    }
+
+    int status = 0;
+
+    waitpid( child, &status, 0 );
+    assert( WIFSIGNALED( status ) && WTERMSIG( status ) == SIGKILL );
+
+    FILE* out = tmpfile();
+
+    RC dumped   = MappedLogRing::Dump( path.c_str(), 11, out );
+    RC missing  = MappedLogRing::Dump( "/nonexistent/ring", 10, out );
+
+    assert( dumped == s_ok() && missing < 0 );
+    (void)dumped; (void)missing;
+
+    std::string text;
+    char        buffer[512];
+
+    rewind( out );
+
+    while( fgets( buffer, sizeof( buffer ), out ) )
+    {
+        text += buffer;
+    }
+
+    fclose( out );
+    unlink( path.c_str() );
+
+    // The last lines, in order, then the deferred line, the dump and the record.
+    //
+    size_t at = 0;
+
+    for( int n = lines - 7; n <= lines; ++n )
+    {
+        char line[32];
+        snprintf( line, sizeof( line ), "ring line %d\n", n );
+
+        at = text.find( line, at );
+        assert( at != std::string::npos );
+    }
+
+    assert( text.find( "ring line 992\n" ) == std::string::npos );
+
+    at = text.find( "deferred 1001 after\n", at );
+    assert( at != std::string::npos );
+
+    at = text.find( "binary 1002\n", at );
+    assert( at != std::string::npos );
+
+    at = text.find( "    00000070: 30 31 32 33", at );
+    assert( at != std::string::npos );
+
+    at = text.find( "\"msg\":\"ring record\",\"n\":1003}\n", at );
+    assert( at != std::string::npos );
+
+    printf( "log ring: %d lines survived a kill\n", lines );
+}
+
+
+
+void tst_logging()
+{
+    tst_log_args_format();
+    tst_log_args_cost();
+    tst_log_timestamp();
+    tst_log_filter();
+    tst_log_limit();
+    tst_log_overflow();
+    tst_file_sink();
+    tst_log_to_file();
+    tst_log_line_limit();
+    tst_log_binary();
+    tst_log_record();
+    tst_log_ring();
+}
@@ -18,15 +18,25 @@
 #include <cstdio>
 #include <stopwatch.h>
 #include <spin_locking.h>
+#include <lock_profile.h>
+#include <thread_support.h>
 #include <marshaling.h>
 
 
 #include <algorithm>
+#include <atomic>
+#include <cassert>
+#include <chrono>
 #include <mutex>
 #include <numeric>
 #include <cstdio>
 #include <vector>
 #include <array>
+#include <cstring>
+#include <functional>
+#include <iterator>
+#include <string>
+#include <thread>
 #include <unordered_map>
 
 using namespace ee5;
@@ -100,6 +110,23 @@ size_t time_it( T f )
     return start.delta();
 }
 
+// The lock names get long with the policies, drop the namespaces for the table.
+//
+static std::string short_name(const char* name)
+{
+    std::string n( name );
+
+    for( const char* ns : { "ee5::", "std::" } )
+    {
+        for( size_t at = n.find( ns ); at != std::string::npos; at = n.find( ns ) )
+        {
+            n.erase( at, strlen( ns ) );
+        }
+    }
+
+    return n;
+}
+
 namespace ee5 { size_t work_thread_id(); }
 template<typename L>
 stats lock_test(i_marshal_work* p,size_t iterations,size_t inner)
@@ -207,22 +234,447 @@ stats lock_test(i_marshal_work* p,size_t iterations,size_t inner)
 
 
 
+//-------------------------------------------------------------------------------------------------
+//
+//  Reader traffic never lets up, one writer takes the lock over and over. The time it takes the
+//  writer to get in shows how each reader / writer mode treats writers. (A TP::Shutdown against
+//  a steady stream of Async calls.)
+//
+template<typename L>
+static void rw_writer_latency(const char* name,size_t readers,size_t writes)
+{
+    L                           lock;
+    std::atomic_bool            done( false );
+    std::atomic_size_t          reads( 0 );
+    std::vector<std::thread>    threads;
+    std::vector<size_t>         times;
+
+    times.reserve( writes );
+
+    for( size_t r = 0; r < readers; ++r )
+    {
+        threads.emplace_back( [&]()
+        {
+            size_t count = 0;
+
+            while( !done.load( std::memory_order_relaxed ) )
+            {
+                lock.lock_shared();
+                count++;
+                lock.unlock_shared();
+            }
+
+            reads += count;
+        });
+    }
+
+    for( size_t w = 0; w < writes; ++w )
+    {
+        times.push_back( time_it( [&] { lock.lock(); } ) );
+        lock.unlock();
+
+        std::this_thread::yield();
+    }
+
+    done = true;
+
+    for( auto& t : threads )
+    {
+        t.join();
+    }
+
+    sort( times );
+
+    auto pct = [&times](size_t p) { return times[ ( times.size() - 1 ) * p / 100 ]; };
+
+    printf( "%-18s %7zu %7zu %7zu %7zu %9zu %12zu\n", name, pct( 50 ), pct( 90 ), pct( 99 ), times.back(), writes, reads.load() );
+}
+
+
+static void tst_rw_modes()
+{
+    using yield     = backoff_yield<>;
+    using rw_traits = std::conditional<is_64_bit::value,is_64_bit,is_32_bit>::type;
+
+    size_t readers  = std::max<size_t>( 3, std::thread::hardware_concurrency() - 1 );
+    size_t writes   = 2000;
+
+    printf( "\nWriter latency with %zu readers\n\n", readers );
+    printf( "mode                   p50     p90     p99     max    writes        reads\n" );
+    printf( "------------------ ------- ------- ------- ------- --------- ------------\n" );
+
+    rw_writer_latency<spin_reader_writer_lock<rw_traits,yield,rw_prefer_readers>>( "prefer readers", readers, writes );
+    rw_writer_latency<spin_reader_writer_lock<rw_traits,yield,rw_prefer_writers>>( "prefer writers", readers, writes );
+    rw_writer_latency<spin_reader_writer_lock<rw_traits,yield,rw_phase_fair>>    ( "phase fair",     readers, writes );
+
+    printf( "------------------ ------- ------- ------- ------- --------- ------------\n" );
+    printf( "                   ^^^^^^^^microseconds^^^^^^^^^\n\n" );
+}
+
+
+// try_lock_for gives up while a reader holds on.
+//
+static void tst_rw_try()
+{
+    using yield     = backoff_yield<>;
+    using rw_traits = std::conditional<is_64_bit::value,is_64_bit,is_32_bit>::type;
+
+    spin_reader_writer_lock<rw_traits,yield,rw_phase_fair> pf;
+    spin_shared_mutex_t                                    wp;
+
+    pf.lock_shared();
+    wp.lock_shared();
+
+    bool pf_write   = pf.try_lock_for( std::chrono::milliseconds( 1 ) );
+    bool wp_write   = wp.try_lock_for( std::chrono::milliseconds( 1 ) );
+    bool pf_read    = pf.try_lock_shared_for( std::chrono::milliseconds( 1 ) );
+    assert( !pf_write && !wp_write && pf_read );
+
+    pf.unlock_shared();
+    pf.unlock_shared();
+    wp.unlock_shared();
+
+    pf_write    = pf.try_lock_for( std::chrono::milliseconds( 1 ) );
+    wp_write    = wp.try_lock_for( std::chrono::milliseconds( 1 ) );
+    assert( pf_write && wp_write );
+
+    pf_read         = pf.try_lock_shared();
+    bool wp_read    = wp.try_lock_shared();
+    assert( !pf_read && !wp_read );
+    (void)pf_write; (void)wp_write; (void)pf_read; (void)wp_read;
+
+    pf.unlock();
+    wp.unlock();
+}
+
+
+
+//-------------------------------------------------------------------------------------------------
+//
+//  The try_ paths of the phase fair lock have to back out without ever letting a writer in
+//  next to a reader. Writers (some blocking, some trying) and readers (the same) go at one lock
+//  and check that they never overlap.
+//
+static void tst_phase_fair_try()
+{
+    using rw_traits = std::conditional<is_64_bit::value,is_64_bit,is_32_bit>::type;
+
+    spin_reader_writer_lock<rw_traits,backoff_yield<>,rw_phase_fair> lock;
+
+    std::atomic_int             readers( 0 );
+    std::atomic_int             writers( 0 );
+    std::atomic_size_t          reads( 0 );
+    std::atomic_size_t          writes( 0 );
+    std::vector<std::thread>    threads;
+
+    const size_t                ops = 100000;
+
+    for( size_t t = 0; t < 4; ++t )
+    {
+        threads.emplace_back( [&,t]()
+        {
+            bool blocking = ( t & 1 ) == 0;
+
+            for( size_t i = 0; i < ops; ++i )
+            {
+                if( ( i + t ) % 8 == 0 )
+                {
+                    bool got = true;
+
+                    if( blocking )
+                    {
+                        lock.lock();
+                    }
+                    else
+                    {
+                        got = lock.try_lock();
+                    }
+
+                    if( got )
+                    {
+                        int w = ++writers;
+                        int r = readers.load();
+                        assert( w == 1 && r == 0 );
+                        (void)w; (void)r;
+
+                        writes++;
+                        writers--;
+                        lock.unlock();
+                    }
+                }
+                else
+                {
+                    bool got = true;
+
+                    if( blocking )
+                    {
+                        lock.lock_shared();
+                    }
+                    else
+                    {
+                        got = lock.try_lock_shared();
+                    }
+
+                    if( got )
+                    {
+                        readers++;
+                        int w = writers.load();
+                        assert( w == 0 );
+                        (void)w;
+
+                        reads++;
+                        readers--;
+                        lock.unlock_shared();
+                    }
+                }
+            }
+        });
+    }
+
+    for( auto& t : threads )
+    {
+        t.join();
+    }
+
+    // Every back out left the counts straight.
+    //
+    bool idle = lock.try_lock();
+    assert( idle );
+    (void)idle;
+    lock.unlock();
+
+    printf( "phase fair try: %zu reads, %zu writes\n", reads.load(), writes.load() );
+}
+
+
+
+//-------------------------------------------------------------------------------------------------
+//
+//  Readers hammer a snapshot that a single writer changes now and then. Every snapshot the
+//  readers see must be whole.
+//
+struct snapshot
+{
+    size_t  version;
+    size_t  items[6];
+    double  ratio;
+};
+
+static inline bool whole(const snapshot& s)
+{
+    for( size_t i : s.items )
+    {
+        if( i != s.version )
+        {
+            return false;
+        }
+    }
+    return s.ratio == s.version / 2.0;
+}
+
+static snapshot make_snapshot(size_t v)
+{
+    snapshot s;
+    s.version = v;
+    std::fill( std::begin( s.items ), std::end( s.items ), v );
+    s.ratio = v / 2.0;
+    return s;
+}
+
+template<typename R>
+static void snapshot_reads(const char* name,size_t readers,size_t updates,R read_one,std::function<void(size_t)> write_one)
+{
+    std::atomic_bool            done( false );
+    std::atomic_size_t          reads( 0 );
+    std::vector<std::thread>    threads;
+    us_stopwatch_s              sw;
+
+    for( size_t r = 0; r < readers; ++r )
+    {
+        threads.emplace_back( [&]()
+        {
+            size_t count = 0;
+
+            while( !done.load( std::memory_order_relaxed ) )
+            {
+                snapshot s = read_one();
+                assert( whole( s ) );
+                (void)s;
+                count++;
+            }
+
+            reads += count;
+        });
+    }
+
+    for( size_t u = 1; u <= updates; ++u )
+    {
+        write_one( u );
+        std::this_thread::sleep_for( std::chrono::microseconds( 100 ) );
+    }
+
+    done = true;
+
+    for( auto& t : threads )
+    {
+        t.join();
+    }
+
+    size_t us = sw.delta();
+
+    printf( "%-18s %12zu %9.2f\n", name, reads.load(), reads.load() / double( us ? us : 1 ) );
+}
+
+
+static void tst_seqlock()
+{
+    size_t readers = std::max<size_t>( 3, std::thread::hardware_concurrency() - 1 );
+    size_t updates = 1000;
+
+    seqlock_value<snapshot>     sv( make_snapshot( 0 ) );
+    spin_shared_mutex_t         rw;
+    snapshot                    guarded = make_snapshot( 0 );
+
+    printf( "\nSnapshot reads with %zu readers\n\n", readers );
+    printf( "lock                      reads   M/s    \n" );
+    printf( "------------------ ------------ ---------\n" );
+
+    snapshot_reads( "seqlock_value", readers, updates,
+        [&sv]() { return sv.load(); },
+        [&sv](size_t v) { sv.store( make_snapshot( v ) ); } );
+
+    snapshot_reads( "spin_shared_mutex", readers, updates,
+        [&]() { rw.lock_shared(); snapshot s = guarded; rw.unlock_shared(); return s; },
+        [&](size_t v) { rw.lock(); guarded = make_snapshot( v ); rw.unlock(); } );
+
+    printf( "------------------ ------------ ---------\n\n" );
+
+    sv.update( [](snapshot& s) { s = make_snapshot( s.version + 1 ); } );
+    assert( sv.load().version == updates + 1 && whole( sv.load() ) );
+}
+
+
+
+//-------------------------------------------------------------------------------------------------
+//
+//  Every thread bumps a plain counter under the lock (with the odd try_lock mixed in). If the
+//  lock ever lets two threads in, increments go missing.
+//
+template<typename L>
+static void lost_increments(size_t ops)
+{
+    L                           lock;
+    size_t                      count = 0;
+    std::vector<std::thread>    threads;
+
+    const size_t                thread_count    = 4;
+
+    for( size_t t = 0; t < thread_count; ++t )
+    {
+        threads.emplace_back( [&]()
+        {
+            for( size_t i = 0; i < ops; ++i )
+            {
+                if( i % 16 == 0 )
+                {
+                    while( !lock.try_lock() )
+                    {
+                        std::this_thread::yield();
+                    }
+                }
+                else
+                {
+                    lock.lock();
+                }
+
+                count++;
+                lock.unlock();
+            }
+        });
+    }
+
+    for( auto& t : threads )
+    {
+        t.join();
+    }
+
+    assert( count == thread_count * ops );
+}
+
+static void tst_queue_locks()
+{
+    lost_increments<ticket_lock>( 50000 );
+    lost_increments<basic_ticket_lock<backoff_yield<>>>( 50000 );
+    lost_increments<mcs_lock>( 50000 );
+    lost_increments<basic_mcs_lock<backoff_yield<>>>( 50000 );
+}
+
+static void tst_cohort()
+{
+    printf( "NUMA nodes: %zu (this thread on node %zu)\n", numa_node_count(), current_numa_node() );
+    assert( numa_node_count() >= 1 && current_numa_node() < numa_node_count() );
+
+    lost_increments<cohort_lock<>>( 50000 );
+}
+
+
+
+//-------------------------------------------------------------------------------------------------
+//
+//  The checks that run with the suite. tst_spin_locks is the benchmark table, which takes too
+//  long to run every time.
+//
+void tst_lock_checks()
+{
+    tst_rw_try();
+    tst_phase_fair_try();
+    tst_seqlock();
+    tst_queue_locks();
+    tst_cohort();
+}
+
+
+
 void tst_spin_locks()
 {
     size_t concurrency  = std::thread::hardware_concurrency();
     size_t iterations = 10000000;// 0;
     size_t work_loop    = 200;
 
+    tst_rw_modes();
+
     tp_start(concurrency);
 
     
-    std::array<std::function<stats()>,5> tests;
-
-    tests[0] = std::bind( lock_test<std::mutex>,          async, iterations, work_loop );
-    tests[1] = std::bind( lock_test<spin_native>,         async, iterations, work_loop );
-    tests[2] = std::bind( lock_test<spin_mutex>,          async, iterations, work_loop );
-    tests[3] = std::bind( lock_test<spin_flag>,           async, iterations, work_loop );
-    tests[4] = std::bind( lock_test<spin_shared_mutex_t>, async, iterations, work_loop );
+    using exponential = backoff_exponential<>;
+    using yield       = backoff_yield<>;
+    using rw_traits   = std::conditional<is_64_bit::value,is_64_bit,is_32_bit>::type;
+
+    std::array<std::function<stats()>,23> tests;
+
+    tests[ 0] = std::bind( lock_test<std::mutex>,                                              async, iterations, work_loop );
+    tests[ 1] = std::bind( lock_test<spin_native>,                                             async, iterations, work_loop );
+    tests[ 2] = std::bind( lock_test<basic_spin_mutex<backoff_none>>,                          async, iterations, work_loop );
+    tests[ 3] = std::bind( lock_test<basic_spin_mutex<backoff_pause>>,                         async, iterations, work_loop );
+    tests[ 4] = std::bind( lock_test<basic_spin_mutex<exponential>>,                           async, iterations, work_loop );
+    tests[ 5] = std::bind( lock_test<basic_spin_mutex<yield>>,                                 async, iterations, work_loop );
+    tests[ 6] = std::bind( lock_test<basic_spin_flag<backoff_none>>,                           async, iterations, work_loop );
+    tests[ 7] = std::bind( lock_test<basic_spin_flag<backoff_pause>>,                          async, iterations, work_loop );
+    tests[ 8] = std::bind( lock_test<basic_spin_flag<exponential>>,                            async, iterations, work_loop );
+    tests[ 9] = std::bind( lock_test<basic_spin_flag<yield>>,                                  async, iterations, work_loop );
+    tests[10] = std::bind( lock_test<spin_reader_writer_lock<rw_traits,backoff_none>>,         async, iterations, work_loop );
+    tests[11] = std::bind( lock_test<spin_reader_writer_lock<rw_traits,backoff_pause>>,        async, iterations, work_loop );
+    tests[12] = std::bind( lock_test<spin_reader_writer_lock<rw_traits,exponential>>,          async, iterations, work_loop );
+    tests[13] = std::bind( lock_test<spin_reader_writer_lock<rw_traits,yield>>,                async, iterations, work_loop );
+    tests[14] = std::bind( lock_test<ticket_lock>,                                             async, iterations, work_loop );
+    tests[15] = std::bind( lock_test<basic_ticket_lock<yield>>,                                async, iterations, work_loop );
+    tests[16] = std::bind( lock_test<mcs_lock>,                                                async, iterations, work_loop );
+    tests[17] = std::bind( lock_test<basic_mcs_lock<yield>>,                                   async, iterations, work_loop );
+    tests[18] = std::bind( lock_test<adaptive_mutex>,                                          async, iterations, work_loop );
+    tests[19] = std::bind( lock_test<spin_reader_writer_lock<rw_traits,exponential,rw_prefer_readers>>, async, iterations, work_loop );
+    tests[20] = std::bind( lock_test<spin_reader_writer_lock<rw_traits,exponential,rw_phase_fair>>, async, iterations, work_loop );
+    tests[21] = std::bind( lock_test<profiled_lock<spin_mutex>>,                               async, iterations, work_loop );
+    tests[22] = std::bind( lock_test<cohort_lock<>>,                                           async, iterations, work_loop );
 
     std::random_shuffle( tests.begin(), tests.end() );
 
@@ -250,19 +702,19 @@ void tst_spin_locks()
 
     float base = data.back().total_time;
 
-    printf("                                 Blocking             Working                 \n");
-    printf("Barrier            total mode ave     max  mode   ave     max     Total       \n");
-    printf("------------ ---------------------------- ------------------- --------- ------\n");
+    printf("                                                                             Blocking             Working                 \n");
+    printf("Barrier                                                        total mode ave     max  mode   ave     max     Total       \n");
+    printf("-------------------------------------------------------- ---------------------------- ------------------- --------- ------\n");
     for(auto& a: data)
     {
-        printf("%-12.12s ",             a.name.get() +5 );
+        printf("%-56.56s ",             short_name( a.name.get() ).c_str() );
         printf("%11lu %4lu %3lu %7lu ", a.time_stalled,a.mode_stalled,a.time_stalled/a.iterations,a.max_stalled);
         printf("%5lu %5lu %7lu ",       a.mode_loop,a.ave_loop,a.max_loop);
         printf("%9.3f ",                a.total_time);
         printf("%5.2f%%\n",             100-(a.total_time/base*100));
     }
-    printf("------------ ---------------------------- ------------------- --------- ------\n");
-    printf("             ^^^^^^^^^^^ ^^^^ ^microseconds^^^^ ^^^^^ ^^^^^^^ ^minutes^\n\n");
+    printf("-------------------------------------------------------- ---------------------------- ------------------- --------- ------\n");
+    printf("                                                         ^^^^^^^^^^^ ^^^^ ^microseconds^^^^ ^^^^^ ^^^^^^^ ^minutes^\n\n");
 
 
     tp_stop();
@@ -669,7 +669,9 @@ void tst_threading()
     //
     //     return;
 
-    tp_start( std::thread::hardware_concurrency() );
+    RC started = tp_start( std::thread::hardware_concurrency() );
+    assert( started == s_ok() );
+    (void)started;
 
     FunctionTests();
 
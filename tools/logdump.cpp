@@ -0,0 +1,52 @@
+//-------------------------------------------------------------------------------------------------
+// Copyright (C) 2014 Ernest R. Ewert
+//
+// Feel free to use this as you see fit.
+// I ask that you keep my name with the code.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+// MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+// IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+// OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+// ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+// OTHER DEALINGS IN THE SOFTWARE.
+//
+#include <ee5>
+
+#include "log_ring.h"
+
+#include <cstdio>
+#include <cstdlib>
+
+using namespace ee5;
+
+
+
+//---------------------------------------------------------------------------------------------------------------------
+//
+//  logdump <ring file> [count]
+//
+//  The last count records (100 unless given) of a MappedLogRing file, oldest first. The
+//  process that wrote the file doesn't have to be alive, or to have exited cleanly.
+//
+int main(int argc,char* argv[])
+{
+    if( argc < 2 || argc > 3 )
+    {
+        fprintf( stderr, "usage: %s <ring file> [count]\n", argv[0] );
+        return 2;
+    }
+
+    size_t count = argc == 3 ? strtoull( argv[2], nullptr, 10 ) : 100;
+
+    RC rc = MappedLogRing::Dump( argv[1], count, stdout );
+
+    if( rc < 0 )
+    {
+        fprintf( stderr, "%s: can't read %s (%llx)\n", argv[0], argv[1], static_cast<unsigned long long>( rc ) );
+        return 1;
+    }
+
+    return 0;
+}